@@ -0,0 +1,264 @@
+/*****************************************************************
+ * Description 有界多生产者多消费者协程通道
+ *  满时挂起发送协程，空时挂起接收协程，不阻塞线程
+ *  关闭后发送失败，接收方取完剩余数据后返回失败
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/11
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#ifndef __TIGER_CHANNEL_H__
+#define __TIGER_CHANNEL_H__
+
+#include <stdint.h>
+
+#include <list>
+#include <memory>
+#include <vector>
+
+#include "co_mutex.h"
+#include "macro.h"
+
+namespace tiger
+{
+
+template <typename T> class Channel
+{
+  public:
+    typedef std::shared_ptr<Channel> ptr;
+
+  private:
+    SpinLock m_lock;
+    // 环形缓冲区
+    std::vector<T> m_buffer;
+    size_t m_head = 0;
+    size_t m_size = 0;
+    bool m_closed = false;
+    CoWaitQueue m_senders;
+    CoWaitQueue m_receivers;
+
+  public:
+    explicit Channel(size_t capacity) : m_buffer(capacity)
+    {
+        TIGER_ASSERT_WITH_INFO(capacity > 0, "[channel capacity must be positive]");
+    }
+
+    bool send(const T &value)
+    {
+        T tmp(value);
+        return send(std::move(tmp));
+    }
+
+    // 满时挂起，通道关闭返回false
+    bool send(T &&value)
+    {
+        std::list<CoWaitQueue::Waiter> wakes;
+        m_lock.lock();
+        while (!m_closed && full())
+        {
+            park(m_senders);
+        }
+        if (m_closed)
+        {
+            m_lock.unlock();
+            return false;
+        }
+        push(std::move(value));
+        pop_waiters(m_receivers, 1, wakes);
+        m_lock.unlock();
+        wake(wakes);
+        return true;
+    }
+
+    bool try_send(T &&value)
+    {
+        std::list<CoWaitQueue::Waiter> wakes;
+        m_lock.lock();
+        if (m_closed || full())
+        {
+            m_lock.unlock();
+            return false;
+        }
+        push(std::move(value));
+        pop_waiters(m_receivers, 1, wakes);
+        m_lock.unlock();
+        wake(wakes);
+        return true;
+    }
+
+    // 批量发送，一次加锁写入尽可能多的数据，返回成功发送的个数(关闭时可能小于values.size())
+    size_t send_batch(std::vector<T> &values)
+    {
+        size_t sent = 0;
+        std::list<CoWaitQueue::Waiter> wakes;
+        m_lock.lock();
+        while (sent < values.size())
+        {
+            while (!m_closed && full())
+            {
+                // 挂起前先唤醒接收方，否则可能双方都在等
+                m_lock.unlock();
+                wake(wakes);
+                wakes.clear();
+                m_lock.lock();
+                if (!m_closed && full())
+                {
+                    park(m_senders);
+                }
+            }
+            if (m_closed)
+                break;
+            size_t cnt = 0;
+            while (sent < values.size() && !full())
+            {
+                push(std::move(values[sent++]));
+                ++cnt;
+            }
+            pop_waiters(m_receivers, cnt, wakes);
+        }
+        m_lock.unlock();
+        wake(wakes);
+        return sent;
+    }
+
+    // 空时挂起，通道关闭且无剩余数据返回false
+    bool recv(T &value)
+    {
+        std::list<CoWaitQueue::Waiter> wakes;
+        m_lock.lock();
+        while (!m_closed && m_size == 0)
+        {
+            park(m_receivers);
+        }
+        if (m_size == 0)
+        {
+            m_lock.unlock();
+            return false;
+        }
+        value = pop();
+        pop_waiters(m_senders, 1, wakes);
+        m_lock.unlock();
+        wake(wakes);
+        return true;
+    }
+
+    bool try_recv(T &value)
+    {
+        std::list<CoWaitQueue::Waiter> wakes;
+        m_lock.lock();
+        if (m_size == 0)
+        {
+            m_lock.unlock();
+            return false;
+        }
+        value = pop();
+        pop_waiters(m_senders, 1, wakes);
+        m_lock.unlock();
+        wake(wakes);
+        return true;
+    }
+
+    // 批量接收，至少等到一个数据后取走最多max_cnt个追加到values，返回取到的个数，关闭且为空返回0
+    size_t recv_batch(std::vector<T> &values, size_t max_cnt)
+    {
+        std::list<CoWaitQueue::Waiter> wakes;
+        m_lock.lock();
+        while (!m_closed && m_size == 0)
+        {
+            park(m_receivers);
+        }
+        size_t cnt = 0;
+        while (cnt < max_cnt && m_size > 0)
+        {
+            values.push_back(pop());
+            ++cnt;
+        }
+        pop_waiters(m_senders, cnt, wakes);
+        m_lock.unlock();
+        wake(wakes);
+        return cnt;
+    }
+
+    // 唤醒所有等待者，发送方返回失败，接收方取完剩余数据后返回失败
+    void close()
+    {
+        std::list<CoWaitQueue::Waiter> wakes;
+        m_lock.lock();
+        m_closed = true;
+        pop_waiters(m_senders, m_senders.size(), wakes);
+        pop_waiters(m_receivers, m_receivers.size(), wakes);
+        m_lock.unlock();
+        wake(wakes);
+    }
+
+    bool is_closed()
+    {
+        SpinLock::Lock lock(m_lock);
+        return m_closed;
+    }
+
+    size_t size()
+    {
+        SpinLock::Lock lock(m_lock);
+        return m_size;
+    }
+
+    size_t capacity() const
+    {
+        return m_buffer.size();
+    }
+
+  private:
+    bool full() const
+    {
+        return m_size == m_buffer.size();
+    }
+
+    void push(T &&value)
+    {
+        m_buffer[(m_head + m_size) % m_buffer.size()] = std::move(value);
+        ++m_size;
+    }
+
+    T pop()
+    {
+        T value = std::move(m_buffer[m_head]);
+        m_head = (m_head + 1) % m_buffer.size();
+        --m_size;
+        return value;
+    }
+
+    // 持锁进入，挂起当前协程，被唤醒后重新持锁返回，调用方需要重新检查条件
+    void park(CoWaitQueue &waiters)
+    {
+        waiters.push();
+        m_lock.unlock();
+        Coroutine::Yield();
+        m_lock.lock();
+    }
+
+    static void pop_waiters(CoWaitQueue &waiters, size_t cnt, std::list<CoWaitQueue::Waiter> &wakes)
+    {
+        while (cnt-- > 0 && !waiters.empty())
+        {
+            wakes.push_back(waiters.pop());
+        }
+    }
+
+    static void wake(std::list<CoWaitQueue::Waiter> &wakes)
+    {
+        for (auto &waiter : wakes)
+        {
+            waiter.wake();
+        }
+    }
+
+  private:
+    Channel(const Channel &) = delete;
+    Channel(const Channel &&) = delete;
+    Channel &operator=(const Channel &) = delete;
+};
+
+} // namespace tiger
+
+#endif
@@ -0,0 +1,271 @@
+/*****************************************************************
+ * Description
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/10
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#include "co_mutex.h"
+
+#include "macro.h"
+#include "scheduler.h"
+#include "thread.h"
+
+namespace tiger
+{
+
+void CoWaitQueue::Waiter::wake()
+{
+    // 调度器停止后不再接受任务，被唤醒的协程不会再运行
+    if (!scheduler->schedule(co, thread_id))
+    {
+        TIGER_LOG_E(SYSTEM_LOG) << "[co waiter wake fail scheduler stopping"
+                                << " co:" << co->id() << " thread:" << thread_id << "]";
+    }
+}
+
+void CoWaitQueue::push(bool is_writer)
+{
+    Waiter waiter;
+    waiter.scheduler = Scheduler::GetThreadScheduler().get();
+    waiter.co = Coroutine::GetRunningCo();
+    waiter.thread_id = Thread::CurThreadId();
+    waiter.is_writer = is_writer;
+    TIGER_ASSERT_WITH_INFO(waiter.scheduler, "[co sync primitive used outside scheduler]");
+    m_waiters.push_back(waiter);
+}
+
+CoWaitQueue::Waiter CoWaitQueue::pop()
+{
+    Waiter waiter = m_waiters.front();
+    m_waiters.pop_front();
+    return waiter;
+}
+
+void CoMutex::lock()
+{
+    m_lock.lock();
+    if (!m_locked)
+    {
+        m_locked = true;
+        m_lock.unlock();
+        return;
+    }
+    m_waiters.push();
+    m_lock.unlock();
+    // 被唤醒时锁已经转交给当前协程
+    Coroutine::Yield();
+}
+
+bool CoMutex::try_lock()
+{
+    SpinLock::Lock lock(m_lock);
+    if (m_locked)
+        return false;
+    m_locked = true;
+    return true;
+}
+
+void CoMutex::unlock()
+{
+    m_lock.lock();
+    if (m_waiters.empty())
+    {
+        m_locked = false;
+        m_lock.unlock();
+        return;
+    }
+    CoWaitQueue::Waiter waiter = m_waiters.pop();
+    m_lock.unlock();
+    waiter.wake();
+}
+
+void CoCondVar::wait(CoMutex &mutex)
+{
+    m_lock.lock();
+    m_waiters.push();
+    m_lock.unlock();
+    mutex.unlock();
+    Coroutine::Yield();
+    mutex.lock();
+}
+
+void CoCondVar::notify_one()
+{
+    m_lock.lock();
+    if (m_waiters.empty())
+    {
+        m_lock.unlock();
+        return;
+    }
+    CoWaitQueue::Waiter waiter = m_waiters.pop();
+    m_lock.unlock();
+    waiter.wake();
+}
+
+void CoCondVar::notify_all()
+{
+    std::list<CoWaitQueue::Waiter> wakes;
+    m_lock.lock();
+    while (!m_waiters.empty())
+    {
+        wakes.push_back(m_waiters.pop());
+    }
+    m_lock.unlock();
+    for (auto &waiter : wakes)
+    {
+        waiter.wake();
+    }
+}
+
+CoSemaphore::CoSemaphore(uint32_t count) : m_count(count)
+{
+}
+
+void CoSemaphore::wait()
+{
+    m_lock.lock();
+    if (m_count > 0)
+    {
+        --m_count;
+        m_lock.unlock();
+        return;
+    }
+    m_waiters.push();
+    m_lock.unlock();
+    // 被唤醒时post已经把计数直接交给当前协程
+    Coroutine::Yield();
+}
+
+bool CoSemaphore::try_wait()
+{
+    SpinLock::Lock lock(m_lock);
+    if (m_count == 0)
+        return false;
+    --m_count;
+    return true;
+}
+
+void CoSemaphore::post()
+{
+    m_lock.lock();
+    if (m_waiters.empty())
+    {
+        ++m_count;
+        m_lock.unlock();
+        return;
+    }
+    CoWaitQueue::Waiter waiter = m_waiters.pop();
+    m_lock.unlock();
+    waiter.wake();
+}
+
+void WaitGroup::add(int64_t cnt)
+{
+    SpinLock::Lock lock(m_lock);
+    m_count += cnt;
+    TIGER_ASSERT_WITH_INFO(m_count >= 0, "[wait group negative counter]");
+}
+
+void WaitGroup::done()
+{
+    std::list<CoWaitQueue::Waiter> wakes;
+    m_lock.lock();
+    TIGER_ASSERT_WITH_INFO(m_count > 0, "[wait group negative counter]");
+    if (--m_count == 0)
+    {
+        while (!m_waiters.empty())
+        {
+            wakes.push_back(m_waiters.pop());
+        }
+    }
+    m_lock.unlock();
+    for (auto &waiter : wakes)
+    {
+        waiter.wake();
+    }
+}
+
+void WaitGroup::wait()
+{
+    m_lock.lock();
+    if (m_count == 0)
+    {
+        m_lock.unlock();
+        return;
+    }
+    m_waiters.push();
+    m_lock.unlock();
+    Coroutine::Yield();
+}
+
+void CoRWLock::dispatch(std::list<CoWaitQueue::Waiter> &wakes)
+{
+    if (m_writer || m_waiters.empty())
+        return;
+    if (m_waiters.front().is_writer)
+    {
+        if (m_readers == 0)
+        {
+            m_writer = true;
+            wakes.push_back(m_waiters.pop());
+        }
+        return;
+    }
+    while (!m_waiters.empty() && !m_waiters.front().is_writer)
+    {
+        ++m_readers;
+        wakes.push_back(m_waiters.pop());
+    }
+}
+
+void CoRWLock::rdlock()
+{
+    m_lock.lock();
+    if (!m_writer && m_waiters.empty())
+    {
+        ++m_readers;
+        m_lock.unlock();
+        return;
+    }
+    m_waiters.push(false);
+    m_lock.unlock();
+    Coroutine::Yield();
+}
+
+void CoRWLock::wrlock()
+{
+    m_lock.lock();
+    if (!m_writer && m_readers == 0)
+    {
+        m_writer = true;
+        m_lock.unlock();
+        return;
+    }
+    m_waiters.push(true);
+    m_lock.unlock();
+    Coroutine::Yield();
+}
+
+void CoRWLock::unlock()
+{
+    std::list<CoWaitQueue::Waiter> wakes;
+    m_lock.lock();
+    if (m_writer)
+    {
+        m_writer = false;
+    }
+    else
+    {
+        TIGER_ASSERT_WITH_INFO(m_readers > 0, "[co rwlock unlock without holder]");
+        --m_readers;
+    }
+    dispatch(wakes);
+    m_lock.unlock();
+    for (auto &waiter : wakes)
+    {
+        waiter.wake();
+    }
+}
+
+} // namespace tiger
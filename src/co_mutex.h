@@ -0,0 +1,180 @@
+/*****************************************************************
+ * Description 协程同步原语
+ *  资源不可用时挂起当前协程而不是阻塞线程，资源释放时通过调度器唤醒等待的协程
+ *  只能在调度器的协程中使用
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/10
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#ifndef __TIGER_CO_MUTEX_H__
+#define __TIGER_CO_MUTEX_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <list>
+
+#include "coroutine.h"
+#include "mutex.h"
+
+namespace tiger
+{
+
+class Scheduler;
+
+// 等待队列，调用方负责加锁
+class CoWaitQueue
+{
+  public:
+    struct Waiter
+    {
+        Scheduler *scheduler = nullptr;
+        Coroutine::ptr co;
+        pid_t thread_id = 0;
+        // CoRWLock中标记写等待
+        bool is_writer = false;
+
+        // 唤醒时指定原线程，保证协程让出之后才会被再次resume
+        void wake();
+    };
+
+  private:
+    std::list<Waiter> m_waiters;
+
+  public:
+    bool empty() const
+    {
+        return m_waiters.empty();
+    }
+    size_t size() const
+    {
+        return m_waiters.size();
+    }
+    Waiter &front()
+    {
+        return m_waiters.front();
+    }
+
+    // 把当前协程加入队列，调用方解锁后再让出
+    void push(bool is_writer = false);
+    Waiter pop();
+};
+
+class CoMutex
+{
+  private:
+    SpinLock m_lock;
+    bool m_locked = false;
+    CoWaitQueue m_waiters;
+
+  public:
+    typedef ScopedLockTmpl<CoMutex> Lock;
+
+    CoMutex() = default;
+
+    void lock();
+    bool try_lock();
+    // 有等待者时直接把锁交给队首协程
+    void unlock();
+
+  private:
+    CoMutex(const CoMutex &) = delete;
+    CoMutex(const CoMutex &&) = delete;
+    CoMutex &operator=(const CoMutex &) = delete;
+};
+
+class CoCondVar
+{
+  private:
+    SpinLock m_lock;
+    CoWaitQueue m_waiters;
+
+  public:
+    CoCondVar() = default;
+
+    // 调用前mutex必须已加锁，返回时重新持有mutex
+    void wait(CoMutex &mutex);
+    void notify_one();
+    void notify_all();
+
+  private:
+    CoCondVar(const CoCondVar &) = delete;
+    CoCondVar(const CoCondVar &&) = delete;
+    CoCondVar &operator=(const CoCondVar &) = delete;
+};
+
+class CoSemaphore
+{
+  private:
+    SpinLock m_lock;
+    uint32_t m_count;
+    CoWaitQueue m_waiters;
+
+  public:
+    CoSemaphore(uint32_t count = 0);
+
+    void wait();
+    bool try_wait();
+    void post();
+
+  private:
+    CoSemaphore(const CoSemaphore &) = delete;
+    CoSemaphore(const CoSemaphore &&) = delete;
+    CoSemaphore &operator=(const CoSemaphore &) = delete;
+};
+
+// 等待一组任务完成，计数归零时唤醒所有等待的协程
+class WaitGroup
+{
+  private:
+    SpinLock m_lock;
+    int64_t m_count = 0;
+    CoWaitQueue m_waiters;
+
+  public:
+    WaitGroup() = default;
+
+    // 在启动任务之前调用
+    void add(int64_t cnt = 1);
+    void done();
+    // 计数已经为0时立即返回
+    void wait();
+
+  private:
+    WaitGroup(const WaitGroup &) = delete;
+    WaitGroup(const WaitGroup &&) = delete;
+    WaitGroup &operator=(const WaitGroup &) = delete;
+};
+
+// 按等待顺序授予，写等待之后到来的读者排队，避免写饥饿
+class CoRWLock
+{
+  private:
+    SpinLock m_lock;
+    uint32_t m_readers = 0;
+    bool m_writer = false;
+    CoWaitQueue m_waiters;
+
+  private:
+    void dispatch(std::list<CoWaitQueue::Waiter> &wakes);
+
+  public:
+    typedef ReadScopedLockTmpl<CoRWLock> ReadLock;
+    typedef WriteScopedLockTmpl<CoRWLock> WriteLock;
+
+    CoRWLock() = default;
+
+    void rdlock();
+    void wrlock();
+    void unlock();
+
+  private:
+    CoRWLock(const CoRWLock &) = delete;
+    CoRWLock(const CoRWLock &&) = delete;
+    CoRWLock &operator=(const CoRWLock &) = delete;
+};
+
+} // namespace tiger
+
+#endif
@@ -28,6 +28,29 @@ template <typename FromType, typename ToType> class LexicalCast
     }
 };
 
+// boost::lexical_cast只认0/1，yaml中的布尔值写作true/false
+template <> class LexicalCast<std::string, bool>
+{
+  public:
+    bool operator()(const std::string &v)
+    {
+        if (v == "true")
+            return true;
+        if (v == "false")
+            return false;
+        return boost::lexical_cast<bool>(v);
+    }
+};
+
+template <> class LexicalCast<bool, std::string>
+{
+  public:
+    std::string operator()(const bool &v)
+    {
+        return v ? "true" : "false";
+    }
+};
+
 template <typename T> class LexicalCast<std::string, std::vector<T>>
 {
   public:
@@ -0,0 +1,95 @@
+/*****************************************************************
+ * Description
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/06
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#include "context.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "macro.h"
+
+extern "C"
+{
+    // 新上下文第一次切入时的入口，见context.S
+    void tiger_context_start();
+}
+
+namespace tiger
+{
+
+void UContext::init()
+{
+    if (getcontext(&m_ctx))
+    {
+        TIGER_ASSERT_WITH_INFO(false, "[getcontext fail]");
+    }
+}
+
+void UContext::make(void *stack, size_t stack_size, void (*fn)())
+{
+    init();
+    m_ctx.uc_link = nullptr;
+    m_ctx.uc_stack.ss_sp = stack;
+    m_ctx.uc_stack.ss_flags = 0;
+    m_ctx.uc_stack.ss_size = stack_size;
+    makecontext(&m_ctx, fn, 0);
+}
+
+void UContext::swap(UContext &to)
+{
+    if (swapcontext(&m_ctx, &to.m_ctx))
+    {
+        TIGER_ASSERT_WITH_INFO(false, "[swapcontext fail]");
+    }
+}
+
+void *UContext::sp() const
+{
+#if defined(__x86_64__)
+    return reinterpret_cast<void *>(m_ctx.uc_mcontext.gregs[REG_RSP]);
+#elif defined(__aarch64__)
+    return reinterpret_cast<void *>(m_ctx.uc_mcontext.sp);
+#else
+    return nullptr;
+#endif
+}
+
+#ifdef TIGER_HAS_ASM_CONTEXT
+// 构造初始栈帧，布局与context.S中tiger_switch_context的恢复顺序一致
+void AsmContext::make(void *stack, size_t stack_size, void (*fn)())
+{
+    uintptr_t top = (reinterpret_cast<uintptr_t>(stack) + stack_size) & ~static_cast<uintptr_t>(15);
+#if defined(__x86_64__)
+    // mxcsr/x87cw, r12, r13, r14, r15, rbx(fn), rbp, ret(tiger_context_start)
+    uint64_t *sp = reinterpret_cast<uint64_t *>(top) - 8;
+    memset(sp, 0, 8 * sizeof(uint64_t));
+    uint32_t *fpu = reinterpret_cast<uint32_t *>(sp);
+    __asm__ __volatile__("stmxcsr %0" : "=m"(fpu[0]));
+    __asm__ __volatile__("fnstcw %0" : "=m"(fpu[1]));
+    sp[5] = reinterpret_cast<uint64_t>(fn);
+    sp[7] = reinterpret_cast<uint64_t>(&tiger_context_start);
+#elif defined(__aarch64__)
+    // d8-d15, x19(fn)-x28, x29, x30(tiger_context_start)
+    uint64_t *sp = reinterpret_cast<uint64_t *>(top) - 20;
+    memset(sp, 0, 20 * sizeof(uint64_t));
+    sp[8] = reinterpret_cast<uint64_t>(fn);
+    sp[19] = reinterpret_cast<uint64_t>(&tiger_context_start);
+#endif
+    m_sp = sp;
+}
+#endif
+
+const char *ContextBackend()
+{
+#ifdef TIGER_USE_ASM_CONTEXT
+    return "asm";
+#else
+    return "ucontext";
+#endif
+}
+
+} // namespace tiger
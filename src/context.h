@@ -0,0 +1,84 @@
+/*****************************************************************
+ * Description 协程上下文切换
+ *  AsmContext只保存callee-saved寄存器，切换时不需要系统调用
+ *  UContext基于ucontext，swapcontext每次都会调用rt_sigprocmask
+ *  编译时定义TIGER_ASM_CONTEXT且平台支持时协程使用AsmContext
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/06
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#ifndef __TIGER_CONTEXT_H__
+#define __TIGER_CONTEXT_H__
+
+#include <stddef.h>
+#include <ucontext.h>
+
+#if defined(__x86_64__) || defined(__aarch64__)
+#define TIGER_HAS_ASM_CONTEXT 1
+#endif
+
+#if defined(TIGER_ASM_CONTEXT) && defined(TIGER_HAS_ASM_CONTEXT)
+#define TIGER_USE_ASM_CONTEXT 1
+#endif
+
+extern "C"
+{
+    // 保存当前寄存器并把栈指针写入*from_sp，然后切换到to_sp
+    void tiger_switch_context(void **from_sp, void *to_sp);
+}
+
+namespace tiger
+{
+
+class UContext
+{
+  private:
+    ucontext_t m_ctx;
+
+  public:
+    // 当前线程上下文，只用于保存现场
+    void init();
+    // fn不能返回
+    void make(void *stack, size_t stack_size, void (*fn)());
+    void swap(UContext &to);
+    // 切出时保存的栈指针，平台不支持时返回nullptr
+    void *sp() const;
+};
+
+#ifdef TIGER_HAS_ASM_CONTEXT
+class AsmContext
+{
+  private:
+    void *m_sp = nullptr;
+
+  public:
+    void init()
+    {
+        m_sp = nullptr;
+    }
+    // fn不能返回
+    void make(void *stack, size_t stack_size, void (*fn)());
+    void swap(AsmContext &to)
+    {
+        tiger_switch_context(&m_sp, to.m_sp);
+    }
+    void *sp() const
+    {
+        return m_sp;
+    }
+};
+#endif
+
+#ifdef TIGER_USE_ASM_CONTEXT
+typedef AsmContext Context;
+#else
+typedef UContext Context;
+#endif
+
+// 当前协程使用的上下文切换实现名
+const char *ContextBackend();
+
+} // namespace tiger
+
+#endif
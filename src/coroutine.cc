@@ -7,9 +7,16 @@
 
 #include "coroutine.h"
 
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
 #include <atomic>
 
 #include "config.h"
+#include "mutex.h"
+#include "stack_allocator.h"
+#include "thread.h"
 
 namespace tiger
 {
@@ -22,21 +29,69 @@ static thread_local Coroutine::ptr s_t_main_co = nullptr;
 
 static ConfigVar<size_t>::ptr g_co_stack_size =
     Config::Lookup<size_t>("tiger.coroutine.stackSize", 1024 * 128, "Coroutine Stack Size");
+static ConfigVar<size_t>::ptr g_co_pool_size =
+    Config::Lookup<size_t>("tiger.coroutine.poolSize", 64, "Coroutine Pool Size Per Thread");
+
+static ConfigVar<size_t>::ptr g_co_shared_stack_size =
+    Config::Lookup<size_t>("tiger.coroutine.sharedStackSize", 1024 * 1024, "Coroutine Shared Stack Size");
+static ConfigVar<size_t>::ptr g_co_shared_stack_cnt =
+    Config::Lookup<size_t>("tiger.coroutine.sharedStackCnt", 4, "Coroutine Shared Stack Count Per Thread");
+
+static ConfigVar<uint32_t>::ptr g_co_stack_paint_sample = Config::Lookup<uint32_t>(
+    "tiger.coroutine.stackPaintSample", 0, "Coroutine Stack Paint Sample Rate, 0 Disable, N Paint One In N");
+
+static const uint64_t STACK_PAINT_MAGIC = 0x5a5aa5a55a5aa5a5ULL;
+static std::atomic<size_t> s_co_paint_seq{0};
+
+static bool StackPaintSampled()
+{
+    uint32_t sample = g_co_stack_paint_sample->val();
+    return sample && s_co_paint_seq.fetch_add(1, std::memory_order_relaxed) % sample == 0;
+}
+
+static thread_local std::vector<Coroutine::ptr> s_t_co_pool;
+static std::atomic<size_t> s_co_pool_hit{0};
+static std::atomic<size_t> s_co_pool_miss{0};
 
-class MallocStackAllocator
+class SharedStack
 {
   public:
-    static void *Alloc(size_t size)
+    typedef std::shared_ptr<SharedStack> ptr;
+
+    // 协程可能在其他线程析构，访问owner需要加锁
+    SpinLock lock;
+    Coroutine *owner = nullptr;
+    void *stack = nullptr;
+    size_t size = 0;
+
+    SharedStack(size_t s) : size(s)
     {
-        return malloc(size);
+        stack = StackAllocator::Alloc(size);
+        TIGER_ASSERT_WITH_INFO(stack, "[alloc coroutine shared stack fail]");
     }
 
-    static void Dealloc(void *vp)
+    ~SharedStack()
     {
-        return free(vp);
+        StackAllocator::Dealloc(stack, size);
     }
 };
 
+static thread_local std::vector<SharedStack::ptr> s_t_shared_stacks;
+static thread_local size_t s_t_shared_stack_idx = 0;
+
+static SharedStack::ptr NextSharedStack()
+{
+    if (s_t_shared_stacks.empty())
+    {
+        size_t cnt = std::max<size_t>(g_co_shared_stack_cnt->val(), 1);
+        for (size_t i = 0; i < cnt; ++i)
+        {
+            s_t_shared_stacks.push_back(std::make_shared<SharedStack>(g_co_shared_stack_size->val()));
+        }
+    }
+    return s_t_shared_stacks[s_t_shared_stack_idx++ % s_t_shared_stacks.size()];
+}
+
 size_t Coroutine::CurCoroutineId()
 {
     if (s_t_running_co)
@@ -55,6 +110,11 @@ std::shared_ptr<Coroutine> Coroutine::GetRunningCo()
     return s_t_main_co;
 }
 
+bool Coroutine::InCoroutine()
+{
+    return s_t_running_co && s_t_running_co != s_t_main_co;
+}
+
 void Coroutine::Yield()
 {
     if (s_t_running_co)
@@ -67,6 +127,11 @@ void Coroutine::Resume()
         s_t_main_co->resume();
 }
 
+size_t Coroutine::DefaultStackSize()
+{
+    return g_co_stack_size->val();
+}
+
 void Coroutine::Run()
 {
     try
@@ -87,21 +152,19 @@ void Coroutine::Run()
         TIGER_LOG_E(tiger::SYSTEM_LOG) << "[run coroutine fail"
                                        << " id:" << s_t_running_co->m_id << "]";
     }
-    swapcontext(&(s_t_running_co->m_ctx), &(s_t_main_co->m_ctx));
+    s_t_running_co->m_ctx.swap(s_t_main_co->m_ctx);
 }
 
 Coroutine::Coroutine()
 {
     m_state = State::RUNNING;
     m_id = ++s_co_id;
-    if (getcontext(&m_ctx))
-    {
-        TIGER_ASSERT_WITH_INFO(false, "[getcontext fail]");
-    }
+    m_ctx.init();
     ++s_co_cnt;
 }
 
-Coroutine::Coroutine(std::function<void()> fn, size_t stack_size) : m_fn(fn), m_state(State::INIT)
+Coroutine::Coroutine(std::function<void()> fn, size_t stack_size, bool shared)
+    : m_fn(fn), m_state(State::INIT), m_shared(shared)
 {
     if (!s_t_main_co)
     {
@@ -109,24 +172,34 @@ Coroutine::Coroutine(std::function<void()> fn, size_t stack_size) : m_fn(fn), m_
         s_t_running_co = s_t_main_co;
     }
     m_id = ++s_co_id;
-    m_stack_size = stack_size == 0 ? g_co_stack_size->val() : stack_size;
-    m_stack = MallocStackAllocator::Alloc(m_stack_size);
-    if (getcontext(&m_ctx))
+    // 共享栈在第一次resume时绑定
+    if (!m_shared)
     {
-        TIGER_ASSERT_WITH_INFO(false, "[getcontext fail]");
+        m_stack_size = stack_size == 0 ? g_co_stack_size->val() : stack_size;
+        m_stack = StackAllocator::Alloc(m_stack_size);
+        TIGER_ASSERT_WITH_INFO(m_stack, "[alloc coroutine stack fail]");
+        if (StackPaintSampled())
+        {
+            m_painted = true;
+            paint_stack(m_stack_size);
+        }
+        m_ctx.make(m_stack, m_stack_size, &Coroutine::Run);
     }
-    m_ctx.uc_stack.ss_sp = m_stack;
-    m_ctx.uc_stack.ss_flags = 0;
-    m_ctx.uc_stack.ss_size = m_stack_size;
-    makecontext(&m_ctx, &Coroutine::Run, 0);
     ++s_co_cnt;
 }
 
 Coroutine::~Coroutine()
 {
-    if (m_stack)
+    if (m_shared)
+    {
+        release_shared_stack();
+        free(m_saved_stack);
+        m_saved_stack = nullptr;
+        m_stack = nullptr;
+    }
+    else if (m_stack)
     {
-        MallocStackAllocator::Dealloc(m_stack);
+        StackAllocator::Dealloc(m_stack, m_stack_size);
         m_stack = nullptr;
     }
     else
@@ -143,45 +216,243 @@ void Coroutine::yield()
     m_state = State::YIELD;
     s_t_main_co->m_state = State::RUNNING;
     s_t_running_co = s_t_main_co;
-    if (swapcontext(&m_ctx, &(s_t_main_co->m_ctx)))
-    {
-        TIGER_ASSERT_WITH_INFO(false, "[swapcontext fail]");
-    }
+    m_ctx.swap(s_t_main_co->m_ctx);
 }
 
 void Coroutine::resume()
 {
     TIGER_ASSERT_WITH_INFO(m_state & (State::INIT | State::YIELD),
                            "[coroutine can only be resumed when it is INIT or Yield]");
+    if (m_shared)
+    {
+        switch_in_shared_stack();
+    }
     s_t_main_co->m_state = State::YIELD;
     m_state = State::RUNNING;
     s_t_running_co = shared_from_this();
-    if (swapcontext(&(s_t_main_co->m_ctx), &m_ctx))
-    {
-        TIGER_ASSERT_WITH_INFO(false, "[swapcontext fail]");
-    }
+    s_t_main_co->m_ctx.swap(m_ctx);
     s_t_main_co->m_state = State::RUNNING;
     s_t_running_co = s_t_main_co;
+    if (m_state & (State::TERMINAL | State::EXCEPT))
+    {
+        if (m_shared)
+        {
+            release_shared_stack();
+        }
+        else if (m_painted)
+        {
+            m_stack_used = measure_stack();
+        }
+    }
+}
+
+void Coroutine::paint_stack(size_t used)
+{
+    // 栈从高地址向低地址增长，只需要重新涂上次用过的部分
+    size_t cnt = std::min(used, m_stack_size) / sizeof(uint64_t);
+    uint64_t *end = reinterpret_cast<uint64_t *>(static_cast<char *>(m_stack) + m_stack_size);
+    for (uint64_t *p = end - cnt; p < end; ++p)
+    {
+        *p = STACK_PAINT_MAGIC;
+    }
+}
+
+size_t Coroutine::measure_stack() const
+{
+    const uint64_t *begin = static_cast<const uint64_t *>(m_stack);
+    const uint64_t *end = begin + m_stack_size / sizeof(uint64_t);
+    const uint64_t *p = begin;
+    while (p < end && *p == STACK_PAINT_MAGIC)
+    {
+        ++p;
+    }
+    return (end - p) * sizeof(uint64_t);
+}
+
+void Coroutine::switch_in_shared_stack()
+{
+    if (!m_shared_stack)
+    {
+        m_shared_stack = NextSharedStack();
+        m_shared_thread_id = Thread::CurThreadId();
+        m_stack = m_shared_stack->stack;
+        m_stack_size = m_shared_stack->size;
+    }
+    TIGER_ASSERT_WITH_INFO(m_shared_thread_id == Thread::CurThreadId(),
+                           "[shared stack coroutine resumed on another thread]");
+    SpinLock::Lock lock(m_shared_stack->lock);
+    Coroutine *owner = m_shared_stack->owner;
+    if (owner == this && !(m_state & State::INIT))
+        return;
+    if (owner && owner != this)
+    {
+        owner->save_shared_stack();
+    }
+    m_shared_stack->owner = this;
+    if (m_state & State::INIT)
+    {
+        m_ctx.make(m_stack, m_stack_size, &Coroutine::Run);
+    }
+    else
+    {
+        memcpy(static_cast<char *>(m_stack) + m_stack_size - m_saved_size, m_saved_stack, m_saved_size);
+    }
+}
+
+void Coroutine::save_shared_stack()
+{
+    char *top = static_cast<char *>(m_stack) + m_stack_size;
+    char *sp = static_cast<char *>(m_ctx.sp());
+    if (!sp || sp < static_cast<char *>(m_stack) || sp > top)
+    {
+        sp = static_cast<char *>(m_stack);
+    }
+    m_saved_size = top - sp;
+    if (m_saved_size > m_saved_cap)
+    {
+        free(m_saved_stack);
+        m_saved_stack = static_cast<char *>(malloc(m_saved_size));
+        TIGER_ASSERT_WITH_INFO(m_saved_stack, "[alloc coroutine saved stack fail]");
+        m_saved_cap = m_saved_size;
+    }
+    memcpy(m_saved_stack, sp, m_saved_size);
+}
+
+void Coroutine::release_shared_stack()
+{
+    if (!m_shared_stack)
+        return;
+    SpinLock::Lock lock(m_shared_stack->lock);
+    if (m_shared_stack->owner == this)
+    {
+        m_shared_stack->owner = nullptr;
+    }
+}
+
+void Coroutine::set_name(const std::string &name)
+{
+    size_t len = std::min(name.size(), sizeof(m_name) - 1);
+    memcpy(m_name, name.data(), len);
+    m_name[len] = '\0';
 }
 
 bool Coroutine::reset(std::function<void()> fn)
 {
-    TIGER_ASSERT_WITH_INFO(m_stack, "[coroutine stack is nullptr]");
+    TIGER_ASSERT_WITH_INFO(m_stack || m_shared, "[coroutine stack is nullptr]");
     if (m_state & (State::INIT | State::TERMINAL | State::EXCEPT))
     {
         m_fn = fn;
-        if (getcontext(&m_ctx))
-        {
-            TIGER_ASSERT_WITH_INFO(false, "[getcontext fail]");
-        }
         m_id = ++s_co_id;
-        m_ctx.uc_stack.ss_sp = m_stack;
-        m_ctx.uc_stack.ss_size = m_stack_size;
         m_state = State::INIT;
-        makecontext(&m_ctx, &Coroutine::Run, 0);
+        m_saved_size = 0;
+        m_name[0] = '\0';
+        if (!m_shared)
+        {
+            if (m_painted)
+            {
+                paint_stack(m_stack_used ? m_stack_used : m_stack_size);
+                m_stack_used = 0;
+            }
+            else if (StackPaintSampled())
+            {
+                m_painted = true;
+                paint_stack(m_stack_size);
+            }
+            m_ctx.make(m_stack, m_stack_size, &Coroutine::Run);
+        }
         return true;
     }
     return false;
 }
 
-} // namespace tiger
\ No newline at end of file
+Coroutine::ptr CoroutinePool::Get(std::function<void()> fn, size_t stack_size)
+{
+    stack_size = stack_size == 0 ? g_co_stack_size->val() : stack_size;
+    if (!s_t_co_pool.empty())
+    {
+        Coroutine::ptr co;
+        co.swap(s_t_co_pool.back());
+        s_t_co_pool.pop_back();
+        if (co->stack_size() == stack_size && co->reset(fn))
+        {
+            s_co_pool_hit.fetch_add(1, std::memory_order_relaxed);
+            return co;
+        }
+    }
+    s_co_pool_miss.fetch_add(1, std::memory_order_relaxed);
+    return std::make_shared<Coroutine>(fn, stack_size);
+}
+
+bool CoroutinePool::Put(Coroutine::ptr &co)
+{
+    if (!co || co.use_count() != 1)
+        return false;
+    if (co->shared() || !(co->state() & (Coroutine::State::TERMINAL | Coroutine::State::EXCEPT)))
+        return false;
+    if (s_t_co_pool.size() >= g_co_pool_size->val())
+        return false;
+    s_t_co_pool.push_back(nullptr);
+    s_t_co_pool.back().swap(co);
+    return true;
+}
+
+size_t CoroutinePool::CachedCnt()
+{
+    return s_t_co_pool.size();
+}
+
+size_t CoroutinePool::HitCnt()
+{
+    return s_co_pool_hit;
+}
+
+size_t CoroutinePool::MissCnt()
+{
+    return s_co_pool_miss;
+}
+
+StackUsageStats::StackUsageStats()
+{
+    for (size_t i = 0; i < BUCKET_CNT; ++i)
+    {
+        m_buckets[i] = 0;
+    }
+}
+
+size_t StackUsageStats::add(size_t used)
+{
+    size_t idx = std::min((used + BUCKET_SIZE - 1) / BUCKET_SIZE, BUCKET_CNT - 1);
+    m_buckets[idx].fetch_add(1, std::memory_order_relaxed);
+    size_t max = m_max.load(std::memory_order_relaxed);
+    while (used > max && !m_max.compare_exchange_weak(max, used, std::memory_order_relaxed))
+    {
+    }
+    return m_cnt.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+size_t StackUsageStats::percentile(double p) const
+{
+    size_t total = 0;
+    size_t cnts[BUCKET_CNT];
+    for (size_t i = 0; i < BUCKET_CNT; ++i)
+    {
+        cnts[i] = m_buckets[i].load(std::memory_order_relaxed);
+        total += cnts[i];
+    }
+    if (total == 0)
+        return 0;
+    size_t target = static_cast<size_t>(p * total);
+    target = std::max<size_t>(std::min(target, total), 1);
+    size_t acc = 0;
+    for (size_t i = 0; i < BUCKET_CNT; ++i)
+    {
+        acc += cnts[i];
+        if (acc >= target)
+        {
+            return i == BUCKET_CNT - 1 ? std::max(m_max.load(), i * BUCKET_SIZE) : i * BUCKET_SIZE;
+        }
+    }
+    return m_max;
+}
+
+} // namespace tiger
@@ -8,14 +8,19 @@
 #ifndef __TIGER_COROUTINE_H__
 #define __TIGER_COROUTINE_H__
 
-#include <ucontext.h>
+#include <sys/types.h>
 
+#include <atomic>
 #include <functional>
 #include <memory>
 
+#include "context.h"
+
 namespace tiger
 {
 
+class SharedStack;
+
 class Coroutine : public std::enable_shared_from_this<Coroutine>
 {
   public:
@@ -32,18 +37,37 @@ class Coroutine : public std::enable_shared_from_this<Coroutine>
     size_t m_id;
     std::function<void()> m_fn;
     State m_state;
-    ucontext_t m_ctx;
+    Context m_ctx;
     void *m_stack = nullptr;
     size_t m_stack_size = 0;
+    // 共享栈模式：在线程的共享栈上运行，栈被其他协程占用时才把已用部分拷贝出去
+    bool m_shared = false;
+    pid_t m_shared_thread_id = 0;
+    std::shared_ptr<SharedStack> m_shared_stack;
+    char *m_saved_stack = nullptr;
+    size_t m_saved_size = 0;
+    size_t m_saved_cap = 0;
+    // 栈涂色：创建时用固定值填充栈，结束时扫描得到栈使用的最高水位
+    bool m_painted = false;
+    size_t m_stack_used = 0;
+    // 定长数组，看门狗在信号处理函数中读取时不会访问到释放的内存
+    char m_name[32] = {0};
 
   private:
     static void Run();
 
+    void switch_in_shared_stack();
+    void save_shared_stack();
+    void release_shared_stack();
+    void paint_stack(size_t used);
+    size_t measure_stack() const;
+
   public:
     typedef std::shared_ptr<Coroutine> ptr;
 
     explicit Coroutine();
-    explicit Coroutine(std::function<void()> fn, size_t stack_size = 0);
+    // shared为true时使用共享栈，第一次resume后只能在同一线程上resume
+    explicit Coroutine(std::function<void()> fn, size_t stack_size = 0, bool shared = false);
     ~Coroutine();
 
     const size_t id() const
@@ -54,6 +78,35 @@ class Coroutine : public std::enable_shared_from_this<Coroutine>
     {
         return m_state;
     }
+    size_t stack_size() const
+    {
+        return m_stack_size;
+    }
+    bool shared() const
+    {
+        return m_shared;
+    }
+    // 共享栈协程绑定的线程，未运行过或非共享栈协程返回0
+    pid_t shared_thread_id() const
+    {
+        return m_shared_thread_id;
+    }
+    // 共享栈协程让出后保存的栈大小
+    size_t saved_stack_size() const
+    {
+        return m_saved_size;
+    }
+    // 涂色协程结束后的栈使用峰值，未涂色或未结束时返回0
+    size_t stack_used() const
+    {
+        return m_stack_used;
+    }
+    // 用于看门狗等诊断输出，超长截断，复用时清空
+    const char *name() const
+    {
+        return m_name;
+    }
+    void set_name(const std::string &name);
 
   public:
     void yield();
@@ -63,8 +116,54 @@ class Coroutine : public std::enable_shared_from_this<Coroutine>
   public:
     static size_t CurCoroutineId();
     static std::shared_ptr<Coroutine> GetRunningCo();
+    // 当前是否运行在子协程中(而不是线程的主协程)
+    static bool InCoroutine();
     static void Yield();
     static void Resume();
+    // tiger.coroutine.stackSize
+    static size_t DefaultStackSize();
+};
+
+// 线程本地的已结束协程缓存，复用协程栈
+class CoroutinePool
+{
+  public:
+    // stack_size为0时使用默认栈大小
+    static Coroutine::ptr Get(std::function<void()> fn, size_t stack_size = 0);
+    static bool Put(Coroutine::ptr &co);
+
+    static size_t CachedCnt();
+    static size_t HitCnt();
+    static size_t MissCnt();
+};
+
+// 协程栈使用峰值统计，按1KB分桶
+class StackUsageStats
+{
+  public:
+    static const size_t BUCKET_SIZE = 1024;
+    static const size_t BUCKET_CNT = 1024;
+
+  private:
+    std::atomic<size_t> m_cnt{0};
+    std::atomic<size_t> m_max{0};
+    std::atomic<size_t> m_buckets[BUCKET_CNT];
+
+  public:
+    StackUsageStats();
+
+    // 返回累计样本数
+    size_t add(size_t used);
+    size_t count() const
+    {
+        return m_cnt;
+    }
+    size_t max() const
+    {
+        return m_max;
+    }
+    // p取值(0, 1]，返回该分位所在桶的上界
+    size_t percentile(double p) const;
 };
 
 } // namespace tiger
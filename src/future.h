@@ -0,0 +1,298 @@
+/*****************************************************************
+ * Description 协程Future/Promise
+ *  在协程中等待结果时挂起协程而不是阻塞线程，不在协程中等待时退化为阻塞线程
+ *  Future可以拷贝，多个持有者共享同一个结果
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/12
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#ifndef __TIGER_FUTURE_H__
+#define __TIGER_FUTURE_H__
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <list>
+#include <memory>
+#include <vector>
+
+#include "co_mutex.h"
+#include "macro.h"
+#include "scheduler.h"
+
+namespace tiger
+{
+
+template <typename T> struct FutureValue
+{
+    std::unique_ptr<T> value;
+
+    template <typename... Args> void set(Args &&...args)
+    {
+        value.reset(new T(std::forward<Args>(args)...));
+    }
+    T get()
+    {
+        return *value;
+    }
+};
+
+template <> struct FutureValue<void>
+{
+    void set()
+    {
+    }
+    void get()
+    {
+    }
+};
+
+template <typename T> class FutureState
+{
+  public:
+    typedef std::shared_ptr<FutureState> ptr;
+
+  private:
+    SpinLock m_lock;
+    bool m_ready = false;
+    FutureValue<T> m_value;
+    std::exception_ptr m_error;
+    CoWaitQueue m_waiters;
+    std::vector<std::function<void()>> m_callbacks;
+
+  public:
+    bool ready()
+    {
+        SpinLock::Lock lock(m_lock);
+        return m_ready;
+    }
+
+    template <typename... Args> void set_value(Args &&...args)
+    {
+        m_lock.lock();
+        TIGER_ASSERT_WITH_INFO(!m_ready, "[promise already satisfied]");
+        m_value.set(std::forward<Args>(args)...);
+        finish();
+    }
+
+    void set_exception(std::exception_ptr error)
+    {
+        m_lock.lock();
+        TIGER_ASSERT_WITH_INFO(!m_ready, "[promise already satisfied]");
+        m_error = error;
+        finish();
+    }
+
+    void wait()
+    {
+        m_lock.lock();
+        if (m_ready)
+        {
+            m_lock.unlock();
+            return;
+        }
+        if (Scheduler::GetThreadScheduler() && Coroutine::InCoroutine())
+        {
+            // 被唤醒时结果已经就绪
+            m_waiters.push();
+            m_lock.unlock();
+            Coroutine::Yield();
+            return;
+        }
+        Semaphore sem;
+        m_callbacks.push_back([&sem]() { sem.post(); });
+        m_lock.unlock();
+        sem.wait();
+    }
+
+    T get()
+    {
+        wait();
+        if (m_error)
+        {
+            std::rethrow_exception(m_error);
+        }
+        return m_value.get();
+    }
+
+    // 就绪后在设置结果的线程上执行，已就绪则立即执行，回调应当很轻
+    void on_ready(std::function<void()> cb)
+    {
+        m_lock.lock();
+        if (!m_ready)
+        {
+            m_callbacks.push_back(std::move(cb));
+            m_lock.unlock();
+            return;
+        }
+        m_lock.unlock();
+        cb();
+    }
+
+  private:
+    // 持锁进入，释放锁后唤醒等待者
+    void finish()
+    {
+        m_ready = true;
+        std::list<CoWaitQueue::Waiter> wakes;
+        while (!m_waiters.empty())
+        {
+            wakes.push_back(m_waiters.pop());
+        }
+        std::vector<std::function<void()>> callbacks;
+        callbacks.swap(m_callbacks);
+        m_lock.unlock();
+        for (auto &waiter : wakes)
+        {
+            waiter.wake();
+        }
+        for (auto &cb : callbacks)
+        {
+            cb();
+        }
+    }
+};
+
+template <typename T> class Future
+{
+  private:
+    typename FutureState<T>::ptr m_state;
+
+  public:
+    Future() = default;
+    explicit Future(typename FutureState<T>::ptr state) : m_state(state)
+    {
+    }
+
+    bool valid() const
+    {
+        return m_state != nullptr;
+    }
+
+    bool ready() const
+    {
+        return m_state->ready();
+    }
+
+    void wait() const
+    {
+        m_state->wait();
+    }
+
+    // 等待结果，Promise设置了异常时重新抛出
+    T get() const
+    {
+        return m_state->get();
+    }
+
+    void on_ready(std::function<void()> cb) const
+    {
+        m_state->on_ready(std::move(cb));
+    }
+};
+
+template <typename T> class Promise
+{
+  private:
+    typename FutureState<T>::ptr m_state;
+
+  public:
+    Promise() : m_state(std::make_shared<FutureState<T>>())
+    {
+    }
+
+    Future<T> get_future() const
+    {
+        return Future<T>(m_state);
+    }
+
+    template <typename... Args> void set_value(Args &&...args) const
+    {
+        m_state->set_value(std::forward<Args>(args)...);
+    }
+
+    void set_exception(std::exception_ptr error) const
+    {
+        m_state->set_exception(error);
+    }
+};
+
+template <typename R> struct AsyncInvoker
+{
+    template <typename Fn> static void Invoke(const Promise<R> &promise, Fn &fn)
+    {
+        promise.set_value(fn());
+    }
+};
+
+template <> struct AsyncInvoker<void>
+{
+    template <typename Fn> static void Invoke(const Promise<void> &promise, Fn &fn)
+    {
+        fn();
+        promise.set_value();
+    }
+};
+
+// 把fn作为调度任务执行，返回其结果的Future
+template <typename Fn> auto Async(Scheduler *scheduler, Fn fn) -> Future<decltype(fn())>
+{
+    typedef decltype(fn()) R;
+    Promise<R> promise;
+    scheduler->schedule([promise, fn]() mutable {
+        try
+        {
+            AsyncInvoker<R>::Invoke(promise, fn);
+        }
+        catch (...)
+        {
+            promise.set_exception(std::current_exception());
+        }
+    });
+    return promise.get_future();
+}
+
+// 全部就绪(包括异常)时就绪
+template <typename T> Future<void> WhenAll(const std::vector<Future<T>> &futures)
+{
+    Promise<void> promise;
+    if (futures.empty())
+    {
+        promise.set_value();
+        return promise.get_future();
+    }
+    auto remain = std::make_shared<std::atomic<size_t>>(futures.size());
+    for (auto &future : futures)
+    {
+        future.on_ready([promise, remain]() {
+            if (--*remain == 0)
+            {
+                promise.set_value();
+            }
+        });
+    }
+    return promise.get_future();
+}
+
+// 任意一个就绪时就绪，结果为该Future的下标
+template <typename T> Future<size_t> WhenAny(const std::vector<Future<T>> &futures)
+{
+    TIGER_ASSERT_WITH_INFO(!futures.empty(), "[when any of empty futures]");
+    Promise<size_t> promise;
+    auto fired = std::make_shared<std::atomic<bool>>(false);
+    for (size_t i = 0; i < futures.size(); ++i)
+    {
+        futures[i].on_ready([promise, fired, i]() {
+            if (!fired->exchange(true))
+            {
+                promise.set_value(i);
+            }
+        });
+    }
+    return promise.get_future();
+}
+
+} // namespace tiger
+
+#endif
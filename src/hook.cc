@@ -76,10 +76,24 @@ bool __enable_hook()
 
 } // namespace tiger
 
-typedef struct
+// io_uring后端下的阻塞socket，读写直接提交完成事件，结果即系统调用的返回值，不再重试
+// 共享栈协程让出后栈会被其他协程覆盖，不能把栈上的请求和缓冲区交给内核，仍走就绪通知
+static tiger::IOManager::ptr UringIOM(int fd, tiger::FDEntity::ptr &fd_entity)
 {
-    bool canceled = false;
-} SocketIoState;
+    if (!tiger::__enable_hook())
+        return nullptr;
+    // 先判断后端，epoll下不查fd表，由do_socket_io查一次
+    auto iom = tiger::IOManager::GetThreadIOM();
+    if (!iom || iom->backend() != tiger::IOManager::Backend::IO_URING)
+        return nullptr;
+    auto co = tiger::Coroutine::GetRunningCo();
+    if (co && co->shared())
+        return nullptr;
+    fd_entity = tiger::SingletonFDManager::Instance()->get_fd(fd);
+    if (!fd_entity || fd_entity->is_closed() || !fd_entity->is_socket() || fd_entity->is_user_nonblock())
+        return nullptr;
+    return iom;
+}
 
 template <typename OrgFunc, typename... Args>
 static ssize_t do_socket_io(int fd, OrgFunc func, const char *hook_func_name, tiger::IOManager::EventStatus status,
@@ -99,7 +113,7 @@ static ssize_t do_socket_io(int fd, OrgFunc func, const char *hook_func_name, ti
     {
         return func(fd, std::forward<Args>(args)...);
     }
-    int timeout = -1;
+    int64_t timeout = -1;
     if (status & tiger::IOManager::EventStatus::READ)
     {
         timeout = fd_entity->recv_timeout();
@@ -113,58 +127,29 @@ static ssize_t do_socket_io(int fd, OrgFunc func, const char *hook_func_name, ti
         TIGER_LOG_E(tiger::SYSTEM_LOG) << "[iomanager event status not found"
                                        << " status:" << status << " func:" << hook_func_name << "]";
     }
-    auto state = std::make_shared<SocketIoState>();
-    ssize_t n = -1;
-    do
+    while (true)
     {
-        n = func(fd, std::forward<Args>(args)...);
-        if (n == -1 && errno == EAGAIN)
+        ssize_t n = func(fd, std::forward<Args>(args)...);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n != -1 || errno != EAGAIN)
+            return n;
+        // 问题：多线程环境下，协程Yield之前事件被触发了怎么办？
+        // 解决：
+        //  1.事件触发的时候必定会在此线程中被唤醒
+        //  2.在调度器中如果发现任务池中有指定线程任务，但不是本线程则发起tickle唤醒一个idle进程
+        //  3.在线程进入idle状态的时候，如果之前tickle过，则重置tickle状态
+        // 超时记录在fd表中由reactor检查，等待过程不分配内存
+        if (!tiger::IOManager::GetThreadIOM()->wait_event(fd, status, timeout))
         {
-            auto iom = tiger::IOManager::GetThreadIOM();
-            tiger::TimerManager::Timer::ptr timer;
-            std::weak_ptr<SocketIoState> week_state(state);
-            if (timeout >= 0)
+            if (errno != ETIMEDOUT)
             {
-                timer = iom->add_cond_timer(
-                    timeout,
-                    [week_state, fd, iom, status]() {
-                        auto _week_state = week_state.lock();
-                        if (!_week_state || _week_state->canceled)
-                        {
-                            return;
-                        }
-                        _week_state->canceled = true;
-                        iom->cancel_event(fd, status);
-                    },
-                    week_state, false);
-            }
-            if (iom->add_event(fd, status))
-            {
-                // 问题：多线程环境下，协程Yield之前事件被触发了怎么办？
-                // 解决：
-                //  1.事件触发的时候必定会在此线程中被唤醒
-                //  2.在调度器中如果发现任务池中有指定线程任务，但不是本线程则发起tickle唤醒一个idle进程
-                //  3.在线程进入idle状态的时候，如果之前tickle过，则重置tickle状态
-                tiger::Coroutine::Yield();
-                iom->cancel_timer(timer);
-                if (state->canceled)
-                {
-                    errno = ETIMEDOUT;
-                    return -1;
-                }
-                state->canceled = false;
-                continue;
-            }
-            else
-            {
-                iom->cancel_timer(timer);
                 TIGER_LOG_E(tiger::SYSTEM_LOG) << "[iomanager add event error"
                                                << " status:" << status << " hookName:" << hook_func_name << "]";
-                return -1;
             }
+            return -1;
         }
-    } while (n == -1 && (errno == EINTR || errno == EAGAIN));
-    return n;
+    }
 }
 
 extern "C"
@@ -180,8 +165,9 @@ extern "C"
             return sleep_f(seconds);
         pid_t t = tiger::Thread::CurThreadId();
         auto iom = tiger::IOManager::GetThreadIOM();
+        auto timers = iom->timers();
         auto co = tiger::Coroutine::GetRunningCo();
-        iom->add_timer(
+        timers->add_timer(
             seconds * 1000, [iom, co, t]() { iom->schedule(co, t); }, false);
         tiger::Coroutine::Yield();
         return 0;
@@ -193,8 +179,9 @@ extern "C"
             return usleep_f(usec);
         pid_t t = tiger::Thread::CurThreadId();
         auto iom = tiger::IOManager::GetThreadIOM();
+        auto timers = iom->timers();
         auto co = tiger::Coroutine::GetRunningCo();
-        iom->add_timer(
+        timers->add_timer_us(
             usec, [iom, co, t]() { iom->schedule(co, t); }, false);
         tiger::Coroutine::Yield();
         return 0;
@@ -203,12 +190,13 @@ extern "C"
     int nanosleep(const struct timespec *rqtp, struct timespec *rmtp)
     {
         if (!tiger::__enable_hook())
-            return nanosleep(rqtp, rmtp);
-        time_t usc = rqtp->tv_sec * 1000 + rqtp->tv_nsec / 10000000;
+            return nanosleep_f(rqtp, rmtp);
+        time_t usc = rqtp->tv_sec * 1000000 + rqtp->tv_nsec / 1000;
         auto t = tiger::Thread::CurThreadId();
         auto iom = tiger::IOManager::GetThreadIOM();
+        auto timers = iom->timers();
         auto co = tiger::Coroutine::GetRunningCo();
-        iom->add_timer(
+        timers->add_timer_us(
             usc, [iom, co, t]() { iom->schedule(co, t); }, false);
         tiger::Coroutine::Yield();
         return 0;
@@ -252,37 +240,10 @@ extern "C"
         if (n != -1 || errno != EINPROGRESS)
             return n;
         auto iom = tiger::IOManager::GetThreadIOM();
-        auto state = std::make_shared<SocketIoState>();
-        std::weak_ptr<SocketIoState> week_state(state);
-        tiger::TimerManager::Timer::ptr timer;
-        if (fd_entity->connect_timeout() > 0)
-        {
-            timer = iom->add_cond_timer(
-                fd_entity->connect_timeout(),
-                [week_state, sockfd, iom]() {
-                    auto _week_state = week_state.lock();
-                    if (!_week_state || _week_state->canceled)
-                        return;
-                    _week_state->canceled = true;
-                    iom->cancel_event(sockfd, tiger::IOManager::EventStatus::WRITE);
-                },
-                week_state, false);
-        }
-        if (iom->add_event(sockfd, tiger::IOManager::EventStatus::WRITE))
-        {
-            tiger::Coroutine::Yield();
-            iom->cancel_timer(timer);
-            if (state->canceled)
-            {
-                errno = ETIMEDOUT;
-                return -1;
-            }
-        }
-        else
-        {
-            iom->cancel_timer(timer);
-            state->canceled = true;
-        }
+        int64_t timeout = fd_entity->connect_timeout() > 0 ? (int64_t)fd_entity->connect_timeout() : -1;
+        // 注册失败时直接查询连接结果
+        if (!iom->wait_event(sockfd, tiger::IOManager::EventStatus::WRITE, timeout) && errno == ETIMEDOUT)
+            return -1;
         int err = 0;
         socklen_t len = sizeof(int);
         if (-1 == getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &err, &len))
@@ -302,7 +263,22 @@ extern "C"
 
     int accept(int socket, struct sockaddr *address, socklen_t *address_len)
     {
-        int fd = do_socket_io(socket, accept_f, "accept", tiger::IOManager::EventStatus::READ, address, address_len);
+        int fd = -1;
+        tiger::FDEntity::ptr fd_entity;
+        auto iom = UringIOM(socket, fd_entity);
+        if (iom)
+        {
+            // 多次触发的accept不返回对端地址
+            fd = iom->uring_accept(socket, (int)fd_entity->recv_timeout());
+            if (fd >= 0 && address)
+            {
+                getpeername(fd, address, address_len);
+            }
+        }
+        else
+        {
+            fd = do_socket_io(socket, accept_f, "accept", tiger::IOManager::EventStatus::READ, address, address_len);
+        }
         if (fd >= 0)
         {
             tiger::SingletonFDManager::Instance()->get_fd(fd, true);
@@ -312,6 +288,10 @@ extern "C"
 
     ssize_t read(int fildes, void *buf, size_t nbyte)
     {
+        tiger::FDEntity::ptr fd_entity;
+        auto iom = UringIOM(fildes, fd_entity);
+        if (iom)
+            return iom->uring_recv(fildes, buf, nbyte, 0, (int)fd_entity->recv_timeout());
         return do_socket_io(fildes, read_f, "read", tiger::IOManager::EventStatus::READ, buf, nbyte);
     }
 
@@ -322,6 +302,10 @@ extern "C"
 
     ssize_t recv(int socket, void *buffer, size_t length, int flags)
     {
+        tiger::FDEntity::ptr fd_entity;
+        auto iom = UringIOM(socket, fd_entity);
+        if (iom)
+            return iom->uring_recv(socket, buffer, length, flags, (int)fd_entity->recv_timeout());
         return do_socket_io(socket, recv_f, "recv", tiger::IOManager::EventStatus::READ, buffer, length, flags);
     }
 
@@ -339,6 +323,10 @@ extern "C"
 
     ssize_t write(int fildes, const void *buf, size_t nbyte)
     {
+        tiger::FDEntity::ptr fd_entity;
+        auto iom = UringIOM(fildes, fd_entity);
+        if (iom)
+            return iom->uring_send(fildes, buf, nbyte, 0, (int)fd_entity->send_timeout());
         return do_socket_io(fildes, write_f, "write", tiger::IOManager::EventStatus::WRITE, buf, nbyte);
     }
 
@@ -349,6 +337,10 @@ extern "C"
 
     ssize_t send(int socket, const void *buffer, size_t length, int flags)
     {
+        tiger::FDEntity::ptr fd_entity;
+        auto iom = UringIOM(socket, fd_entity);
+        if (iom)
+            return iom->uring_send(socket, buffer, length, flags, (int)fd_entity->send_timeout());
         return do_socket_io(socket, send_f, "send", tiger::IOManager::EventStatus::WRITE, buffer, length, flags);
     }
 
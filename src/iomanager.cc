@@ -9,22 +9,112 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
 #include <functional>
 #include <vector>
 
+#include "config.h"
 #include "hook.h"
 
 namespace tiger
 {
 
+static ConfigVar<bool>::ptr g_iomanager_multi_reactor =
+    Config::Lookup<bool>("tiger.iomanager.multiReactor", false, "iomanager one epoll per worker thread");
+static ConfigVar<std::string>::ptr g_iomanager_backend =
+    Config::Lookup<std::string>("tiger.iomanager.backend", "epoll", "iomanager backend epoll or io_uring");
+static ConfigVar<uint32_t>::ptr g_iomanager_uring_entries =
+    Config::Lookup<uint32_t>("tiger.iomanager.uringEntries", 256, "io_uring submission queue entries per reactor");
+static ConfigVar<bool>::ptr g_iomanager_uring_multishot_recv = Config::Lookup<bool>(
+    "tiger.iomanager.uringMultishotRecv", false, "io_uring multishot recv with provided buffers");
+static ConfigVar<uint32_t>::ptr g_iomanager_uring_buffer_cnt =
+    Config::Lookup<uint32_t>("tiger.iomanager.uringBufferCnt", 256, "io_uring provided buffer count per reactor");
+static ConfigVar<uint32_t>::ptr g_iomanager_uring_buffer_size =
+    Config::Lookup<uint32_t>("tiger.iomanager.uringBufferSize", 4096, "io_uring provided buffer size");
+static ConfigVar<bool>::ptr g_iomanager_timer_wheel =
+    Config::Lookup<bool>("tiger.iomanager.timerWheel", false, "iomanager timers in a hierarchical timing wheel");
+static ConfigVar<uint32_t>::ptr g_iomanager_io_timeout_tick =
+    Config::Lookup<uint32_t>("tiger.iomanager.ioTimeoutTick", 10, "iomanager io timeout check granularity ms");
+
+// io_uring的user_data：低3位是类型，高16位是seq，中间是Context或UringOp的地址
+enum UringKind
+{
+    URING_TICKLE = 0,
+    URING_POLL_READ = 1,
+    URING_POLL_WRITE = 2,
+    URING_OP = 3,
+    URING_OP_TIMEOUT = 4,
+    URING_ACCEPT = 5,
+    URING_RECV = 6,
+    // 取消请求自身的结果，不处理
+    URING_IGNORE = 7,
+};
+static const uint64_t URING_PTR_MASK = 0x0000FFFFFFFFFFF8ull;
+
+static uint64_t UringData(const void *ptr, uint64_t kind, uint16_t seq = 0)
+{
+    return ((uint64_t)seq << 48) | (uint64_t)ptr | kind;
+}
+
+// 剩余时间取较小的，-1表示没有
+static time_t MinLeft(time_t a, time_t b)
+{
+    if (a < 0)
+        return b;
+    return b < 0 ? a : std::min(a, b);
+}
+
+// 微秒超时的epoll_wait，内核不支持epoll_pwait2(5.11)时按毫秒向上取整
+static int EpollWait(int epfd, epoll_event *events, int max_cnt, time_t timeout_us)
+{
+#ifdef __NR_epoll_pwait2
+    static std::atomic<bool> s_pwait2{true};
+    if (s_pwait2.load(std::memory_order_relaxed))
+    {
+        timespec ts;
+        ts.tv_sec = timeout_us / 1000000;
+        ts.tv_nsec = timeout_us % 1000000 * 1000;
+        int rt = syscall(__NR_epoll_pwait2, epfd, events, max_cnt, &ts, nullptr, 0);
+        if (rt >= 0 || errno != ENOSYS)
+            return rt;
+        s_pwait2 = false;
+    }
+#endif
+    return epoll_wait(epfd, events, max_cnt, (int)((timeout_us + 999) / 1000));
+}
+
 IOManager::ptr IOManager::GetThreadIOM()
 {
     return std::dynamic_pointer_cast<IOManager>(Scheduler::GetThreadScheduler());
 }
 
+void IOManager::Context::lock()
+{
+    size_t spins = 0;
+    while (true)
+    {
+        uint32_t cur = state.load(std::memory_order_relaxed);
+        if (!(cur & LOCKED) &&
+            state.compare_exchange_weak(cur, cur | LOCKED, std::memory_order_acquire, std::memory_order_relaxed))
+            return;
+        if (++spins % 64 == 0)
+        {
+            sched_yield();
+        }
+    }
+}
+
+void IOManager::Context::unlock()
+{
+    state.fetch_and(~LOCKED, std::memory_order_release);
+}
+
 IOManager::Context::EventContext &IOManager::Context::get_event_context(const EventStatus status)
 {
     return status == EventStatus::READ ? read : write;
@@ -36,17 +126,25 @@ void IOManager::Context::reset_event_context(EventContext &ctx)
     ctx.co.reset();
     ctx.cb = nullptr;
     ctx.scheduler = nullptr;
+    ctx.polled = false;
+    ctx.op = nullptr;
+    ctx.deadline = 0;
+}
+
+bool IOManager::Context::has_multishot() const
+{
+    return multishot || eof || multishot_error || !accepted.empty() || !received.empty();
 }
 
 void IOManager::Context::trigger_event(const EventStatus status)
 {
-    if (!(statuses & status))
+    if (!(statuses() & status))
     {
         TIGER_LOG_E(SYSTEM_LOG) << "[tiger_event fail"
-                                << " statuses" << statuses << " status" << status << "]";
+                                << " statuses" << statuses() << " status" << status << "]";
         return;
     }
-    statuses = (EventStatus)(statuses & ~status);
+    set_statuses((EventStatus)(statuses() & ~status));
     EventContext &ctx = get_event_context(status);
     if (ctx.co)
     {
@@ -54,37 +152,289 @@ void IOManager::Context::trigger_event(const EventStatus status)
     }
     else
     {
-        ctx.scheduler->schedule(&ctx.cb, ctx.thread_id);
+        ctx.scheduler->schedule_inline(std::move(ctx.cb), ctx.thread_id);
     }
     reset_event_context(ctx);
 }
 
-IOManager::IOManager(const std::string &name, bool use_main_thread, size_t thread_cnt)
-    : Scheduler(name, use_main_thread, thread_cnt)
+IOManager::Reactor::Reactor(IOManager *iom) : iom(iom)
 {
-    m_epfd = epoll_create(1024);
-    TIGER_ASSERT_WITH_INFO(m_epfd > 0, "[epoll_create fail]");
-    int rt = pipe(m_tickle_fds);
-    TIGER_ASSERT_WITH_INFO(rt == 0, "[pipe fail]");
+    epfd = epoll_create(1024);
+    TIGER_ASSERT_WITH_INFO(epfd > 0, "[epoll_create fail]");
+    tickle_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    TIGER_ASSERT_WITH_INFO(tickle_fd >= 0, "[eventfd fail]");
     epoll_event event;
     memset(&event, 0, sizeof(epoll_event));
-    event.events = EPOLLIN | EPOLLOUT;
-    event.data.fd = m_tickle_fds[0];
-    TIGER_ASSERT_WITH_INFO(!fcntl(m_tickle_fds[0], F_SETFL, O_NONBLOCK), "[fcntl fail]");
-    TIGER_ASSERT_WITH_INFO(!epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickle_fds[0], &event), "[epoll_ctl fail]");
-    fd_context_resize(128);
+    event.events = EPOLLIN;
+    event.data.fd = tickle_fd;
+    TIGER_ASSERT_WITH_INFO(!epoll_ctl(epfd, EPOLL_CTL_ADD, tickle_fd, &event), "[epoll_ctl fail]");
+    for (auto &segment : segments)
+    {
+        segment.store(nullptr, std::memory_order_relaxed);
+    }
+    memset(deadline_slots, 0, sizeof(deadline_slots));
+    memset(deadline_bits, 0, sizeof(deadline_bits));
+    deadline_tick = LoopMicrosecond() / 1000 / iom->m_io_timeout_tick;
+}
+
+IOManager::Reactor::~Reactor()
+{
+    cancel_all_timer();
+    if (uring)
+        delete uring;
+    close(epfd);
+    close(tickle_fd);
+    for (auto &segment : segments)
+    {
+        delete[] segment.load(std::memory_order_relaxed);
+    }
+}
+
+IOManager::Context *IOManager::Reactor::get_context(int fd)
+{
+    Context *ctx = find_context(fd);
+    if (ctx || fd < 0 || (size_t)fd >= CONTEXT_SEGMENT_SIZE * CONTEXT_SEGMENT_CNT)
+        return ctx;
+    // 并发创建同一段时只有一个成功，其余的释放自己创建的
+    size_t base = fd & ~(CONTEXT_SEGMENT_SIZE - 1);
+    Context *segment = new Context[CONTEXT_SEGMENT_SIZE];
+    for (size_t i = 0; i < CONTEXT_SEGMENT_SIZE; ++i)
+    {
+        segment[i].fd = base + i;
+    }
+    Context *expected = nullptr;
+    if (!segments[fd >> CONTEXT_SEGMENT_SHIFT].compare_exchange_strong(expected, segment, std::memory_order_acq_rel))
+    {
+        delete[] segment;
+        segment = expected;
+    }
+    return &segment[fd & (CONTEXT_SEGMENT_SIZE - 1)];
+}
+
+IOManager::Context *IOManager::Reactor::find_context(int fd) const
+{
+    if (fd < 0 || (size_t)fd >= CONTEXT_SEGMENT_SIZE * CONTEXT_SEGMENT_CNT)
+        return nullptr;
+    Context *segment = segments[fd >> CONTEXT_SEGMENT_SHIFT].load(std::memory_order_acquire);
+    return segment ? &segment[fd & (CONTEXT_SEGMENT_SIZE - 1)] : nullptr;
+}
+
+bool IOManager::Reactor::has_event(int fd, EventStatus status)
+{
+    Context *ctx = find_context(fd);
+    if (!ctx)
+        return false;
+    if (ctx->statuses() & status)
+        return true;
+    // 多次触发的accept/recv在读方向上
+    if (!(status & EventStatus::READ))
+        return false;
+    Context::Lock lock(*ctx);
+    return ctx->has_multishot();
+}
+
+void IOManager::Reactor::on_timer_refresh()
+{
+    // 本线程修改定时器时还没有进入epoll_wait，进入前会重新计算超时
+    if (thread_id != Thread::CurThreadId())
+    {
+        iom->tickle_reactor(this);
+    }
+}
+
+bool IOManager::Reactor::watch_deadline(Context *ctx, uint64_t ms)
+{
+    SpinLock::Lock lock(deadline_lock);
+    if (ctx->deadline_slot >= 0)
+    {
+        // 已登记的不晚于新的，到时检查后再按实际的超时重新登记
+        if (ctx->deadline_key <= ms)
+            return false;
+        unlink_deadline(ctx);
+    }
+    // 向上取整到tick，同一tick内的超时一起处理；已经过去的放到下一个要检查的槽
+    uint64_t tick_ms = iom->m_io_timeout_tick;
+    uint64_t tick = std::max((ms + tick_ms - 1) / tick_ms, deadline_tick);
+    size_t slot = tick % DEADLINE_SLOT_CNT;
+    ctx->deadline_key = ms;
+    ctx->deadline_slot = slot;
+    ctx->deadline_prev = nullptr;
+    ctx->deadline_next = deadline_slots[slot];
+    if (ctx->deadline_next)
+    {
+        ctx->deadline_next->deadline_prev = ctx;
+    }
+    deadline_slots[slot] = ctx;
+    deadline_bits[slot / 64] |= 1ull << (slot % 64);
+    ++deadline_cnt;
+    return tick * tick_ms < deadline_wakeup;
+}
+
+void IOManager::Reactor::unlink_deadline(Context *ctx)
+{
+    size_t slot = ctx->deadline_slot;
+    if (ctx->deadline_prev)
+    {
+        ctx->deadline_prev->deadline_next = ctx->deadline_next;
+    }
+    else
+    {
+        deadline_slots[slot] = ctx->deadline_next;
+        if (!ctx->deadline_next)
+        {
+            deadline_bits[slot / 64] &= ~(1ull << (slot % 64));
+        }
+    }
+    if (ctx->deadline_next)
+    {
+        ctx->deadline_next->deadline_prev = ctx->deadline_prev;
+    }
+    ctx->deadline_prev = ctx->deadline_next = nullptr;
+    ctx->deadline_slot = -1;
+    --deadline_cnt;
+}
+
+void IOManager::Reactor::take_deadlines(uint64_t now, std::vector<Context *> &due)
+{
+    SpinLock::Lock lock(deadline_lock);
+    uint64_t now_tick = now / iom->m_io_timeout_tick;
+    if (now_tick < deadline_tick)
+        return;
+    // 超过一圈没检查时每个槽只需看一遍
+    uint64_t cnt = std::min<uint64_t>(now_tick - deadline_tick + 1, (uint64_t)DEADLINE_SLOT_CNT);
+    for (uint64_t i = 0; i < cnt && deadline_cnt > 0; ++i)
+    {
+        Context *ctx = deadline_slots[(deadline_tick + i) % DEADLINE_SLOT_CNT];
+        while (ctx)
+        {
+            Context *next = ctx->deadline_next;
+            // 槽里还有之后几圈的
+            if (ctx->deadline_key <= now)
+            {
+                unlink_deadline(ctx);
+                due.push_back(ctx);
+            }
+            ctx = next;
+        }
+    }
+    deadline_tick = now_tick + 1;
+}
+
+time_t IOManager::Reactor::next_deadline_left(uint64_t now_us)
+{
+    if (deadline_cnt == 0)
+    {
+        deadline_wakeup = std::numeric_limits<uint64_t>::max();
+        return -1;
+    }
+    SpinLock::Lock lock(deadline_lock);
+    static const size_t WORD_CNT = DEADLINE_SLOT_CNT / 64;
+    size_t start = deadline_tick % DEADLINE_SLOT_CNT;
+    // 从下一个要检查的槽开始绕一圈，最后回到起始字的低位
+    for (size_t i = 0; i <= WORD_CNT; ++i)
+    {
+        size_t word = (start / 64 + i) % WORD_CNT;
+        uint64_t bits = deadline_bits[word];
+        if (i == 0)
+        {
+            bits &= ~0ull << (start % 64);
+        }
+        else if (i == WORD_CNT)
+        {
+            bits &= (1ull << (start % 64)) - 1;
+        }
+        if (!bits)
+            continue;
+        size_t slot = word * 64 + __builtin_ctzll(bits);
+        uint64_t tick = deadline_tick + (slot + DEADLINE_SLOT_CNT - start) % DEADLINE_SLOT_CNT;
+        uint64_t wakeup = tick * iom->m_io_timeout_tick;
+        deadline_wakeup = wakeup;
+        return wakeup * 1000 > now_us ? wakeup * 1000 - now_us : 0;
+    }
+    deadline_wakeup = std::numeric_limits<uint64_t>::max();
+    return -1;
+}
+
+IOManager::IOManager(const std::string &name, bool use_main_thread, size_t thread_cnt)
+    : Scheduler(name, use_main_thread, thread_cnt), m_multi_reactor(g_iomanager_multi_reactor->val()),
+      m_backend(g_iomanager_backend->val() == "io_uring" ? Backend::IO_URING : Backend::EPOLL),
+      m_io_timeout_tick(std::max<uint64_t>(g_iomanager_io_timeout_tick->val(), 1))
+{
+    m_reactors.push_back(new Reactor(this));
+    set_timer_wheel(g_iomanager_timer_wheel->val());
 }
 
 IOManager::~IOManager()
 {
     cancel_all_timer();
-    close(m_epfd);
-    close(m_tickle_fds[0]);
-    close(m_tickle_fds[1]);
-    for (size_t i = 0; i < m_contexts.size(); ++i)
+    for (auto reactor : m_reactors)
+    {
+        delete reactor;
+    }
+}
+
+void IOManager::start()
+{
+    {
+        MutexLock::Lock lock(m_mutex);
+        // ring的完成队列只能由一个线程读取，io_uring总是每个线程一个reactor
+        if (m_backend == Backend::IO_URING)
+        {
+            m_multi_reactor = true;
+        }
+        if (m_multi_reactor && is_stopped() && m_reactors.size() == 1)
+        {
+            size_t worker_cnt = thread_cnt() + (use_main_thread() ? 1 : 0);
+            for (size_t i = 1; i < worker_cnt; ++i)
+            {
+                m_reactors.push_back(new Reactor(this));
+                m_reactors.back()->set_wheel(is_wheel());
+            }
+        }
+        if (m_backend == Backend::IO_URING && is_stopped())
+        {
+            init_uring();
+        }
+    }
+    Scheduler::start();
+}
+
+void IOManager::init_uring()
+{
+    bool ok = true;
+    for (auto reactor : m_reactors)
     {
-        if (m_contexts[i])
-            delete m_contexts[i];
+        if (reactor->uring)
+            continue;
+        reactor->uring = new IoUring;
+        if (!reactor->uring->init(g_iomanager_uring_entries->val()))
+        {
+            ok = false;
+            break;
+        }
+    }
+    if (!ok)
+    {
+        for (auto reactor : m_reactors)
+        {
+            delete reactor->uring;
+            reactor->uring = nullptr;
+        }
+        m_backend = Backend::EPOLL;
+        TIGER_LOG_W(SYSTEM_LOG) << "[io_uring unavailable fallback to epoll name:" << name() << "]";
+        return;
+    }
+    // 5.19同时加入了IORING_OP_SOCKET和多次触发的accept，6.0同时加入了IORING_OP_SEND_ZC和多次触发的recv
+    IoUring *uring = m_reactors[0]->uring;
+    m_uring_multishot_accept = uring->supports(IORING_OP_SOCKET);
+    m_uring_multishot_recv = g_iomanager_uring_multishot_recv->val() && uring->supports(IORING_OP_SEND_ZC);
+    for (auto reactor : m_reactors)
+    {
+        if (m_uring_multishot_recv && !reactor->uring->has_buffers() &&
+            !reactor->uring->setup_buffers(g_iomanager_uring_buffer_cnt->val(), g_iomanager_uring_buffer_size->val()))
+        {
+            m_uring_multishot_recv = false;
+        }
     }
 }
 
@@ -98,50 +448,284 @@ void IOManager::close_hook()
     enable_hook(false);
 }
 
+IOManager::Reactor *IOManager::cur_reactor() const
+{
+    if (!m_multi_reactor)
+        return m_reactors[0];
+    Worker *worker = cur_worker();
+    if (worker && worker->idx < m_reactors.size())
+        return m_reactors[worker->idx];
+    return nullptr;
+}
+
+IOManager::Reactor *IOManager::find_reactor(int fd, EventStatus status) const
+{
+    if (!m_multi_reactor)
+        return m_reactors[0];
+    Reactor *cur = cur_reactor();
+    if (cur && cur->has_event(fd, status))
+        return cur;
+    // 在其他线程上关闭或取消，逐个查找
+    for (auto reactor : m_reactors)
+    {
+        if (reactor != cur && reactor->has_event(fd, status))
+            return reactor;
+    }
+    return cur ? cur : m_reactors[fd % m_reactors.size()];
+}
+
+bool IOManager::set_timer_wheel(bool v)
+{
+    if (!set_wheel(v))
+        return false;
+    for (auto reactor : m_reactors)
+    {
+        if (!reactor->set_wheel(v))
+            return false;
+    }
+    return true;
+}
+
+uint64_t IOManager::timer_coalesced_cnt() const
+{
+    uint64_t cnt = coalesced_cnt();
+    if (m_multi_reactor)
+    {
+        for (auto reactor : m_reactors)
+        {
+            cnt += reactor->coalesced_cnt();
+        }
+    }
+    return cnt;
+}
+
+TimerManager *IOManager::timers()
+{
+    Reactor *reactor = m_multi_reactor ? cur_reactor() : nullptr;
+    if (reactor)
+        return reactor;
+    return this;
+}
+
+pid_t IOManager::assign_thread()
+{
+    if (!m_multi_reactor)
+        return 0;
+    auto &all = workers();
+    if (all.empty())
+        return 0;
+    return all[m_assign_idx++ % all.size()]->thread_id;
+}
+
+void IOManager::tickle_reactor(Reactor *reactor)
+{
+    // 一批schedule只写一次，被唤醒的线程读走后才允许再写；停止时每次都写，确保所有线程都能退出
+    if (reactor->tickle_pending.exchange(true) && !is_stopping())
+        return;
+    uint64_t one = 1;
+    int rt = write(reactor->tickle_fd, &one, sizeof(one));
+    TIGER_ASSERT_WITH_INFO(rt == sizeof(one), "[write fail]");
+    count_tickle();
+}
+
 void IOManager::tickle()
 {
-    if (has_idel_thread())
+    if (!m_multi_reactor)
     {
-        int rt = write(m_tickle_fds[1], "T", 1);
-        TIGER_ASSERT_WITH_INFO(rt == 1, "[write fail]");
+        if (has_idel_thread())
+            tickle_reactor(m_reactors[0]);
+        return;
+    }
+    // 停止时唤醒所有线程，eventfd保留计数，之后才进入epoll_wait的线程也会立即返回
+    if (is_stopping())
+    {
+        for (auto reactor : m_reactors)
+        {
+            tickle_reactor(reactor);
+        }
+        return;
+    }
+    if (!has_idel_thread())
+        return;
+    auto &all = workers();
+    size_t cnt = all.size();
+    size_t idx = m_tickle_idx++;
+    for (size_t i = 0; i < cnt; ++i)
+    {
+        Worker *worker = all[(idx + i) % cnt];
+        if (worker->is_idle.exchange(false))
+        {
+            tickle_reactor(m_reactors[worker->idx]);
+            return;
+        }
     }
 }
 
+void IOManager::tickle_worker(Worker *worker)
+{
+    if (!worker->is_idle)
+        return;
+    if (m_multi_reactor)
+    {
+        tickle_reactor(m_reactors[worker->idx]);
+        return;
+    }
+    // 所有线程共用一个epoll，无法定向唤醒，由被唤醒的线程继续转发
+    tickle();
+}
+
+time_t IOManager::next_left_time(Reactor *reactor)
+{
+    time_t left = next_timer_left_us();
+    if (m_multi_reactor)
+    {
+        left = MinLeft(left, reactor->next_timer_left_us());
+    }
+    return MinLeft(left, reactor->next_deadline_left(LoopMicrosecond()));
+}
+
+void IOManager::set_deadline(Reactor *reactor, Context *ctx, EventStatus status, int64_t timeout_ms)
+{
+    ctx->timed_out &= ~status;
+    auto &event_context = ctx->get_event_context(status);
+    if (timeout_ms < 0)
+    {
+        event_context.deadline = 0;
+        return;
+    }
+    event_context.deadline = LoopMicrosecond() / 1000 + timeout_ms;
+    if (!reactor->watch_deadline(ctx, event_context.deadline))
+        return;
+    // 等待中的线程醒得比这个超时晚
+    if (!m_multi_reactor)
+    {
+        tickle();
+    }
+    else if (reactor->thread_id != Thread::CurThreadId())
+    {
+        tickle_reactor(reactor);
+    }
+}
+
+bool IOManager::take_timed_out(Context *ctx, EventStatus status)
+{
+    Context::Lock lock(*ctx);
+    bool timed_out = ctx->timed_out & status;
+    ctx->timed_out &= ~status;
+    return timed_out;
+}
+
+void IOManager::expire_deadlines(Reactor *reactor, std::vector<Context *> &due)
+{
+    if (reactor->deadline_cnt == 0)
+        return;
+    uint64_t now = LoopMicrosecond() / 1000;
+    reactor->take_deadlines(now, due);
+    for (Context *ctx : due)
+    {
+        Context::Lock lock(*ctx);
+        uint64_t left = 0;
+        for (EventStatus status : {EventStatus::READ, EventStatus::WRITE})
+        {
+            // 事件触发或删除时deadline已清零
+            auto &event_context = ctx->get_event_context(status);
+            if (!event_context.deadline || !(ctx->statuses() & status))
+                continue;
+            if (event_context.deadline <= now)
+            {
+                ctx->timed_out |= status;
+                cancel_event(reactor, ctx, status);
+            }
+            else
+            {
+                left = left ? std::min(left, event_context.deadline) : event_context.deadline;
+            }
+        }
+        if (left)
+        {
+            reactor->watch_deadline(ctx, left);
+        }
+    }
+    due.clear();
+}
+
 void IOManager::idle()
 {
     epoll_event *events = new epoll_event[256]();
     int rt = 0;
     std::vector<std::function<void()>> cbs;
+    std::vector<Context *> due;
+    Worker *worker = cur_worker();
+    TIGER_ASSERT_WITH_INFO(worker, "[iomanager idle without worker]");
+    Reactor *reactor = cur_reactor();
+    reactor->thread_id = Thread::CurThreadId();
+    if (reactor->uring)
+    {
+        delete[] events;
+        idle_uring(worker, reactor);
+        return;
+    }
+    int epfd = reactor->epfd;
     while (true)
     {
         rt = 0;
         do
         {
-            static const int EPOLL_MAX_TIMEOUT = 5000;
-            time_t next_time = next_timer_left_time();
-            next_time = next_time < 0 ? EPOLL_MAX_TIMEOUT : next_time;
-            next_time = next_time > EPOLL_MAX_TIMEOUT ? EPOLL_MAX_TIMEOUT : next_time;
+            static const time_t EPOLL_MAX_TIMEOUT_US = 5000 * 1000;
+            LoopClockUpdate();
+            time_t next_time = next_left_time(reactor);
+            next_time = next_time < 0 ? EPOLL_MAX_TIMEOUT_US : next_time;
+            next_time = next_time > EPOLL_MAX_TIMEOUT_US ? EPOLL_MAX_TIMEOUT_US : next_time;
+            // 自旋期间轮询epoll，不阻塞
+            bool got = idle_spin(worker, [&]() {
+                rt = epoll_wait(epfd, events, 256, 0);
+                LoopClockUpdate();
+                return rt > 0 || next_left_time(reactor) == 0;
+            });
+            if (got)
+                break;
+            worker->is_idle = true;
             ++m_idle_cnt;
-            rt = epoll_wait(m_epfd, events, 256, (int)next_time);
+            if (!has_ready_task(worker))
+            {
+                count_park();
+                rt = EpollWait(epfd, events, 256, next_time);
+            }
             --m_idle_cnt;
-            if (rt > 0 || next_timer_left_time() <= 0 || is_stopping())
+            worker->is_idle = false;
+            LoopClockUpdate();
+            if (rt > 0 || has_ready_task(worker) || next_left_time(reactor) <= 0 || is_stopping())
                 break;
         } while (true);
         all_expired_cbs(cbs);
-        schedules(cbs.begin(), cbs.end());
+        schedules_inline(cbs.begin(), cbs.end());
         cbs.clear();
+        expire_deadlines(reactor, due);
+        if (m_multi_reactor)
+        {
+            // reactor的定时器回调留在本线程执行
+            reactor->all_expired_cbs(cbs);
+            schedules_inline(cbs.begin(), cbs.end(), Thread::CurThreadId());
+            cbs.clear();
+        }
         for (int i = 0; i < rt; ++i)
         {
             epoll_event &event = events[i];
-            if (event.data.fd == m_tickle_fds[0])
+            if (event.data.fd == reactor->tickle_fd)
             {
-                uint8_t dummy;
-                while (read(m_tickle_fds[0], &dummy, 1) == 1)
+                // 先清标记再读，读之后的tickle会重新写入
+                reactor->tickle_pending = false;
+                uint64_t dummy;
+                while (read(reactor->tickle_fd, &dummy, sizeof(dummy)) == sizeof(dummy))
                     continue;
+                if (!m_multi_reactor && has_idle_mail())
+                {
+                    tickle();
+                }
                 continue;
             }
             Context *ctx = (Context *)event.data.ptr;
-            MutexLock::Lock lock(ctx->mutex);
+            Context::Lock lock(*ctx);
             if (event.events & (EPOLLERR | EPOLLHUP))
             {
                 event.events |= EPOLLIN | EPOLLOUT;
@@ -155,109 +739,636 @@ void IOManager::idle()
             {
                 real_status = EventStatus::WRITE;
             }
-            if ((EventStatus)(ctx->statuses & real_status) == EventStatus::NONE)
+            if ((EventStatus)(ctx->statuses() & real_status) == EventStatus::NONE)
                 continue;
-            EventStatus left_status = (EventStatus)(ctx->statuses & ~real_status);
+            EventStatus left_status = (EventStatus)(ctx->statuses() & ~real_status);
             int op = left_status ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
             event.events = EPOLLET | left_status;
-            if (epoll_ctl(m_epfd, op, ctx->fd, &event))
+            if (epoll_ctl(epfd, op, ctx->fd, &event))
             {
                 TIGER_LOG_E(SYSTEM_LOG) << "[epoll_ctl fail"
-                                        << " epfd:" << m_epfd << " op:" << op << " fd:" << ctx->fd
+                                        << " epfd:" << epfd << " op:" << op << " fd:" << ctx->fd
                                         << " errno:" << strerror(errno) << "]";
                 continue;
             }
             if (real_status & EventStatus::READ)
             {
                 ctx->trigger_event(EventStatus::READ);
-                --m_appending_event_cnt;
+                --reactor->appending_event_cnt;
             }
             if (real_status & EventStatus::WRITE)
             {
                 ctx->trigger_event(EventStatus::WRITE);
-                --m_appending_event_cnt;
+                --reactor->appending_event_cnt;
+            }
+        }
+        // 让出后运行的任务直接读时钟
+        LoopClockClear();
+        if (is_stopping() && !has_pending_task())
+        {
+            if (main_thread_id() == Thread::CurThreadId())
+            {
+                if (thread_cnt() == 0)
+                    break;
+            }
+            else
+            {
+                break;
             }
         }
+        Coroutine::Yield();
+    }
+}
+
+void IOManager::idle_uring(Worker *worker, Reactor *reactor)
+{
+    IoUring *uring = reactor->uring;
+    std::vector<std::function<void()>> cbs;
+    std::vector<Context *> due;
+    auto complete = [this, reactor](uint64_t user_data, int res, uint32_t flags) {
+        uring_complete(reactor, user_data, res, flags);
+    };
+    // 多次触发的poll，tickle时产生完成事件
+    uring->push(1, [reactor](io_uring_sqe **sqes) {
+        sqes[0]->opcode = IORING_OP_POLL_ADD;
+        sqes[0]->fd = reactor->tickle_fd;
+        sqes[0]->poll32_events = POLLIN;
+        sqes[0]->len = IORING_POLL_ADD_MULTI;
+        sqes[0]->user_data = UringData(nullptr, URING_TICKLE);
+    });
+    while (true)
+    {
+        do
+        {
+            static const time_t URING_MAX_TIMEOUT_US = 5000 * 1000;
+            LoopClockUpdate();
+            time_t next_time = next_left_time(reactor);
+            next_time = next_time < 0 ? URING_MAX_TIMEOUT_US : next_time;
+            next_time = next_time > URING_MAX_TIMEOUT_US ? URING_MAX_TIMEOUT_US : next_time;
+            // 自旋期间只在有待提交的请求时进入内核
+            bool got = idle_spin(worker, [&]() {
+                uring->submit();
+                LoopClockUpdate();
+                return uring->cq_ready() > 0 || next_left_time(reactor) == 0;
+            });
+            if (got)
+                break;
+            worker->is_idle = true;
+            ++m_idle_cnt;
+            if (!has_ready_task(worker))
+            {
+                count_park();
+                // 本轮积累的请求和等待合并为一次io_uring_enter
+                uring->wait(next_time);
+            }
+            --m_idle_cnt;
+            worker->is_idle = false;
+            LoopClockUpdate();
+            if (uring->cq_ready() > 0 || has_ready_task(worker) || next_left_time(reactor) <= 0 || is_stopping())
+                break;
+        } while (true);
+        uring->submit();
+        all_expired_cbs(cbs);
+        schedules_inline(cbs.begin(), cbs.end());
+        cbs.clear();
+        reactor->all_expired_cbs(cbs);
+        schedules_inline(cbs.begin(), cbs.end(), Thread::CurThreadId());
+        cbs.clear();
+        expire_deadlines(reactor, due);
+        uring->reap(complete);
+        // 让出后运行的任务直接读时钟
+        LoopClockClear();
+        if (is_stopping() && !has_pending_task())
+        {
+            if (main_thread_id() == Thread::CurThreadId())
+            {
+                if (thread_cnt() == 0)
+                    break;
+            }
+            else
+            {
+                break;
+            }
+        }
+        Coroutine::Yield();
+    }
+}
+
+void IOManager::uring_complete(Reactor *reactor, uint64_t user_data, int res, uint32_t flags)
+{
+    uint64_t kind = user_data & 0x7;
+    uint16_t seq = user_data >> 48;
+    if (kind == URING_TICKLE)
+    {
+        reactor->tickle_pending = false;
+        uint64_t dummy;
+        while (read(reactor->tickle_fd, &dummy, sizeof(dummy)) == sizeof(dummy))
+            continue;
+        if (!(flags & IORING_CQE_F_MORE))
+        {
+            reactor->uring->push(1, [reactor](io_uring_sqe **sqes) {
+                sqes[0]->opcode = IORING_OP_POLL_ADD;
+                sqes[0]->fd = reactor->tickle_fd;
+                sqes[0]->poll32_events = POLLIN;
+                sqes[0]->len = IORING_POLL_ADD_MULTI;
+                sqes[0]->user_data = UringData(nullptr, URING_TICKLE);
+            });
+        }
+        return;
+    }
+    if (kind == URING_IGNORE)
+        return;
+    if (kind == URING_OP || kind == URING_OP_TIMEOUT)
+    {
+        UringOp *op = (UringOp *)(user_data & URING_PTR_MASK);
+        if (kind == URING_OP)
+        {
+            op->res = res;
+        }
+        else
+        {
+            op->timed_out = res == -ETIME;
+        }
+        if (--op->pending > 0)
+            return;
+        Context *ctx = op->ctx;
+        {
+            Context::Lock lock(*ctx);
+            auto &event_context = ctx->get_event_context(op->status);
+            if (event_context.op == op)
+            {
+                ctx->set_statuses((EventStatus)(ctx->statuses() & ~op->status));
+                ctx->reset_event_context(event_context);
+                --reactor->appending_event_cnt;
+            }
+        }
+        // 协程恢复后op随栈释放，调度之后不能再访问
+        pid_t thread_id = op->thread_id;
+        schedule(&op->co, thread_id);
+        return;
+    }
+    Context *ctx = (Context *)(user_data & URING_PTR_MASK);
+    Context::Lock lock(*ctx);
+    if (kind == URING_POLL_READ || kind == URING_POLL_WRITE)
+    {
+        EventStatus status = kind == URING_POLL_READ ? EventStatus::READ : EventStatus::WRITE;
+        auto &event_context = ctx->get_event_context(status);
+        if (!(ctx->statuses() & status) || !event_context.polled || event_context.seq != seq)
+            return;
+        ctx->trigger_event(status);
+        --reactor->appending_event_cnt;
+        return;
+    }
+    // 多次触发的accept/recv，取消或fd关闭后到达的结果直接释放
+    bool stale = ctx->multishot != kind || ctx->multishot_seq != seq;
+    if (kind == URING_ACCEPT && res >= 0)
+    {
+        if (stale)
+        {
+            close_f(res);
+        }
+        else
+        {
+            ctx->accepted.push_back(res);
+        }
+    }
+    if (kind == URING_RECV && res > 0 && (flags & IORING_CQE_F_BUFFER))
+    {
+        uint16_t bid = flags >> IORING_CQE_BUFFER_SHIFT;
+        if (stale)
+        {
+            uring_recycle(reactor, bid);
+        }
+        else
+        {
+            ctx->received.push_back({bid, (uint32_t)res, 0});
+        }
+    }
+    if (stale)
+        return;
+    if (!(flags & IORING_CQE_F_MORE))
+    {
+        ctx->multishot = 0;
+        if (res < 0)
+        {
+            ctx->multishot_error = -res;
+        }
+        else if (kind == URING_RECV && res == 0)
+        {
+            ctx->eof = true;
+        }
+    }
+    auto &event_context = ctx->read;
+    if ((ctx->statuses() & EventStatus::READ) && !event_context.polled && !event_context.op)
+    {
+        ctx->trigger_event(EventStatus::READ);
+        --reactor->appending_event_cnt;
+    }
+}
+
+void IOManager::uring_recycle(Reactor *reactor, uint16_t bid)
+{
+    uring_push(reactor, 1, [reactor, bid](io_uring_sqe **sqes) {
+        reactor->uring->provide_buffer(sqes[0], bid);
+        sqes[0]->user_data = UringData(nullptr, URING_IGNORE);
+    });
+}
+
+bool IOManager::uring_cancel(Reactor *reactor, Context *ctx, EventStatus status)
+{
+    auto &event_context = ctx->get_event_context(status);
+    if (event_context.op)
+    {
+        // 内核可能还在读写协程的缓冲区，等-ECANCELED到达后再唤醒
+        uint64_t target = UringData(event_context.op, URING_OP);
+        uring_push(reactor, 1, [target](io_uring_sqe **sqes) {
+            sqes[0]->opcode = IORING_OP_ASYNC_CANCEL;
+            sqes[0]->fd = -1;
+            sqes[0]->addr = target;
+            sqes[0]->user_data = UringData(nullptr, URING_IGNORE);
+        });
+        return false;
+    }
+    if (event_context.polled)
+    {
+        uint64_t target =
+            UringData(ctx, status == EventStatus::READ ? URING_POLL_READ : URING_POLL_WRITE, event_context.seq);
+        uring_push(reactor, 1, [target](io_uring_sqe **sqes) {
+            sqes[0]->opcode = IORING_OP_POLL_REMOVE;
+            sqes[0]->fd = -1;
+            sqes[0]->addr = target;
+            sqes[0]->user_data = UringData(nullptr, URING_IGNORE);
+        });
+    }
+    return true;
+}
+
+bool IOManager::uring_park(Reactor *reactor, Context *ctx, int64_t timeout_ms)
+{
+    if (ctx->statuses() & EventStatus::READ)
+    {
+        TIGER_LOG_E(SYSTEM_LOG) << "[uring wait fail"
+                                << " fd:" << ctx->fd << " statuses:" << ctx->statuses() << "]";
+        errno = EBUSY;
+        return false;
+    }
+    auto &event_context = ctx->read;
+    ++event_context.seq;
+    event_context.scheduler = Scheduler::GetThreadScheduler();
+    event_context.co = Coroutine::GetRunningCo();
+    event_context.thread_id = Thread::CurThreadId();
+    ctx->set_statuses((EventStatus)(ctx->statuses() | EventStatus::READ));
+    ++reactor->appending_event_cnt;
+    set_deadline(reactor, ctx, EventStatus::READ, timeout_ms);
+    return true;
+}
+
+ssize_t IOManager::uring_io(int fd, EventStatus status, uint8_t opcode, void *buf, size_t len, int flags,
+                            int64_t timeout_ms)
+{
+    Reactor *reactor = cur_reactor();
+    TIGER_ASSERT_WITH_INFO(reactor && reactor->uring, "[uring io without reactor]");
+    Context *ctx = reactor->get_context(fd);
+    if (!ctx)
+    {
+        errno = EBADF;
+        return -1;
+    }
+    UringOp op;
+    op.co = Coroutine::GetRunningCo();
+    TIGER_ASSERT_WITH_INFO(!op.co->shared(), "[uring io on shared stack]");
+    op.thread_id = Thread::CurThreadId();
+    op.ctx = ctx;
+    op.status = status;
+    op.pending = timeout_ms >= 0 ? 2 : 1;
+    op.ts.tv_sec = timeout_ms / 1000;
+    op.ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+    {
+        Context::Lock lock(*ctx);
+        if (ctx->statuses() & status)
+        {
+            TIGER_LOG_E(SYSTEM_LOG) << "[uring io fail"
+                                    << " fd:" << fd << " statuses:" << ctx->statuses() << " status:" << status << "]";
+            errno = EBUSY;
+            return -1;
+        }
+        auto &event_context = ctx->get_event_context(status);
+        ++event_context.seq;
+        event_context.op = &op;
+        ctx->set_statuses((EventStatus)(ctx->statuses() | status));
+        ++reactor->appending_event_cnt;
+        // 读写与超时链接，超时后内核取消读写，读写先完成时取消超时
+        reactor->uring->push(op.pending, [&](io_uring_sqe **sqes) {
+            sqes[0]->opcode = opcode;
+            sqes[0]->fd = fd;
+            sqes[0]->addr = (uint64_t)buf;
+            sqes[0]->len = len;
+            sqes[0]->msg_flags = flags;
+            sqes[0]->user_data = UringData(&op, URING_OP);
+            if (op.pending > 1)
+            {
+                sqes[0]->flags |= IOSQE_IO_LINK;
+                sqes[1]->opcode = IORING_OP_LINK_TIMEOUT;
+                sqes[1]->fd = -1;
+                sqes[1]->addr = (uint64_t)&op.ts;
+                sqes[1]->len = 1;
+                sqes[1]->user_data = UringData(&op, URING_OP_TIMEOUT);
+            }
+        });
+    }
+    Coroutine::Yield();
+    if (op.res < 0)
+    {
+        errno = op.timed_out && op.res == -ECANCELED ? ETIMEDOUT : -op.res;
+        return -1;
+    }
+    return op.res;
+}
+
+bool IOManager::uring_cancel_all(Reactor *reactor, Context *ctx)
+{
+    if (!ctx->statuses() && !ctx->has_multishot())
+        return false;
+    if (ctx->multishot)
+    {
+        uint64_t target = UringData(ctx, ctx->multishot, ctx->multishot_seq);
+        uring_push(reactor, 1, [target](io_uring_sqe **sqes) {
+            sqes[0]->opcode = IORING_OP_ASYNC_CANCEL;
+            sqes[0]->fd = -1;
+            sqes[0]->addr = target;
+            sqes[0]->user_data = UringData(nullptr, URING_IGNORE);
+        });
+        ctx->multishot = 0;
+    }
+    // fd即将关闭，没取走的连接和数据一并释放，之后到达的结果按过期处理
+    for (int client : ctx->accepted)
+    {
+        close_f(client);
+    }
+    ctx->accepted.clear();
+    for (auto &recv_buffer : ctx->received)
+    {
+        uring_recycle(reactor, recv_buffer.bid);
+    }
+    ctx->received.clear();
+    ctx->eof = false;
+    ctx->multishot_error = 0;
+    if ((ctx->statuses() & EventStatus::READ) && uring_cancel(reactor, ctx, EventStatus::READ))
+    {
+        ctx->trigger_event(EventStatus::READ);
+        --reactor->appending_event_cnt;
+    }
+    if ((ctx->statuses() & EventStatus::WRITE) && uring_cancel(reactor, ctx, EventStatus::WRITE))
+    {
+        ctx->trigger_event(EventStatus::WRITE);
+        --reactor->appending_event_cnt;
+    }
+    return true;
+}
+
+IOManager::Reactor *IOManager::multishot_reactor(int fd) const
+{
+    Reactor *cur = cur_reactor();
+    for (auto reactor : m_reactors)
+    {
+        if (reactor == cur)
+            continue;
+        Context *ctx = reactor->find_context(fd);
+        if (!ctx)
+            continue;
+        Context::Lock lock(*ctx);
+        if (ctx->has_multishot())
+            return reactor;
+    }
+    return cur;
+}
+
+ssize_t IOManager::uring_recv(int fd, void *buf, size_t len, int flags, int64_t timeout_ms)
+{
+    if (!m_uring_multishot_recv || flags != 0)
+    {
+        ssize_t n = recv_f(fd, buf, len, flags);
+        if (n >= 0 || errno != EAGAIN)
+            return n;
+        return uring_io(fd, EventStatus::READ, IORING_OP_RECV, buf, len, flags, timeout_ms);
+    }
+    Reactor *reactor = multishot_reactor(fd);
+    Context *ctx = reactor->get_context(fd);
+    if (!ctx)
+    {
+        errno = EBADF;
+        return -1;
+    }
+    while (true)
+    {
         {
-            MutexLock::Lock lock(m_mutex);
-            if (is_stopping() && m_tasks.size() == 0)
+            Context::Lock lock(*ctx);
+            // 开启多次触发后内核持续读取，必须先取走已收到的数据，不能再直接读socket
+            if (!ctx->received.empty())
             {
-                if (main_thread_id() == Thread::CurThreadId())
+                size_t n = 0;
+                while (n < len && !ctx->received.empty())
                 {
-                    if (thread_cnt() == 0)
-                        break;
+                    auto &recv_buffer = ctx->received.front();
+                    size_t cnt = std::min(len - n, (size_t)(recv_buffer.len - recv_buffer.offset));
+                    memcpy((char *)buf + n, reactor->uring->buffer(recv_buffer.bid) + recv_buffer.offset, cnt);
+                    recv_buffer.offset += cnt;
+                    n += cnt;
+                    if (recv_buffer.offset == recv_buffer.len)
+                    {
+                        uring_recycle(reactor, recv_buffer.bid);
+                        ctx->received.pop_front();
+                    }
                 }
-                else
+                return n;
+            }
+            if (ctx->eof)
+                return 0;
+            bool no_buffer = false;
+            if (ctx->multishot_error)
+            {
+                int err = ctx->multishot_error;
+                ctx->multishot_error = 0;
+                if (err != ENOBUFS)
                 {
-                    break;
+                    errno = err;
+                    return -1;
+                }
+                no_buffer = true;
+            }
+            if (ctx->multishot != URING_RECV)
+            {
+                ssize_t n = recv_f(fd, buf, len, 0);
+                if (n >= 0 || errno != EAGAIN)
+                    return n;
+                if (no_buffer)
+                {
+                    // 缓冲区被其他连接占满，这次读到调用方的缓冲区，下次再开启多次触发
+                    lock.unlock();
+                    return uring_io(fd, EventStatus::READ, IORING_OP_RECV, buf, len, 0, timeout_ms);
                 }
+                ctx->multishot = URING_RECV;
+                uint64_t user_data = UringData(ctx, URING_RECV, ++ctx->multishot_seq);
+                uring_push(reactor, 1, [fd, user_data](io_uring_sqe **sqes) {
+                    sqes[0]->opcode = IORING_OP_RECV;
+                    sqes[0]->fd = fd;
+                    sqes[0]->ioprio = IORING_RECV_MULTISHOT;
+                    sqes[0]->flags = IOSQE_BUFFER_SELECT;
+                    sqes[0]->buf_group = IoUring::BUFFER_GROUP;
+                    sqes[0]->user_data = user_data;
+                });
             }
+            if (!uring_park(reactor, ctx, timeout_ms))
+                return -1;
         }
         Coroutine::Yield();
+        if (take_timed_out(ctx, EventStatus::READ))
+        {
+            errno = ETIMEDOUT;
+            return -1;
+        }
     }
 }
 
-void IOManager::on_timer_refresh()
+ssize_t IOManager::uring_send(int fd, const void *buf, size_t len, int flags, int64_t timeout_ms)
 {
-    tickle();
+    ssize_t n = send_f(fd, buf, len, flags);
+    if (n >= 0 || errno != EAGAIN)
+        return n;
+    return uring_io(fd, EventStatus::WRITE, IORING_OP_SEND, (void *)buf, len, flags, timeout_ms);
 }
 
-void IOManager::fd_context_resize(size_t size)
+int IOManager::uring_accept(int fd, int64_t timeout_ms)
 {
-    if (size <= m_contexts.size())
-        return;
-    m_contexts.resize(size);
-    for (size_t i = 0; i < size; ++i)
+    if (!m_uring_multishot_accept)
+    {
+        int client = accept_f(fd, nullptr, nullptr);
+        if (client >= 0 || errno != EAGAIN)
+            return client;
+        return uring_io(fd, EventStatus::READ, IORING_OP_ACCEPT, nullptr, 0, 0, timeout_ms);
+    }
+    Reactor *reactor = multishot_reactor(fd);
+    Context *ctx = reactor->get_context(fd);
+    if (!ctx)
+    {
+        errno = EBADF;
+        return -1;
+    }
+    while (true)
     {
-        if (!m_contexts[i])
         {
-            m_contexts[i] = new Context;
-            m_contexts[i]->fd = i;
+            Context::Lock lock(*ctx);
+            if (!ctx->accepted.empty())
+            {
+                int client = ctx->accepted.front();
+                ctx->accepted.pop_front();
+                return client;
+            }
+            if (ctx->multishot_error)
+            {
+                errno = ctx->multishot_error;
+                ctx->multishot_error = 0;
+                return -1;
+            }
+            if (ctx->multishot != URING_ACCEPT)
+            {
+                int client = accept_f(fd, nullptr, nullptr);
+                if (client >= 0 || errno != EAGAIN)
+                    return client;
+                // 之后每个新连接产生一个完成事件，在队列中等待accept取走
+                ctx->multishot = URING_ACCEPT;
+                uint64_t user_data = UringData(ctx, URING_ACCEPT, ++ctx->multishot_seq);
+                uring_push(reactor, 1, [fd, user_data](io_uring_sqe **sqes) {
+                    sqes[0]->opcode = IORING_OP_ACCEPT;
+                    sqes[0]->fd = fd;
+                    sqes[0]->ioprio = IORING_ACCEPT_MULTISHOT;
+                    sqes[0]->user_data = user_data;
+                });
+            }
+            if (!uring_park(reactor, ctx, timeout_ms))
+                return -1;
+        }
+        Coroutine::Yield();
+        if (take_timed_out(ctx, EventStatus::READ))
+        {
+            errno = ETIMEDOUT;
+            return -1;
         }
     }
 }
 
+void IOManager::on_timer_refresh()
+{
+    tickle();
+}
+
 bool IOManager::add_event(int fd, EventStatus status, std::function<void()> cb)
 {
-    ReadWriteLock::ReadLock rlock(m_lock);
-    Context *ctx = nullptr;
-    if ((int)m_contexts.size() > fd)
+    Reactor *reactor = cur_reactor();
+    if (!reactor)
     {
-        ctx = m_contexts[fd];
-        rlock.unlock();
+        // 非工作线程按fd选择reactor
+        reactor = m_reactors[fd % m_reactors.size()];
     }
-    else
+    Context *ctx = reactor->get_context(fd);
+    if (!ctx)
     {
-        rlock.unlock();
-        ReadWriteLock::WriteLock wlock(m_lock);
-        fd_context_resize(fd * 1.5);
-        ctx = m_contexts[fd];
+        TIGER_LOG_E(SYSTEM_LOG) << "[add_event fail fd out of range fd:" << fd << "]";
+        return false;
     }
-    MutexLock::Lock mlock(ctx->mutex);
-    if (ctx->statuses & status)
+    Context::Lock mlock(*ctx);
+    return add_event(reactor, ctx, status, cb);
+}
+
+bool IOManager::add_event(Reactor *reactor, Context *ctx, EventStatus status, std::function<void()> &cb)
+{
+    int fd = ctx->fd;
+    if (ctx->statuses() & status)
     {
         TIGER_LOG_E(SYSTEM_LOG) << "[add_event fail"
-                                << " statuses:" << ctx->statuses << " status:" << status << "]";
+                                << " statuses:" << ctx->statuses() << " status:" << status << "]";
+        errno = EBUSY;
         return false;
     }
-    int op = ctx->statuses ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
-    epoll_event event;
-    event.events = ctx->statuses | status | EPOLLET;
-    event.data.ptr = ctx;
-    if (epoll_ctl(m_epfd, op, fd, &event))
+    auto &event_context = ctx->get_event_context(status);
+    if (reactor->uring)
     {
-        TIGER_LOG_E(SYSTEM_LOG) << "[epoll_ctl fail"
-                                << " epfd" << m_epfd << " op" << op << " fd" << fd << " errno" << strerror(errno)
-                                << "]";
-        return false;
+        // 单次poll，两个方向各自提交，触发后不需要再修改
+        event_context.polled = true;
+        uint64_t user_data =
+            UringData(ctx, status == EventStatus::READ ? URING_POLL_READ : URING_POLL_WRITE, ++event_context.seq);
+        uring_push(reactor, 1, [fd, status, user_data](io_uring_sqe **sqes) {
+            sqes[0]->opcode = IORING_OP_POLL_ADD;
+            sqes[0]->fd = fd;
+            sqes[0]->poll32_events = status == EventStatus::READ ? POLLIN : POLLOUT;
+            sqes[0]->user_data = user_data;
+        });
     }
-    ++m_appending_event_cnt;
-    ctx->statuses = (EventStatus)(ctx->statuses | status);
-    auto &event_context = ctx->get_event_context(status);
+    else
+    {
+        int op = ctx->statuses() ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        epoll_event event;
+        event.events = ctx->statuses() | status | EPOLLET;
+        event.data.ptr = ctx;
+        if (epoll_ctl(reactor->epfd, op, fd, &event))
+        {
+            TIGER_LOG_E(SYSTEM_LOG) << "[epoll_ctl fail"
+                                    << " epfd" << reactor->epfd << " op" << op << " fd" << fd << " errno"
+                                    << strerror(errno) << "]";
+            return false;
+        }
+    }
+    ++reactor->appending_event_cnt;
+    ctx->set_statuses((EventStatus)(ctx->statuses() | status));
     event_context.scheduler = Scheduler::GetThreadScheduler();
     if (cb)
     {
         event_context.cb.swap(cb);
+        // 回调也留在注册它的线程上执行
+        if (m_multi_reactor)
+        {
+            event_context.thread_id = Thread::CurThreadId();
+        }
     }
     else
     {
@@ -269,119 +1380,162 @@ bool IOManager::add_event(int fd, EventStatus status, std::function<void()> cb)
 
 bool IOManager::del_event(int fd, EventStatus status)
 {
-    ReadWriteLock::ReadLock rlock(m_lock);
-    if ((int)m_contexts.size() <= fd)
+    Reactor *reactor = find_reactor(fd, status);
+    Context *ctx = reactor->find_context(fd);
+    if (!ctx || !(ctx->statuses() & status))
     {
         TIGER_LOG_E(SYSTEM_LOG) << "[del_event fail"
-                                << " fd:" << fd << " size:" << m_contexts.size() << "]";
-        rlock.unlock();
+                                << " fd:" << fd << " statuses:" << (ctx ? ctx->statuses() : 0) << " status:" << status
+                                << "]";
         return false;
     }
-    auto ctx = m_contexts[fd];
-    if (!(ctx->statuses & status))
-    {
-        TIGER_LOG_E(SYSTEM_LOG) << "[del_event fail"
-                                << " fd:" << fd << " statuses:" << ctx->statuses << " status:" << status << "]";
-        rlock.unlock();
+    Context::Lock mlock(*ctx);
+    // 加锁前事件可能已经触发
+    if (!(ctx->statuses() & status))
         return false;
+    EventStatus new_status = (EventStatus)(ctx->statuses() & ~status);
+    if (reactor->uring)
+    {
+        // 完成模式的读写不能直接删除，由取消后的完成事件唤醒
+        if (!uring_cancel(reactor, ctx, status))
+            return true;
     }
-    rlock.unlock();
-    MutexLock mlock(ctx->mutex);
-    EventStatus new_status = (EventStatus)(ctx->statuses & ~status);
-    int op = new_status ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-    epoll_event event;
-    event.events = EPOLLET | new_status;
-    event.data.ptr = ctx;
-    if (epoll_ctl(m_epfd, op, fd, &event))
+    else
     {
-        TIGER_LOG_E(SYSTEM_LOG) << "[epoll_ctl fail"
-                                << " epfd:" << m_epfd << " op:" << op << " fd:" << fd << " errno:" << strerror(errno)
-                                << "]";
-        return false;
+        int op = new_status ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+        epoll_event event;
+        event.events = EPOLLET | new_status;
+        event.data.ptr = ctx;
+        if (epoll_ctl(reactor->epfd, op, fd, &event))
+        {
+            TIGER_LOG_E(SYSTEM_LOG) << "[epoll_ctl fail"
+                                    << " epfd:" << reactor->epfd << " op:" << op << " fd:" << fd
+                                    << " errno:" << strerror(errno) << "]";
+            return false;
+        }
     }
-    --m_appending_event_cnt;
-    ctx->statuses = new_status;
-    auto &event_context = ctx->get_event_context(new_status);
+    --reactor->appending_event_cnt;
+    ctx->set_statuses(new_status);
+    auto &event_context = ctx->get_event_context(status);
     ctx->reset_event_context(event_context);
     return true;
 }
 
 bool IOManager::cancel_event(int fd, EventStatus status)
 {
-    ReadWriteLock::ReadLock rlock(m_lock);
-    if ((int)m_contexts.size() <= fd)
+    Reactor *reactor = find_reactor(fd, status);
+    Context *ctx = reactor->find_context(fd);
+    if (!ctx || !(ctx->statuses() & status))
     {
         TIGER_LOG_E(SYSTEM_LOG) << "[cancel_event fail"
-                                << " fd:" << fd << " size:" << m_contexts.size() << "]";
-        rlock.unlock();
+                                << " fd:" << fd << " statuses:" << (ctx ? ctx->statuses() : 0) << " status:" << status
+                                << "]";
         return false;
     }
-    auto ctx = m_contexts[fd];
-    if (!(ctx->statuses & status))
-    {
-        TIGER_LOG_E(SYSTEM_LOG) << "[cancel_event fail"
-                                << " fd:" << fd << " statuses:" << ctx->statuses << " status:" << status << "]";
-        rlock.unlock();
+    Context::Lock mlock(*ctx);
+    if (!(ctx->statuses() & status))
         return false;
-    }
-    rlock.unlock();
+    return cancel_event(reactor, ctx, status);
+}
 
-    MutexLock::Lock mlock(ctx->mutex);
-    EventStatus new_status = (EventStatus)(ctx->statuses & ~status);
+bool IOManager::cancel_event(Reactor *reactor, Context *ctx, EventStatus status)
+{
+    int fd = ctx->fd;
+    if (reactor->uring)
+    {
+        if (uring_cancel(reactor, ctx, status))
+        {
+            --reactor->appending_event_cnt;
+            ctx->trigger_event(status);
+        }
+        return true;
+    }
+    EventStatus new_status = (EventStatus)(ctx->statuses() & ~status);
     int op = new_status ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
     epoll_event event;
     event.events = EPOLLET | new_status;
     event.data.ptr = ctx;
-    if (epoll_ctl(m_epfd, op, fd, &event))
+    if (epoll_ctl(reactor->epfd, op, fd, &event))
     {
         TIGER_LOG_E(SYSTEM_LOG) << "[epoll_ctl fail"
-                                << " epfd:" << m_epfd << " op:" << op << " fd:" << fd << " errno:" << strerror(errno)
-                                << "]";
+                                << " epfd:" << reactor->epfd << " op:" << op << " fd:" << fd
+                                << " errno:" << strerror(errno) << "]";
         return false;
     }
-    --m_appending_event_cnt;
+    --reactor->appending_event_cnt;
     ctx->trigger_event(status);
     return true;
 }
 
-bool IOManager::cancel_all_event(int fd)
+bool IOManager::wait_event(int fd, EventStatus status, int64_t timeout_ms)
 {
-    ReadWriteLock::ReadLock rlock(m_lock);
-    if ((int)m_contexts.size() <= fd)
+    Reactor *reactor = cur_reactor();
+    if (!reactor)
+    {
+        reactor = m_reactors[fd % m_reactors.size()];
+    }
+    Context *ctx = reactor->get_context(fd);
+    if (!ctx)
     {
-        TIGER_LOG_E(SYSTEM_LOG) << "[cancel_all_event fail"
-                                << " fd:" << fd << " size:" << m_contexts.size() << "]";
-        rlock.unlock();
+        TIGER_LOG_E(SYSTEM_LOG) << "[wait_event fail fd out of range fd:" << fd << "]";
+        errno = EBADF;
         return false;
     }
-    auto ctx = m_contexts[fd];
-    rlock.unlock();
-    if (!ctx->statuses)
     {
+        Context::Lock mlock(*ctx);
+        std::function<void()> cb;
+        if (!add_event(reactor, ctx, status, cb))
+            return false;
+        set_deadline(reactor, ctx, status, timeout_ms);
+    }
+    Coroutine::Yield();
+    if (take_timed_out(ctx, status))
+    {
+        errno = ETIMEDOUT;
+        return false;
+    }
+    return true;
+}
+
+bool IOManager::cancel_all_event(int fd)
+{
+    Reactor *reactor = find_reactor(fd, (EventStatus)(EventStatus::READ | EventStatus::WRITE));
+    Context *ctx = reactor->find_context(fd);
+    if (!ctx)
         return false;
+    if (reactor->uring)
+    {
+        Context::Lock mlock(*ctx);
+        return uring_cancel_all(reactor, ctx);
     }
-    MutexLock::Lock mlock(ctx->mutex);
+    if (!ctx->statuses())
+    {
+        return false;
+    }
+    Context::Lock mlock(*ctx);
+    if (!ctx->statuses())
+        return false;
     epoll_event event;
     event.events = EventStatus::NONE;
     event.data.ptr = ctx;
-    if (epoll_ctl(m_epfd, EPOLL_CTL_DEL, fd, &event))
+    if (epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, fd, &event))
     {
         TIGER_LOG_E(SYSTEM_LOG) << "[epoll_ctl fail"
-                                << " epfd:" << m_epfd << " op:" << EPOLL_CTL_DEL << " fd:" << fd
+                                << " epfd:" << reactor->epfd << " op:" << EPOLL_CTL_DEL << " fd:" << fd
                                 << " errno:" << strerror(errno) << "]";
         return false;
     }
-    if (ctx->statuses & EventStatus::READ)
+    if (ctx->statuses() & EventStatus::READ)
     {
         ctx->trigger_event(EventStatus::READ);
-        --m_appending_event_cnt;
+        --reactor->appending_event_cnt;
     }
-    if (ctx->statuses & EventStatus::WRITE)
+    if (ctx->statuses() & EventStatus::WRITE)
     {
         ctx->trigger_event(EventStatus::WRITE);
-        --m_appending_event_cnt;
+        --reactor->appending_event_cnt;
     }
-    TIGER_ASSERT_WITH_INFO(ctx->statuses == EventStatus::NONE, "[cancel_all_event fail]");
+    TIGER_ASSERT_WITH_INFO(ctx->statuses() == EventStatus::NONE, "[cancel_all_event fail]");
     return true;
 }
 
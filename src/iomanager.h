@@ -1,5 +1,10 @@
 /*****************************************************************
- * Description
+ * Description IO调度器
+ *  默认所有工作线程共用一个epoll、fd表和定时器
+ *  多reactor模式(tiger.iomanager.multiReactor)下每个工作线程有自己的epoll、fd表和定时器
+ *  协程在哪个线程上等待IO就注册到哪个线程的reactor，唤醒时固定回到该线程
+ *  io_uring后端(tiger.iomanager.backend)下每个reactor一个ring，读写直接提交完成事件，不可用时退回epoll
+ *  阻塞IO的超时记录在fd表中，由reactor按tick批量检查，不为每次等待创建定时器
  * Email huxiaoheigame@gmail.com
  * Created on 2022/10/08
  * Copyright (c) 2021 虎小黑
@@ -8,8 +13,11 @@
 #ifndef __TIGER_IOMANAGER_H__
 #define __TIGER_IOMANAGER_H__
 
+#include <deque>
+
 #include "scheduler.h"
 #include "timer.h"
+#include "uring.h"
 
 namespace tiger
 {
@@ -24,50 +32,244 @@ class IOManager : public Scheduler, public TimerManager
         WRITE = 0x004
     };
 
+    enum class Backend
+    {
+        EPOLL = 0,
+        // 需要5.11以上内核，多次触发的accept需要5.19，多次触发的recv需要6.0
+        IO_URING = 1,
+    };
+
   private:
-    typedef struct
+    struct Context;
+
+    // io_uring完成模式的一次读写，位于发起协程的栈上，结果全部到达前协程不会恢复
+    struct UringOp
+    {
+        Coroutine::ptr co;
+        pid_t thread_id = 0;
+        Context *ctx = nullptr;
+        EventStatus status = EventStatus::NONE;
+        int res = 0;
+        bool timed_out = false;
+        // 还没到达的完成事件数，链接超时时为2
+        int pending = 0;
+        __kernel_timespec ts;
+    };
+
+    struct Context
     {
         struct EventContext
         {
             Scheduler::ptr scheduler;
-            pid_t thread_id;
+            pid_t thread_id = 0;
             Coroutine::ptr co;
             std::function<void()> cb;
+            // 以下只用于io_uring，seq区分过期的完成事件
+            uint16_t seq = 0;
+            bool polled = false;
+            UringOp *op = nullptr;
+            // 等待超时的单调时钟毫秒，0表示不超时
+            uint64_t deadline = 0;
+        };
+        // 多次触发的recv收到的数据，在ring的provided buffer中
+        struct RecvBuffer
+        {
+            uint16_t bid;
+            uint32_t len;
+            uint32_t offset;
         };
-        MutexLock mutex;
+        // 低位是已注册的EventStatus，可以不加锁读取；LOCKED位保护其余字段
+        static const uint32_t LOCKED = 0x80000000;
+        std::atomic<uint32_t> state{0};
         int fd = 0;
-        EventStatus statuses = EventStatus::NONE;
         EventContext read;
         EventContext write;
+        // io_uring多次触发的accept或recv，同一时间最多一个
+        uint8_t multishot = 0;
+        uint16_t multishot_seq = 0;
+        int multishot_error = 0;
+        bool eof = false;
+        std::deque<int> accepted;
+        std::deque<RecvBuffer> received;
+        // 因超时被唤醒的方向，由等待方取走
+        uint8_t timed_out = 0;
+        // 以下由reactor的deadline_lock保护，key不晚于两个方向上最早的deadline
+        Context *deadline_prev = nullptr;
+        Context *deadline_next = nullptr;
+        uint64_t deadline_key = 0;
+        int deadline_slot = -1;
+
+        typedef ScopedLockTmpl<Context> Lock;
+        // 临界区很短，自旋一段时间后让出CPU
+        void lock();
+        void unlock();
+        EventStatus statuses() const
+        {
+            return (EventStatus)(state.load(std::memory_order_acquire) & ~LOCKED);
+        }
+        // 持有锁时调用
+        void set_statuses(EventStatus statuses)
+        {
+            state.store(LOCKED | statuses, std::memory_order_release);
+        }
 
         EventContext &get_event_context(const EventStatus status);
         void reset_event_context(EventContext &ctx);
         void trigger_event(const EventStatus status);
-    } Context;
+        // 有没有取走的多次触发的结果，或者还在进行中
+        bool has_multishot() const;
+    };
+
+    // 每段256个fd，最多支持1M个fd
+    static const size_t CONTEXT_SEGMENT_SHIFT = 8;
+    static const size_t CONTEXT_SEGMENT_SIZE = 1 << CONTEXT_SEGMENT_SHIFT;
+    static const size_t CONTEXT_SEGMENT_CNT = 4096;
+    // IO超时按tick分到环形的槽里，超出一圈的留在槽中下一圈再检查
+    static const size_t DEADLINE_SLOT_CNT = 1024;
+
+    // 一个epoll实例和它的fd表，定时器只在多reactor模式下使用
+    struct Reactor : public TimerManager
+    {
+        IOManager *iom;
+        int epfd = -1;
+        // eventfd，已有未处理的唤醒时不再重复写
+        int tickle_fd = -1;
+        std::atomic<bool> tickle_pending{false};
+        // 等待事件的线程，其他线程修改定时器时才需要唤醒它
+        std::atomic<pid_t> thread_id{0};
+        std::atomic<size_t> appending_event_cnt{0};
+        // fd表按段分配，段一旦创建就不再移动或释放，查找不加锁
+        std::atomic<Context *> segments[CONTEXT_SEGMENT_CNT];
+        // io_uring后端时不为空
+        IoUring *uring = nullptr;
+        // 等待IO的超时，槽里是Context的侵入式链表
+        SpinLock deadline_lock;
+        uint64_t deadline_tick = 0;
+        std::atomic<size_t> deadline_cnt{0};
+        Context *deadline_slots[DEADLINE_SLOT_CNT];
+        uint64_t deadline_bits[DEADLINE_SLOT_CNT / 64];
+        // 等待中的线程醒来检查超时的时间，更早的超时需要唤醒它
+        std::atomic<uint64_t> deadline_wakeup{std::numeric_limits<uint64_t>::max()};
+
+        explicit Reactor(IOManager *iom);
+        ~Reactor();
+
+        // 所在的段不存在时创建，fd超出上限时返回nullptr
+        Context *get_context(int fd);
+        // 不创建段，fd从未使用过时返回nullptr
+        Context *find_context(int fd) const;
+        bool has_event(int fd, EventStatus status);
+        void on_timer_refresh() override;
+
+        // 持有ctx锁时调用，按ms登记超时，返回是否早于等待中线程的唤醒时间
+        bool watch_deadline(Context *ctx, uint64_t ms);
+        // 取出now之前的槽中的Context，超时可能已经失效，由调用方逐个检查
+        void take_deadlines(uint64_t now, std::vector<Context *> &due);
+        // 距下一个非空槽的微秒数，没有时返回-1
+        time_t next_deadline_left(uint64_t now_us);
+
+      private:
+        void unlink_deadline(Context *ctx);
+    };
 
   private:
-    int m_epfd = 0;
-    int m_tickle_fds[2];
-    ReadWriteLock m_lock;
-    std::atomic<size_t> m_appending_event_cnt{0};
-    std::vector<Context *> m_contexts;
+    bool m_multi_reactor;
+    Backend m_backend;
+    bool m_uring_multishot_accept = false;
+    bool m_uring_multishot_recv = false;
+    uint64_t m_io_timeout_tick;
+    // 共享模式只有一个，多reactor模式下第i个属于第i个工作线程
+    std::vector<Reactor *> m_reactors;
+    std::atomic<size_t> m_tickle_idx{0};
+    std::atomic<size_t> m_assign_idx{0};
+
+  private:
+    // 当前线程所属的reactor，多reactor模式下非工作线程返回nullptr
+    Reactor *cur_reactor() const;
+    // 事件所在的reactor，优先查找当前线程的
+    Reactor *find_reactor(int fd, EventStatus status) const;
+    void tickle_reactor(Reactor *reactor);
+    // 距最早的定时器或IO超时的微秒数，没有时返回-1
+    time_t next_left_time(Reactor *reactor);
+
+    // 持有ctx锁时调用，注册事件，cb为空时唤醒当前协程
+    bool add_event(Reactor *reactor, Context *ctx, EventStatus status, std::function<void()> &cb);
+    bool cancel_event(Reactor *reactor, Context *ctx, EventStatus status);
+    // 持有ctx锁时调用，为当前协程的等待登记超时
+    void set_deadline(Reactor *reactor, Context *ctx, EventStatus status, int64_t timeout_ms);
+    // 被唤醒后取走超时标记，返回是否超时
+    bool take_timed_out(Context *ctx, EventStatus status);
+    // 唤醒已超时的等待，due是复用的临时数组
+    void expire_deadlines(Reactor *reactor, std::vector<Context *> &due);
+
+    // 为每个reactor创建ring，失败时退回epoll
+    void init_uring();
+    void idle_uring(Worker *worker, Reactor *reactor);
+    // 把cnt个sqe放入reactor的ring，不是reactor线程时立即提交
+    template <typename Fn> void uring_push(Reactor *reactor, unsigned cnt, Fn fill)
+    {
+        reactor->uring->push(cnt, fill);
+        if (reactor->thread_id != Thread::CurThreadId())
+        {
+            reactor->uring->submit();
+        }
+    }
+    void uring_complete(Reactor *reactor, uint64_t user_data, int res, uint32_t flags);
+    // 把多次触发的recv用完的缓冲区还给reactor的ring
+    void uring_recycle(Reactor *reactor, uint16_t bid);
+    // 撤销status方向上的等待，返回是否需要立即唤醒等待方
+    bool uring_cancel(Reactor *reactor, Context *ctx, EventStatus status);
+    // 持有ctx锁时调用，fd关闭前撤销所有等待和多次触发的请求
+    bool uring_cancel_all(Reactor *reactor, Context *ctx);
+    // 持有ctx锁时调用，当前协程在ctx上等待多次触发的结果
+    bool uring_park(Reactor *reactor, Context *ctx, int64_t timeout_ms);
+    // 提交一次完成模式的读写并挂起，返回值与对应的系统调用相同；请求和缓冲区在调用方栈上，不能是共享栈协程
+    ssize_t uring_io(int fd, EventStatus status, uint8_t opcode, void *buf, size_t len, int flags,
+                     int64_t timeout_ms);
+    // 已经开启多次触发的accept/recv的reactor，都没有时为当前线程的
+    Reactor *multishot_reactor(int fd) const;
 
   protected:
     void open_hook() override;
     void close_hook() override;
     void tickle() override;
+    void tickle_worker(Worker *worker) override;
     void idle() override;
     void on_timer_refresh() override;
 
-  protected:
-    void fd_context_resize(size_t size);
-
   public:
     typedef std::shared_ptr<IOManager> ptr;
 
     IOManager(const std::string &name = "", bool user_main_thread = false, size_t thread_cnt = 1);
     ~IOManager();
 
+    bool multi_reactor() const
+    {
+        return m_multi_reactor;
+    }
+    // 覆盖tiger.iomanager.multiReactor，需在start之前设置
+    void set_multi_reactor(bool v)
+    {
+        m_multi_reactor = v;
+    }
+
+    // 覆盖tiger.iomanager.timerWheel，IOManager和各reactor的定时器都使用时间轮，已有定时器时返回false
+    bool set_timer_wheel(bool v);
+    // IOManager和各reactor的定时器合并到期节省的唤醒次数
+    uint64_t timer_coalesced_cnt() const;
+
+    Backend backend() const
+    {
+        return m_backend;
+    }
+    // 覆盖tiger.iomanager.backend，需在start之前设置；io_uring总是每个线程一个ring，会同时开启多reactor模式
+    void set_backend(Backend backend)
+    {
+        m_backend = backend;
+    }
+
+    void start() override;
+
   public:
     static IOManager::ptr GetThreadIOM();
 
@@ -76,6 +278,20 @@ class IOManager : public Scheduler, public TimerManager
     bool del_event(int fd, EventStatus status);
     bool cancel_event(int fd, EventStatus status);
     bool cancel_all_event(int fd);
+    // 当前协程挂起直到fd上的事件触发或被取消，timeout_ms<0表示不超时
+    // 超时或注册失败时返回false并设置errno，超时为ETIMEDOUT；整个过程不分配内存
+    bool wait_event(int fd, EventStatus status, int64_t timeout_ms);
+
+    // IO超时和sleep使用的定时器，多reactor模式下是当前工作线程的，否则是IOManager自身
+    TimerManager *timers();
+    // 多reactor模式下轮流返回一个工作线程，新连接的协程固定在该线程上；共享模式或尚未启动时返回0
+    pid_t assign_thread();
+
+    // io_uring后端下由hook调用，先直接调用一次，EAGAIN时提交到ring并挂起，timeout_ms<0表示不超时
+    // 共享栈协程不能调用，hook中改用就绪通知
+    ssize_t uring_recv(int fd, void *buf, size_t len, int flags, int64_t timeout_ms);
+    ssize_t uring_send(int fd, const void *buf, size_t len, int flags, int64_t timeout_ms);
+    int uring_accept(int fd, int64_t timeout_ms);
 };
 
 } // namespace tiger
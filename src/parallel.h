@@ -0,0 +1,165 @@
+/*****************************************************************
+ * Description 基于调度器的并行计算
+ *  把区间按粒度切分成多个调度任务，调用方自己也执行一块，全部完成后返回
+ *  在协程中调用时挂起协程等待，不阻塞工作线程
+ *  在共享栈协程中调用时，fn/map不能引用调用方栈上的变量，等待期间栈会被其他协程覆盖
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/13
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#ifndef __TIGER_PARALLEL_H__
+#define __TIGER_PARALLEL_H__
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "future.h"
+#include "scheduler.h"
+
+namespace tiger
+{
+
+// 记录第一个异常，最后一个完成的任务负责唤醒等待方
+class ParallelJoin
+{
+  public:
+    typedef std::shared_ptr<ParallelJoin> ptr;
+
+  private:
+    std::atomic<size_t> m_remain;
+    SpinLock m_lock;
+    std::exception_ptr m_error;
+    Promise<void> m_promise;
+
+  public:
+    explicit ParallelJoin(size_t cnt) : m_remain(cnt)
+    {
+    }
+
+    template <typename Fn> void run(Fn &fn)
+    {
+        try
+        {
+            fn();
+        }
+        catch (...)
+        {
+            SpinLock::Lock lock(m_lock);
+            if (!m_error)
+            {
+                m_error = std::current_exception();
+            }
+        }
+        if (--m_remain == 0)
+        {
+            m_promise.set_value();
+        }
+    }
+
+    // 等待全部完成，有任务抛出异常时重新抛出第一个
+    void wait()
+    {
+        m_promise.get_future().wait();
+        if (m_error)
+        {
+            std::rethrow_exception(m_error);
+        }
+    }
+};
+
+// 执行tasks中的所有任务，第一个在当前协程执行，其余作为调度任务
+inline void ParallelRun(Scheduler *scheduler, std::vector<std::function<void()>> &tasks)
+{
+    if (tasks.empty())
+        return;
+    auto join = std::make_shared<ParallelJoin>(tasks.size());
+    std::vector<std::function<void()>> cbs;
+    cbs.reserve(tasks.size() - 1);
+    for (size_t i = 1; i < tasks.size(); ++i)
+    {
+        std::function<void()> &task = tasks[i];
+        cbs.push_back([join, &task]() { join->run(task); });
+    }
+    if (!scheduler->schedules(cbs.begin(), cbs.end()))
+    {
+        // 调度器正在停止，任务没有入队，全部在当前协程执行
+        for (auto &cb : cbs)
+        {
+            cb();
+        }
+    }
+    join->run(tasks[0]);
+    join->wait();
+}
+
+// 按粒度切分[begin, end)，grain为0时按线程数自动选择，每块至少1个元素
+inline size_t ParallelGrain(Scheduler *scheduler, size_t cnt, size_t grain)
+{
+    if (grain > 0)
+        return grain;
+    // 每个线程分到多块，便于工作窃取平衡负载
+    size_t chunks = std::max<size_t>(scheduler->thread_cnt(), 1) * 4;
+    return std::max<size_t>((cnt + chunks - 1) / chunks, 1);
+}
+
+// fn(chunk_begin, chunk_end)处理一块，块之间无序执行
+template <typename Fn> void ParallelFor(Scheduler *scheduler, size_t begin, size_t end, size_t grain, Fn fn)
+{
+    if (begin >= end)
+        return;
+    grain = ParallelGrain(scheduler, end - begin, grain);
+    // 调用方可能是共享栈协程，等待时栈被换出，其他线程上的任务不能引用调用方栈上的参数
+    auto shared_fn = std::make_shared<Fn>(std::move(fn));
+    std::vector<std::function<void()>> tasks;
+    tasks.reserve((end - begin + grain - 1) / grain);
+    for (size_t b = begin; b < end; b += grain)
+    {
+        size_t e = std::min(b + grain, end);
+        tasks.push_back([shared_fn, b, e]() { (*shared_fn)(b, e); });
+    }
+    ParallelRun(scheduler, tasks);
+}
+
+// map(chunk_begin, chunk_end)得到每块的结果，再按块顺序用reduce合并，结果与切分方式无关时才确定
+template <typename T, typename MapFn, typename ReduceFn>
+T ParallelReduce(Scheduler *scheduler, size_t begin, size_t end, size_t grain, T identity, MapFn map, ReduceFn reduce)
+{
+    if (begin >= end)
+        return identity;
+    grain = ParallelGrain(scheduler, end - begin, grain);
+    size_t cnt = (end - begin + grain - 1) / grain;
+    std::vector<T> results(cnt, identity);
+    auto shared_map = std::make_shared<MapFn>(std::move(map));
+    std::vector<std::function<void()>> tasks;
+    tasks.reserve(cnt);
+    for (size_t i = 0; i < cnt; ++i)
+    {
+        size_t b = begin + i * grain;
+        size_t e = std::min(b + grain, end);
+        T *result = &results[i];
+        tasks.push_back([shared_map, b, e, result]() { *result = (*shared_map)(b, e); });
+    }
+    ParallelRun(scheduler, tasks);
+    T value = identity;
+    for (auto &result : results)
+    {
+        value = reduce(value, result);
+    }
+    return value;
+}
+
+// 并行执行多个可调用对象
+template <typename... Fns> void ParallelInvoke(Scheduler *scheduler, Fns... fns)
+{
+    std::vector<std::function<void()>> tasks{std::function<void()>(fns)...};
+    ParallelRun(scheduler, tasks);
+}
+
+} // namespace tiger
+
+#endif
@@ -7,10 +7,70 @@
 
 #include "scheduler.h"
 
+#include <errno.h>
+#include <execinfo.h>
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "config.h"
+#include "stack_allocator.h"
+#include "watchdog.h"
+
 namespace tiger
 {
 
 static thread_local Scheduler::ptr s_t_scheduler = nullptr;
+static thread_local void *s_t_worker = nullptr;
+
+static const size_t INLINE_BATCH_SIZE = 64;
+
+static const size_t ADAPTIVE_STACK_INTERVAL = 1024;
+
+static ConfigVar<bool>::ptr g_scheduler_adaptive_stack =
+    Config::Lookup<bool>("tiger.scheduler.adaptiveStack", false, "Scheduler Size Coroutine Stack From Observed Usage");
+static ConfigVar<double>::ptr g_scheduler_adaptive_stack_percentile = Config::Lookup<double>(
+    "tiger.scheduler.adaptiveStackPercentile", 0.99, "Scheduler Adaptive Stack Usage Percentile");
+static ConfigVar<double>::ptr g_scheduler_adaptive_stack_margin =
+    Config::Lookup<double>("tiger.scheduler.adaptiveStackMargin", 2.0, "Scheduler Adaptive Stack Safety Margin");
+static ConfigVar<size_t>::ptr g_scheduler_adaptive_stack_min =
+    Config::Lookup<size_t>("tiger.scheduler.adaptiveStackMin", 16 * 1024, "Scheduler Adaptive Stack Min Size");
+
+static ConfigVar<size_t>::ptr g_scheduler_local_queue_size =
+    Config::Lookup<size_t>("tiger.scheduler.localQueueSize", 1024, "Scheduler work stealing local queue size");
+
+static ConfigVar<uint64_t>::ptr g_scheduler_idle_spin_us = Config::Lookup<uint64_t>(
+    "tiger.scheduler.idleSpinUs", 50, "Scheduler Max Spin Time Before Park When Idle, 0 Means Park Immediately");
+
+static ConfigVar<size_t>::ptr g_scheduler_batch_size = Config::Lookup<size_t>(
+    "tiger.scheduler.batchSize", 16, "Scheduler Max Tasks Taken From Global Queue Per Lock");
+
+static ConfigVar<bool>::ptr g_scheduler_telemetry = Config::Lookup<bool>(
+    "tiger.scheduler.telemetry", true, "Scheduler Record Coroutine Run Time And Idle Time Histograms");
+
+static ConfigVar<uint64_t>::ptr g_scheduler_watchdog_ms = Config::Lookup<uint64_t>(
+    "tiger.scheduler.watchdogMs", 0, "Scheduler Report Coroutine Running Longer Than This, 0 Means Disable Watchdog");
+static ConfigVar<bool>::ptr g_scheduler_watchdog_migrate = Config::Lookup<bool>(
+    "tiger.scheduler.watchdogMigrate", false, "Scheduler Move Pending Tasks Off A Stalled Thread");
+
+// 看门狗采集调用栈的信号，默认动作是忽略，误发也不会终止进程
+static const int STALL_SIGNAL = SIGURG;
+// 等待被检查线程处理信号的最长时间
+static const uint64_t STALL_CAPTURE_TIMEOUT_US = 10 * 1000;
+
+static ConfigVar<std::string>::ptr g_scheduler_cpu_layout = Config::Lookup<std::string>(
+    "tiger.scheduler.cpuLayout", "none", "Scheduler Pin Worker Threads When No Cpu Set Given: none/core/numa");
+static ConfigVar<std::vector<int>>::ptr g_scheduler_cpu_set =
+    Config::Lookup<std::vector<int>>("tiger.scheduler.cpuSet", {}, "Scheduler Cpus To Pin Worker Threads To");
+
+static ConfigVar<bool>::ptr g_scheduler_strict_priority =
+    Config::Lookup<bool>("tiger.scheduler.strictPriority", false, "Scheduler Always Run Higher Priority Task First");
+static ConfigVar<std::vector<size_t>>::ptr g_scheduler_priority_weights = Config::Lookup<std::vector<size_t>>(
+    "tiger.scheduler.priorityWeights", {8, 4, 1}, "Scheduler Weighted Round Robin Weights Of HIGH/NORMAL/LOW");
 
 Scheduler::ptr Scheduler::GetThreadScheduler()
 {
@@ -23,6 +83,23 @@ Scheduler::Scheduler(const std::string &name, bool use_main_thread, size_t threa
     m_main_thread_id = Thread::CurThreadId();
     m_is_stopping = false;
     m_is_stopped = true;
+    m_work_stealing = false;
+    m_strict_priority = g_scheduler_strict_priority->val();
+    auto weights = g_scheduler_priority_weights->val();
+    for (size_t i = 0; i < PRIORITY_CNT; ++i)
+    {
+        m_priority_weights[i] = i < weights.size() && weights[i] > 0 ? weights[i] : 1;
+        m_priority_credits[i] = m_priority_weights[i];
+    }
+    reset_wait_stats();
+    m_idle_spin_us = g_scheduler_idle_spin_us->val();
+    m_batch_size = std::max<size_t>(g_scheduler_batch_size->val(), 1);
+    m_telemetry = g_scheduler_telemetry->val();
+    m_watchdog_us = g_scheduler_watchdog_ms->val() * 1000;
+    m_watchdog_migrate = g_scheduler_watchdog_migrate->val();
+    m_cpus = g_scheduler_cpu_set->val();
+    const std::string &layout = g_scheduler_cpu_layout->val();
+    m_cpu_layout = layout == "core" ? CpuLayout::CORE : (layout == "numa" ? CpuLayout::NUMA : CpuLayout::NONE);
     if (m_use_main_thread)
     {
         --m_thread_cnt;
@@ -31,9 +108,869 @@ Scheduler::Scheduler(const std::string &name, bool use_main_thread, size_t threa
 
 Scheduler::~Scheduler()
 {
+    if (m_watchdog_us > 0)
+    {
+        SingletonWatchdog::Instance()->del(this);
+    }
     m_is_stopped = true;
     m_is_stopping = false;
-    s_t_scheduler = nullptr;
+    // 可能是线程切换到新调度器时释放了旧调度器，不能清掉新的
+    if (s_t_scheduler.get() == this)
+    {
+        s_t_scheduler = nullptr;
+    }
+    for (auto worker : m_workers)
+    {
+        Task *t = nullptr;
+        while (worker->local_tasks.pop(t))
+        {
+            delete t;
+        }
+        delete worker;
+    }
+    m_workers.clear();
+}
+
+Scheduler::Worker *Scheduler::cur_worker() const
+{
+    Worker *worker = (Worker *)s_t_worker;
+    if (worker && worker->scheduler == this)
+    {
+        return worker;
+    }
+    return nullptr;
+}
+
+Scheduler::Worker *Scheduler::find_worker(pid_t thread_id) const
+{
+    Worker *worker = cur_worker();
+    if (worker && worker->thread_id == thread_id)
+        return worker;
+    for (auto w : m_workers)
+    {
+        if (w->thread_id == thread_id)
+            return w;
+    }
+    return nullptr;
+}
+
+bool Scheduler::take_mail(Worker *worker, Task &task)
+{
+    if (worker->mailbox_cnt == 0)
+        return false;
+    MutexLock::Lock lock(worker->mailbox_mutex);
+    while (!worker->mailbox.empty())
+    {
+        task = worker->mailbox.front();
+        worker->mailbox.pop_front();
+        --worker->mailbox_cnt;
+        if (task.valid())
+            return true;
+        task.reset();
+    }
+    return false;
+}
+
+bool Scheduler::steal_task(Worker *worker, Task &task)
+{
+    size_t cnt = m_workers.size();
+    for (size_t i = 1; i < cnt; ++i)
+    {
+        Worker *victim = m_workers[(worker->idx + i) % cnt];
+        Task *t = nullptr;
+        if (victim->local_tasks.steal(t))
+        {
+            task = *t;
+            delete t;
+            RelaxedAdd(worker->steal_cnt);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Scheduler::take_task(Worker *worker, Task &task)
+{
+    if (worker && take_mail(worker, task))
+        return true;
+    bool stealing = m_work_stealing && worker;
+    bool need_tickle = false;
+    bool is_active = false;
+    // 高优先级任务只进全局队列，有积压时先于本地队列处理
+    if (m_high_task_cnt > 0)
+    {
+        MutexLock::Lock lock(m_mutex);
+        is_active = pop_global_task(task);
+        need_tickle = m_task_cnt > 0 && m_idle_cnt > 0;
+    }
+    if (!is_active && worker && worker->batch_idx < worker->batch.size())
+    {
+        task = std::move(worker->batch[worker->batch_idx++]);
+        --worker->batch_cnt;
+        is_active = true;
+    }
+    if (stealing && !is_active)
+    {
+        Task *t = nullptr;
+        while (!is_active && worker->local_tasks.pop(t))
+        {
+            task = *t;
+            delete t;
+            is_active = task.valid();
+        }
+        need_tickle = is_active && !worker->local_tasks.empty() && m_idle_cnt > 0;
+    }
+    if (!is_active)
+    {
+        MutexLock::Lock lock(m_mutex);
+        is_active = pop_global_task(task);
+        if (is_active && worker)
+        {
+            fill_batch(worker);
+        }
+        need_tickle = (m_task_cnt > 0 || (stealing && !worker->local_tasks.empty())) && m_idle_cnt > 0;
+    }
+    if (need_tickle)
+    {
+        tickle();
+    }
+    if (!is_active && stealing)
+    {
+        is_active = steal_task(worker, task) && task.valid();
+    }
+    if (is_active && task.m_enqueue_us != 0)
+    {
+        record_wait(worker, task, MonotonicMicrosecond());
+    }
+    return is_active;
+}
+
+void Scheduler::run_inline_cbs(Worker *worker)
+{
+    while (worker->inline_idx < worker->inline_cbs.size())
+    {
+        if (!worker->inline_co)
+        {
+            worker->inline_co = CoroutinePool::Get(std::bind(&Scheduler::inline_loop, this));
+        }
+        worker->inline_blocked = false;
+        resume_task(worker, worker->inline_co);
+        if (worker->inline_blocked)
+        {
+            // 回调中途让出，回调协程转交给唤醒方持有，剩余回调换一个协程继续执行
+            worker->inline_blocked = false;
+            worker->inline_co.reset();
+        }
+    }
+    worker->inline_cbs.clear();
+    worker->inline_idx = 0;
+}
+
+void Scheduler::inline_loop()
+{
+    Worker *worker = cur_worker();
+    Coroutine *self = Coroutine::GetRunningCo().get();
+    while (true)
+    {
+        while (worker->inline_idx < worker->inline_cbs.size())
+        {
+            std::function<void()> cb;
+            cb.swap(worker->inline_cbs[worker->inline_idx++]);
+            worker->inline_blocked = true;
+            try
+            {
+                cb();
+            }
+            catch (const std::exception &e)
+            {
+                TIGER_LOG_E(SYSTEM_LOG) << "[run inline callback fail"
+                                        << " error:" << e.what() << "]";
+            }
+            catch (...)
+            {
+                TIGER_LOG_E(SYSTEM_LOG) << "[run inline callback fail]";
+            }
+            // 回调中途阻塞过，当前协程已经不再是批量回调协程，随回调一起结束
+            worker = cur_worker();
+            if (!worker || worker->inline_co.get() != self)
+                return;
+            worker->inline_blocked = false;
+        }
+        Coroutine::Yield();
+    }
+}
+
+void Scheduler::record_stack_usage(const Coroutine::ptr &co)
+{
+    size_t used = co->stack_used();
+    if (used == 0)
+        return;
+    size_t cnt = m_stack_stats.add(used);
+    if (!g_scheduler_adaptive_stack->val() || cnt % ADAPTIVE_STACK_INTERVAL != 0)
+        return;
+    // 按分位数乘以安全系数，按页对齐，限制在[最小值, 默认栈大小]之间
+    size_t page = StackAllocator::PageSize();
+    size_t max_size = Coroutine::DefaultStackSize();
+    size_t size = m_stack_stats.percentile(g_scheduler_adaptive_stack_percentile->val()) *
+                  g_scheduler_adaptive_stack_margin->val();
+    size = (size + page - 1) / page * page;
+    size = std::min(std::max(size, g_scheduler_adaptive_stack_min->val()), max_size);
+    if (m_stack_size.exchange(size) != size)
+    {
+        TIGER_LOG_I(SYSTEM_LOG) << "[scheduler adaptive stack"
+                                << " name:" << m_name << " size:" << size << " samples:" << cnt
+                                << " max:" << m_stack_stats.max() << "]";
+    }
+}
+
+void Scheduler::resume_task(Worker *worker, const Coroutine::ptr &co)
+{
+    if (!worker)
+    {
+        co->resume();
+        return;
+    }
+    RelaxedAdd(worker->switch_cnt);
+    if (!m_telemetry && m_watchdog_us == 0)
+    {
+        co->resume();
+        return;
+    }
+    uint64_t start = MonotonicMicrosecond();
+    if (m_watchdog_us > 0)
+    {
+        worker->slice_co_id.store(co->id(), std::memory_order_relaxed);
+        worker->slice_co.store(co.get(), std::memory_order_relaxed);
+        worker->slice_start.store(start, std::memory_order_release);
+    }
+    co->resume();
+    if (m_watchdog_us > 0)
+    {
+        worker->slice_start.store(0, std::memory_order_release);
+        worker->slice_co.store(nullptr, std::memory_order_relaxed);
+    }
+    if (m_telemetry)
+    {
+        worker->run_hist.add(MonotonicMicrosecond() - start);
+    }
+}
+
+void Scheduler::resume_idle(Worker *worker, const Coroutine::ptr &idle_co)
+{
+    if (!worker)
+    {
+        idle_co->resume();
+        return;
+    }
+    RelaxedAdd(worker->switch_cnt);
+    if (!m_telemetry)
+    {
+        idle_co->resume();
+        return;
+    }
+    uint64_t start = MonotonicMicrosecond();
+    idle_co->resume();
+    RelaxedAdd(worker->idle_us, MonotonicMicrosecond() - start);
+}
+
+void Scheduler::count_tickle()
+{
+    Worker *worker = cur_worker();
+    if (worker)
+    {
+        RelaxedAdd(worker->tickle_cnt);
+    }
+    else
+    {
+        ++m_external_tickle_cnt;
+    }
+}
+
+void Scheduler::push_mail(Worker *worker, Task &task)
+{
+    {
+        MutexLock::Lock lock(worker->mailbox_mutex);
+        worker->mailbox.push_back(task);
+        ++worker->mailbox_cnt;
+    }
+    if (worker != cur_worker())
+    {
+        tickle_worker(worker);
+    }
+}
+
+bool Scheduler::push_task(Task &task)
+{
+    // 共享栈协程运行过之后只能回到原线程
+    if (task.m_co && task.m_co->shared_thread_id())
+    {
+        task.m_thread_id = task.m_co->shared_thread_id();
+    }
+    // 带优先级或截止时间的任务进全局队列，保证出队顺序
+    bool ordered = task.m_priority != Priority::NORMAL || task.m_deadline != 0;
+    // 关闭telemetry时只给分级任务打时间戳，供wait_stats统计
+    if (m_telemetry || ordered)
+    {
+        task.m_enqueue_us = MonotonicMicrosecond();
+    }
+    if (task.m_thread_id != 0)
+    {
+        Worker *target = find_worker(task.m_thread_id);
+        if (target)
+        {
+            push_mail(target, task);
+            return true;
+        }
+        // 共享栈保存在原线程上，换线程恢复会破坏栈，只能拒绝
+        if (task.m_co && task.m_co->shared_thread_id())
+        {
+            TIGER_LOG_E(SYSTEM_LOG) << "[schedule shared coroutine fail, thread not found"
+                                    << " thread_id:" << task.m_thread_id << "]";
+            return false;
+        }
+        TIGER_LOG_W(SYSTEM_LOG) << "[schedule thread not found, unpin task thread_id:" << task.m_thread_id << "]";
+        task.m_thread_id = 0;
+    }
+    Worker *worker = m_work_stealing && !ordered ? cur_worker() : nullptr;
+    if (worker)
+    {
+        Task *t = new Task();
+        std::swap(*t, task);
+        if (worker->local_tasks.push(t))
+        {
+            if (m_idle_cnt > 0)
+            {
+                tickle();
+            }
+            return true;
+        }
+        std::swap(*t, task);
+        delete t;
+    }
+    bool need_tickle = false;
+    {
+        MutexLock::Lock lock(m_mutex);
+        need_tickle = m_task_cnt == 0;
+        push_global_task(task);
+    }
+    if (need_tickle && m_idle_cnt > 0)
+    {
+        tickle();
+    }
+    return true;
+}
+
+bool Scheduler::push_tasks(std::list<Task> &tasks)
+{
+    bool ok = true;
+    for (auto it = tasks.begin(); it != tasks.end();)
+    {
+        if (it->m_co && it->m_co->shared_thread_id())
+        {
+            ok = push_task(*it) && ok;
+            it = tasks.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    if (tasks.empty())
+        return ok;
+    uint64_t now = m_telemetry ? MonotonicMicrosecond() : 0;
+    for (auto &task : tasks)
+    {
+        bool ordered = task.m_priority != Priority::NORMAL || task.m_deadline != 0;
+        if (ordered && now == 0)
+        {
+            now = MonotonicMicrosecond();
+        }
+        task.m_enqueue_us = m_telemetry || ordered ? now : 0;
+    }
+    if (tasks.front().m_thread_id != 0)
+    {
+        // schedules中所有任务指定的是同一线程
+        Worker *target = find_worker(tasks.front().m_thread_id);
+        if (target)
+        {
+            {
+                MutexLock::Lock lock(target->mailbox_mutex);
+                target->mailbox_cnt += tasks.size();
+                target->mailbox.splice(target->mailbox.end(), tasks);
+            }
+            if (target != cur_worker())
+            {
+                tickle_worker(target);
+            }
+            return ok;
+        }
+        TIGER_LOG_W(SYSTEM_LOG) << "[schedule thread not found, unpin tasks"
+                                << " thread_id:" << tasks.front().m_thread_id << " count:" << tasks.size() << "]";
+        for (auto &task : tasks)
+        {
+            task.m_thread_id = 0;
+        }
+    }
+    bool need_tickle = false;
+    Worker *worker = m_work_stealing ? cur_worker() : nullptr;
+    if (worker)
+    {
+        while (!tasks.empty())
+        {
+            Task *t = new Task();
+            std::swap(*t, tasks.front());
+            if (!worker->local_tasks.push(t))
+            {
+                std::swap(*t, tasks.front());
+                delete t;
+                break;
+            }
+            need_tickle = true;
+            tasks.pop_front();
+        }
+    }
+    if (!tasks.empty())
+    {
+        MutexLock::Lock lock(m_mutex);
+        need_tickle = need_tickle || m_task_cnt == 0;
+        m_task_cnt += tasks.size();
+        m_tasks[(size_t)Priority::NORMAL].splice(m_tasks[(size_t)Priority::NORMAL].end(), tasks);
+    }
+    if (need_tickle && m_idle_cnt > 0)
+    {
+        tickle();
+    }
+    return ok;
+}
+
+void Scheduler::push_global_task(Task &task)
+{
+    size_t idx = (size_t)task.m_priority;
+    if (task.m_deadline != 0)
+    {
+        m_deadline_tasks[idx].insert(std::make_pair(task.m_deadline, task));
+    }
+    else
+    {
+        m_tasks[idx].push_back(task);
+    }
+    ++m_task_cnt;
+    if (task.m_priority == Priority::HIGH)
+    {
+        ++m_high_task_cnt;
+    }
+}
+
+bool Scheduler::pop_global_task(Task &task)
+{
+    while (m_task_cnt > 0)
+    {
+        // 严格优先级取最高的非空队列，否则按权重轮转，所有非空队列额度用完后重新分配
+        size_t idx = PRIORITY_CNT;
+        for (int round = 0; round < 2 && idx == PRIORITY_CNT; ++round)
+        {
+            for (size_t i = 0; i < PRIORITY_CNT; ++i)
+            {
+                if (m_tasks[i].empty() && m_deadline_tasks[i].empty())
+                    continue;
+                if (m_strict_priority || m_priority_credits[i] > 0)
+                {
+                    idx = i;
+                    break;
+                }
+            }
+            if (idx == PRIORITY_CNT)
+            {
+                for (size_t i = 0; i < PRIORITY_CNT; ++i)
+                {
+                    m_priority_credits[i] = m_priority_weights[i];
+                }
+            }
+        }
+        if (!m_strict_priority)
+        {
+            --m_priority_credits[idx];
+        }
+        // 同一优先级内截止时间最早的先执行，没有截止时间的按FIFO排在后面
+        if (!m_deadline_tasks[idx].empty())
+        {
+            auto it = m_deadline_tasks[idx].begin();
+            task = std::move(it->second);
+            m_deadline_tasks[idx].erase(it);
+        }
+        else
+        {
+            task = std::move(m_tasks[idx].front());
+            m_tasks[idx].pop_front();
+        }
+        --m_task_cnt;
+        if (idx == (size_t)Priority::HIGH)
+        {
+            --m_high_task_cnt;
+        }
+        if (task.valid())
+            return true;
+        task.reset();
+    }
+    return false;
+}
+
+void Scheduler::fill_batch(Worker *worker)
+{
+    // 最多取走全局队列中平均每个线程的份额，避免一个线程囤积任务
+    size_t cnt = std::min(m_batch_size - 1, m_task_cnt / m_workers.size());
+    worker->batch.clear();
+    worker->batch_idx = 0;
+    Task task;
+    while (cnt-- > 0 && pop_global_task(task))
+    {
+        if (m_work_stealing)
+        {
+            // 放进本地队列，本线程阻塞时其他线程还能窃取
+            Task *t = new Task();
+            std::swap(*t, task);
+            if (worker->local_tasks.push(t))
+                continue;
+            std::swap(*t, task);
+            delete t;
+        }
+        worker->batch.push_back(std::move(task));
+        ++worker->batch_cnt;
+        task.reset();
+    }
+}
+
+void Scheduler::record_wait(Worker *worker, const Task &task, uint64_t now)
+{
+    size_t idx = (size_t)task.m_priority;
+    uint64_t wait = now > task.m_enqueue_us ? now - task.m_enqueue_us : 0;
+    if (worker && m_telemetry)
+    {
+        worker->wait_hist.add(wait);
+    }
+    ++m_wait_cnt[idx];
+    m_wait_total_us[idx] += wait;
+    uint64_t max = m_wait_max_us[idx];
+    while (wait > max && !m_wait_max_us[idx].compare_exchange_weak(max, wait))
+    {
+    }
+}
+
+Scheduler::WaitStats Scheduler::wait_stats(Priority priority) const
+{
+    size_t idx = (size_t)priority;
+    WaitStats stats;
+    stats.count = m_wait_cnt[idx];
+    stats.total_us = m_wait_total_us[idx];
+    stats.max_us = m_wait_max_us[idx];
+    return stats;
+}
+
+Scheduler::Telemetry Scheduler::telemetry()
+{
+    Telemetry telemetry;
+    std::vector<Worker *> workers;
+    {
+        MutexLock::Lock lock(m_mutex);
+        workers = m_workers;
+        telemetry.queue_depth = m_task_cnt;
+    }
+    telemetry.idle_cnt = m_idle_cnt;
+    telemetry.spin_hit_cnt = m_spin_hit_cnt;
+    telemetry.park_cnt = m_park_cnt;
+    telemetry.tickle_cnt = m_external_tickle_cnt;
+    for (auto worker : workers)
+    {
+        WorkerTelemetry w;
+        w.idx = worker->idx;
+        w.thread_id = worker->thread_id;
+        w.is_idle = worker->is_idle;
+        w.queue_depth = worker->mailbox_cnt + worker->batch_cnt + worker->local_tasks.size();
+        w.task_cnt = worker->task_cnt.load(std::memory_order_relaxed);
+        w.switch_cnt = worker->switch_cnt.load(std::memory_order_relaxed);
+        w.steal_cnt = worker->steal_cnt.load(std::memory_order_relaxed);
+        w.tickle_cnt = worker->tickle_cnt.load(std::memory_order_relaxed);
+        w.idle_us = worker->idle_us.load(std::memory_order_relaxed);
+        w.wait = worker->wait_hist.snapshot();
+        w.run = worker->run_hist.snapshot();
+        telemetry.task_cnt += w.task_cnt;
+        telemetry.switch_cnt += w.switch_cnt;
+        telemetry.steal_cnt += w.steal_cnt;
+        telemetry.tickle_cnt += w.tickle_cnt;
+        telemetry.idle_us += w.idle_us;
+        telemetry.wait.merge(w.wait);
+        telemetry.run.merge(w.run);
+        telemetry.workers.push_back(w);
+    }
+    return telemetry;
+}
+
+void Scheduler::OnStallSignal(int)
+{
+    // 只做拷贝和backtrace，不加锁不分配内存
+    Worker *worker = (Worker *)s_t_worker;
+    if (!worker)
+        return;
+    int saved_errno = errno;
+    size_t len = 0;
+    // 运行片段还没结束时协程一定还活着
+    Coroutine *co = worker->slice_start.load(std::memory_order_acquire) ? worker->slice_co.load() : nullptr;
+    if (co)
+    {
+        const char *name = co->name();
+        while (len + 1 < sizeof(worker->stall_name) && name[len])
+        {
+            worker->stall_name[len] = name[len];
+            ++len;
+        }
+    }
+    worker->stall_name[len] = '\0';
+    worker->stall_frame_cnt.store(backtrace(worker->stall_frames, Worker::STALL_FRAME_CNT), std::memory_order_release);
+    errno = saved_errno;
+}
+
+bool Scheduler::capture_stall(Worker *worker, uint64_t start, StallReport &report)
+{
+    static bool s_installed = [] {
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = &Scheduler::OnStallSignal;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        // 第一次backtrace可能加载libgcc并分配内存，先在看门狗线程调用一次，之后在信号处理函数中调用才安全
+        void *frames[1];
+        backtrace(frames, 1);
+        return sigaction(STALL_SIGNAL, &sa, nullptr) == 0;
+    }();
+    if (!s_installed)
+        return false;
+    worker->stall_frame_cnt.store(-1, std::memory_order_relaxed);
+    if (syscall(SYS_tgkill, getpid(), (pid_t)worker->thread_id, STALL_SIGNAL) != 0)
+        return false;
+    uint64_t deadline = MonotonicMicrosecond() + STALL_CAPTURE_TIMEOUT_US;
+    int cnt = -1;
+    while ((cnt = worker->stall_frame_cnt.load(std::memory_order_acquire)) < 0 && MonotonicMicrosecond() < deadline)
+    {
+        usleep(100);
+    }
+    // 采集期间协程已经让出，调用栈不再对应超时的协程
+    if (cnt < 0 || worker->slice_start.load(std::memory_order_acquire) != start)
+        return false;
+    report.co_name = worker->stall_name;
+    BacktraceSymbols(worker->stall_frames, cnt, report.backtrace);
+    return true;
+}
+
+size_t Scheduler::migrate_tasks(Worker *worker)
+{
+    // 卡住的协程在让出之前就可能被唤醒放进队列，交给其他线程时仍是运行状态会被丢弃
+    Coroutine *running = worker->slice_co.load(std::memory_order_acquire);
+    std::list<Task> tasks;
+    {
+        MutexLock::Lock lock(worker->mailbox_mutex);
+        for (auto it = worker->mailbox.begin(); it != worker->mailbox.end();)
+        {
+            // 指定线程的协程留在原线程，只迁移回调和还没运行过的协程
+            if (it->m_co && (it->m_co.get() == running || it->m_co->state() != Coroutine::State::INIT))
+            {
+                ++it;
+                continue;
+            }
+            tasks.splice(tasks.end(), worker->mailbox, it++);
+            --worker->mailbox_cnt;
+        }
+    }
+    // 本地队列允许其他线程窃取，批量缓存只有本线程能访问，留给它自己
+    std::list<Task> keep;
+    Task *t = nullptr;
+    while (worker->local_tasks.steal(t))
+    {
+        if (t->m_co && t->m_co.get() == running)
+        {
+            // 放回本线程的信箱，让出之后由它自己继续运行
+            t->m_thread_id = worker->thread_id;
+            keep.push_back(std::move(*t));
+        }
+        else
+        {
+            tasks.push_back(std::move(*t));
+        }
+        delete t;
+    }
+    if (!keep.empty())
+    {
+        MutexLock::Lock lock(worker->mailbox_mutex);
+        worker->mailbox_cnt += keep.size();
+        worker->mailbox.splice(worker->mailbox.end(), keep);
+    }
+    if (tasks.empty())
+        return 0;
+    size_t cnt = tasks.size();
+    {
+        MutexLock::Lock lock(m_mutex);
+        for (auto &task : tasks)
+        {
+            task.m_thread_id = 0;
+            push_global_task(task);
+        }
+    }
+    tickle();
+    return cnt;
+}
+
+std::vector<Scheduler::StallReport> Scheduler::check_stalls()
+{
+    std::vector<StallReport> reports;
+    if (m_watchdog_us == 0 || m_is_stopping)
+        return reports;
+    std::vector<Worker *> workers;
+    {
+        MutexLock::Lock lock(m_mutex);
+        workers = m_workers;
+    }
+    for (auto worker : workers)
+    {
+        uint64_t start = worker->slice_start.load(std::memory_order_acquire);
+        uint64_t now = MonotonicMicrosecond();
+        if (start == 0 || now < start + m_watchdog_us)
+            continue;
+        // 卡住期间每轮都迁移新积压的任务，但只报告一次
+        size_t migrated = m_watchdog_migrate ? migrate_tasks(worker) : 0;
+        if (worker->stall_reported == start)
+            continue;
+        worker->stall_reported = start;
+        StallReport report;
+        report.scheduler = m_name;
+        report.worker_idx = worker->idx;
+        report.thread_id = worker->thread_id;
+        report.co_id = worker->slice_co_id.load(std::memory_order_relaxed);
+        report.running_us = now - start;
+        report.migrated = migrated;
+        capture_stall(worker, start, report);
+        reports.push_back(report);
+    }
+    return reports;
+}
+
+void Scheduler::reset_wait_stats()
+{
+    for (size_t i = 0; i < PRIORITY_CNT; ++i)
+    {
+        m_wait_cnt[i] = 0;
+        m_wait_total_us[i] = 0;
+        m_wait_max_us[i] = 0;
+    }
+}
+
+bool Scheduler::has_pending_task()
+{
+    {
+        MutexLock::Lock lock(m_mutex);
+        if (m_task_cnt > 0)
+            return true;
+    }
+    for (auto worker : m_workers)
+    {
+        if (worker->mailbox_cnt > 0 || worker->batch_cnt > 0 || !worker->local_tasks.empty())
+            return true;
+    }
+    return false;
+}
+
+bool Scheduler::has_ready_task(Worker *worker) const
+{
+    if (worker->mailbox_cnt > 0 || worker->batch_cnt > 0 || m_task_cnt > 0)
+        return true;
+    if (!m_work_stealing)
+        return false;
+    for (auto w : m_workers)
+    {
+        if (!w->local_tasks.empty())
+            return true;
+    }
+    return false;
+}
+
+bool Scheduler::idle_spin(Worker *worker, const std::function<bool()> &poll)
+{
+    uint64_t budget = worker->spin_us;
+    if (budget == 0 || m_is_stopping)
+        return false;
+    uint64_t start = MonotonicMicrosecond();
+    while (true)
+    {
+        if (m_is_stopping)
+            return false;
+        if (has_ready_task(worker) || (poll && poll()))
+        {
+            worker->spin_us = std::min(budget * 2, m_idle_spin_us);
+            ++m_spin_hit_cnt;
+            return true;
+        }
+        if (MonotonicMicrosecond() - start >= budget)
+            break;
+        sched_yield();
+    }
+    // 下限保留最大值的1/8，避免长时间空闲后再也不自旋
+    worker->spin_us = std::max(budget / 2, std::max<uint64_t>(m_idle_spin_us / 8, 1));
+    return false;
+}
+
+bool Scheduler::has_idle_mail()
+{
+    Worker *cur = cur_worker();
+    for (auto worker : m_workers)
+    {
+        if (worker != cur && worker->is_idle && worker->mailbox_cnt > 0)
+            return true;
+    }
+    return false;
+}
+
+std::vector<std::vector<int>> Scheduler::cpu_plan() const
+{
+    std::vector<std::vector<int>> plan(m_thread_cnt);
+    if (!m_cpus.empty())
+    {
+        for (size_t i = 0; i < plan.size(); ++i)
+        {
+            plan[i].push_back(m_cpus[i % m_cpus.size()]);
+        }
+        return plan;
+    }
+    if (m_cpu_layout == CpuLayout::CORE)
+    {
+        // 先占满一个节点的物理核，再用其他节点，最后才用超线程
+        auto cpus = CpuTopology::Cpus();
+        std::sort(cpus.begin(), cpus.end(), [](const CpuTopology::Cpu &a, const CpuTopology::Cpu &b) {
+            if (a.sibling != b.sibling)
+                return a.sibling < b.sibling;
+            if (a.node != b.node)
+                return a.node < b.node;
+            return a.id < b.id;
+        });
+        for (size_t i = 0; i < plan.size() && !cpus.empty(); ++i)
+        {
+            plan[i].push_back(cpus[i % cpus.size()].id);
+        }
+    }
+    else if (m_cpu_layout == CpuLayout::NUMA)
+    {
+        std::vector<std::vector<int>> nodes;
+        for (size_t node = 0; node < CpuTopology::NodeCnt(); ++node)
+        {
+            auto cpus = CpuTopology::NodeCpus(node);
+            if (!cpus.empty())
+            {
+                nodes.push_back(cpus);
+            }
+        }
+        for (size_t i = 0; i < plan.size() && !nodes.empty(); ++i)
+        {
+            plan[i] = nodes[i % nodes.size()];
+        }
+    }
+    return plan;
 }
 
 void Scheduler::start()
@@ -46,12 +983,35 @@ void Scheduler::start()
         }
         m_is_stopped = false;
         m_is_stopping = false;
+        size_t worker_cnt = m_thread_cnt + (m_use_main_thread ? 1 : 0);
+        for (size_t i = 0; i < worker_cnt; ++i)
+        {
+            m_workers.push_back(new Worker(this, i, g_scheduler_local_queue_size->val()));
+            m_workers.back()->spin_us = m_idle_spin_us;
+            m_workers.back()->batch.reserve(m_batch_size);
+        }
+        auto plan = cpu_plan();
+        // 工作线程持有调度器的引用，调用方stop之后立即释放调度器时，工作线程退出前调度器不会被析构
+        Scheduler::ptr self = shared_from_this();
         for (size_t i = 0; i < m_thread_cnt; ++i)
         {
-            m_threads.push_back(
-                std::make_shared<Thread>(std::bind(&Scheduler::run, this), m_name + std::to_string(i + 1)));
+            const std::vector<int> &cpus = plan[i];
+            m_threads.push_back(std::make_shared<Thread>(
+                [self, cpus]() {
+                    // 先绑定再进入调度循环，线程内的分配(协程栈、epoll事件数组)在首次访问时落到本地节点
+                    if (!cpus.empty())
+                    {
+                        Thread::SetAffinity(cpus);
+                    }
+                    self->run();
+                },
+                m_name + std::to_string(i + 1)));
         }
     }
+    if (m_watchdog_us > 0)
+    {
+        SingletonWatchdog::Instance()->add(this);
+    }
     if (m_use_main_thread)
     {
         run();
@@ -64,13 +1024,46 @@ void Scheduler::stop()
         return;
     m_is_stopping = true;
     tickle();
+    if (m_watchdog_us > 0)
+    {
+        SingletonWatchdog::Instance()->del(this);
+    }
 }
 
 void Scheduler::tickle()
 {
-    if (m_idle_cnt)
+    // 停止过程中唤醒所有线程，避免主线程消费掉唤醒导致其他idle线程无法退出
+    if (m_is_stopping)
+    {
+        for (auto worker : m_workers)
+        {
+            worker->semaphore.post();
+        }
+        count_tickle();
+        return;
+    }
+    if (m_idle_cnt == 0)
+        return;
+    size_t cnt = m_workers.size();
+    size_t idx = m_tickle_idx++;
+    for (size_t i = 0; i < cnt; ++i)
+    {
+        Worker *worker = m_workers[(idx + i) % cnt];
+        if (worker->is_idle.exchange(false))
+        {
+            worker->semaphore.post();
+            count_tickle();
+            return;
+        }
+    }
+}
+
+void Scheduler::tickle_worker(Worker *worker)
+{
+    if (worker->is_idle.exchange(false))
     {
-        m_semaphore.post();
+        worker->semaphore.post();
+        count_tickle();
     }
 }
 
@@ -79,47 +1072,53 @@ void Scheduler::run()
     open_hook();
     auto idle_co = std::make_shared<Coroutine>(std::bind(&Scheduler::idle, this));
     s_t_scheduler = shared_from_this();
+    Worker *worker = nullptr;
+    size_t idx = m_worker_idx++;
+    if (idx < m_workers.size())
+    {
+        worker = m_workers[idx];
+        worker->thread_id = Thread::CurThreadId();
+        s_t_worker = worker;
+    }
     Task task;
     while (true)
     {
         task.reset();
-        bool is_active = false;
-        bool need_tickle = false;
+        bool is_active = take_task(worker, task);
+        if (is_active && task.m_cb)
         {
-            MutexLock::Lock lock(m_mutex);
-            auto t = m_tasks.begin();
-            while (t != m_tasks.end())
+            if (worker)
             {
-                if (t->m_thread_id != 0 && t->m_thread_id != Thread::CurThreadId())
+                // 连续的回调任务放到同一批次执行
+                worker->inline_cbs.push_back(std::move(task.m_cb));
+                task.reset();
+                while (worker->inline_cbs.size() < INLINE_BATCH_SIZE && take_task(worker, task) && task.m_cb)
                 {
-                    ++t;
-                    need_tickle = true;
-                    continue;
+                    worker->inline_cbs.push_back(std::move(task.m_cb));
+                    task.reset();
                 }
-                task = *t;
-                m_tasks.erase(t);
+                RelaxedAdd(worker->task_cnt, worker->inline_cbs.size());
+                run_inline_cbs(worker);
+                // 回调可能产生了新任务，本批次执行完重新取任务
                 if (!task.m_co)
-                {
-                    task.reset();
                     continue;
-                }
-                is_active = true;
-                break;
             }
-            if (!m_tasks.empty() && m_idle_cnt > 0)
+            else
             {
-                need_tickle = true;
+                task.m_co = CoroutinePool::Get(std::move(task.m_cb));
             }
         }
-        if (need_tickle)
-        {
-            tickle();
-        }
         if (is_active)
         {
             if (task.m_co->state() & (Coroutine::State::INIT | Coroutine::State::YIELD))
             {
-                task.m_co->resume();
+                if (worker)
+                {
+                    RelaxedAdd(worker->task_cnt);
+                }
+                resume_task(worker, task.m_co);
+                record_stack_usage(task.m_co);
+                CoroutinePool::Put(task.m_co);
             }
             else
             {
@@ -132,29 +1131,31 @@ void Scheduler::run()
             {
                 if (Thread::CurThreadId() == m_main_thread_id && m_thread_cnt != 0)
                 {
-                    idle_co->resume();
+                    resume_idle(worker, idle_co);
                     continue;
                 }
                 break;
             }
             else
             {
-                if (need_tickle)
-                {
-                    need_tickle = false;
-                    continue;
-                }
-                idle_co->resume();
+                resume_idle(worker, idle_co);
             }
         }
     }
+    s_t_worker = nullptr;
     --m_thread_cnt;
     tickle();
+    task.reset();
+    idle_co.reset();
+    // 这里可能释放最后一个引用，不能留到线程退出时析构thread_local，否则~Scheduler中会重复释放s_t_scheduler
+    s_t_scheduler = nullptr;
 }
 
 void Scheduler::idle()
 {
     TIGER_LOG_D(TEST_LOG) << "[enter idle]";
+    Worker *worker = cur_worker();
+    TIGER_ASSERT_WITH_INFO(worker, "[scheduler idle without worker]");
     while (true)
     {
         if (m_is_stopping)
@@ -162,7 +1163,7 @@ void Scheduler::idle()
             if (m_main_thread_id == Thread::CurThreadId() && m_thread_cnt > 0)
             {
                 ++m_idle_cnt;
-                m_semaphore.wait();
+                worker->semaphore.wait();
                 --m_idle_cnt;
                 Coroutine::Yield();
                 continue;
@@ -171,9 +1172,22 @@ void Scheduler::idle()
         }
         else
         {
+            // 自旋期间不标记idle，投递任务的线程不需要唤醒
+            if (idle_spin(worker))
+            {
+                Coroutine::Yield();
+                continue;
+            }
+            worker->is_idle = true;
             ++m_idle_cnt;
-            m_semaphore.wait();
+            // 置idle之后再检查一次，防止丢失唤醒
+            if (!has_ready_task(worker))
+            {
+                ++m_park_cnt;
+                worker->semaphore.wait();
+            }
             --m_idle_cnt;
+            worker->is_idle = false;
             Coroutine::Yield();
         }
     }
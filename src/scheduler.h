@@ -9,48 +9,203 @@
 #define __TIGER_SCHEDULER_H__
 
 #include <atomic>
+#include <map>
 
 #include "macro.h"
 #include "mutex.h"
+#include "util.h"
+#include "work_stealing_queue.h"
 
 namespace tiger
 {
 
 class Scheduler : public std::enable_shared_from_this<Scheduler>
 {
+  public:
+    // 任务优先级，数值越小越优先
+    enum class Priority
+    {
+        HIGH = 0,
+        NORMAL = 1,
+        LOW = 2,
+    };
+    static const size_t PRIORITY_CNT = 3;
+
+    // 没有指定CPU时工作线程的自动绑定方式
+    enum class CpuLayout
+    {
+        // 不绑定，由内核调度
+        NONE = 0,
+        // 每个线程绑定一个物理核，核用完后再用超线程
+        CORE = 1,
+        // 线程轮流分到各NUMA节点，可以在节点内的CPU间迁移
+        NUMA = 2,
+    };
+
+    // 入队到开始执行的排队时间
+    struct WaitStats
+    {
+        uint64_t count = 0;
+        uint64_t total_us = 0;
+        uint64_t max_us = 0;
+
+        uint64_t avg_us() const
+        {
+            return count > 0 ? total_us / count : 0;
+        }
+    };
+
+    // 单个工作线程的运行统计，单位微秒
+    struct WorkerTelemetry
+    {
+        size_t idx = 0;
+        pid_t thread_id = 0;
+        bool is_idle = false;
+        // 邮箱、本地队列和批量缓存中的任务数
+        size_t queue_depth = 0;
+        // 执行的任务数，协程被唤醒后再次执行也计一次
+        uint64_t task_cnt = 0;
+        uint64_t switch_cnt = 0;
+        uint64_t steal_cnt = 0;
+        uint64_t tickle_cnt = 0;
+        uint64_t idle_us = 0;
+        // 入队到开始执行的时间，协程每次连续运行的时长
+        LatencyHistogram::Snapshot wait;
+        LatencyHistogram::Snapshot run;
+    };
+
+    // 调度器运行统计快照，汇总字段为所有工作线程之和
+    struct Telemetry
+    {
+        // 全局队列中的任务数
+        size_t queue_depth = 0;
+        size_t idle_cnt = 0;
+        uint64_t spin_hit_cnt = 0;
+        uint64_t park_cnt = 0;
+        uint64_t task_cnt = 0;
+        uint64_t switch_cnt = 0;
+        uint64_t steal_cnt = 0;
+        // 包括非工作线程投递任务时发出的唤醒
+        uint64_t tickle_cnt = 0;
+        uint64_t idle_us = 0;
+        LatencyHistogram::Snapshot wait;
+        LatencyHistogram::Snapshot run;
+        std::vector<WorkerTelemetry> workers;
+    };
+
+    // 看门狗发现的运行超时的协程
+    struct StallReport
+    {
+        std::string scheduler;
+        size_t worker_idx = 0;
+        pid_t thread_id = 0;
+        size_t co_id = 0;
+        std::string co_name;
+        uint64_t running_us = 0;
+        // 信号没有及时处理或协程已经让出时为空
+        std::vector<std::string> backtrace;
+        // 迁移到其他线程的任务数
+        size_t migrated = 0;
+    };
+
   private:
     struct Task
     {
         Coroutine::ptr m_co;
+        // 无栈回调，由工作线程的回调协程直接执行
+        std::function<void()> m_cb;
         pid_t m_thread_id;
+        Priority m_priority = Priority::NORMAL;
+        // 单调时钟微秒，0表示没有截止时间
+        uint64_t m_deadline = 0;
+        uint64_t m_enqueue_us = 0;
 
         Task() : m_co(nullptr), m_thread_id(0)
         {
         }
 
-        Task(Coroutine::ptr co, pid_t thread_id = 0) : m_co(co), m_thread_id(thread_id)
+        Task(Coroutine::ptr co, pid_t thread_id = 0, size_t = 0) : m_co(co), m_thread_id(thread_id)
         {
         }
 
-        Task(Coroutine::ptr *co, pid_t thread_id = 0) : m_co(nullptr), m_thread_id(thread_id)
+        Task(Coroutine::ptr *co, pid_t thread_id = 0, size_t = 0) : m_co(nullptr), m_thread_id(thread_id)
         {
             m_co.swap(*co);
         }
 
-        Task(std::function<void()> fn, pid_t thread_id = 0) : m_thread_id(thread_id)
+        // stack_size为0时使用默认栈大小
+        Task(std::function<void()> fn, pid_t thread_id = 0, size_t stack_size = 0) : m_thread_id(thread_id)
+        {
+            m_co = CoroutinePool::Get(std::move(fn), stack_size);
+        }
+
+        Task(std::function<void()> *fn, pid_t thread_id = 0, size_t stack_size = 0) : m_thread_id(thread_id)
         {
-            m_co = std::make_shared<Coroutine>(fn);
+            m_co = CoroutinePool::Get(std::move(*fn), stack_size);
         }
 
-        Task(std::function<void()> *fn, pid_t thread_id = 0) : m_thread_id(thread_id)
+        bool valid() const
         {
-            m_co = std::make_shared<Coroutine>(*fn, thread_id);
+            return m_co || m_cb;
         }
 
         void reset()
         {
             m_thread_id = 0;
             m_co = nullptr;
+            m_cb = nullptr;
+            m_priority = Priority::NORMAL;
+            m_deadline = 0;
+            m_enqueue_us = 0;
+        }
+    };
+
+  protected:
+    struct Worker
+    {
+        static const int STALL_FRAME_CNT = 32;
+
+        Scheduler *scheduler;
+        size_t idx;
+        std::atomic<pid_t> thread_id{0};
+        std::atomic<bool> is_idle{false};
+        Semaphore semaphore;
+        WorkStealingQueue<Task *> local_tasks;
+        // 指定在该线程执行的任务
+        MutexLock mailbox_mutex;
+        std::atomic<size_t> mailbox_cnt{0};
+        std::list<Task> mailbox;
+        // 批量执行无栈回调的协程，回调阻塞时该协程被提升为回调独占
+        Coroutine::ptr inline_co;
+        std::vector<std::function<void()>> inline_cbs;
+        size_t inline_idx = 0;
+        bool inline_blocked = false;
+        // 空闲时自旋等待任务的时长(微秒)，自旋等到任务时加倍，没等到时减半
+        uint64_t spin_us = 0;
+        // 从全局队列一次取出的任务，只有本线程访问，batch_cnt供其他线程判断是否还有任务
+        std::vector<Task> batch;
+        size_t batch_idx = 0;
+        std::atomic<size_t> batch_cnt{0};
+        // 运行统计，只由本线程写入，其他线程随时可读
+        std::atomic<uint64_t> task_cnt{0};
+        std::atomic<uint64_t> switch_cnt{0};
+        std::atomic<uint64_t> steal_cnt{0};
+        std::atomic<uint64_t> tickle_cnt{0};
+        std::atomic<uint64_t> idle_us{0};
+        LatencyHistogram wait_hist;
+        LatencyHistogram run_hist;
+        // 当前协程开始运行的时间，0表示没有协程在运行，看门狗据此判断超时
+        std::atomic<uint64_t> slice_start{0};
+        std::atomic<Coroutine *> slice_co{nullptr};
+        std::atomic<size_t> slice_co_id{0};
+        // 以下只由看门狗线程和本线程的信号处理函数访问
+        uint64_t stall_reported = 0;
+        std::atomic<int> stall_frame_cnt{-1};
+        void *stall_frames[STALL_FRAME_CNT];
+        char stall_name[32];
+
+        Worker(Scheduler *s, size_t i, size_t capacity) : scheduler(s), idx(i), local_tasks(capacity)
+        {
         }
     };
 
@@ -61,12 +216,65 @@ class Scheduler : public std::enable_shared_from_this<Scheduler>
     pid_t m_main_thread_id;
     bool m_is_stopping;
     bool m_is_stopped;
+    bool m_work_stealing;
     std::vector<Thread::ptr> m_threads;
-    Semaphore m_semaphore;
+    std::vector<Worker *> m_workers;
+    std::atomic<size_t> m_worker_idx{0};
+    std::atomic<size_t> m_tickle_idx{0};
+    std::atomic<size_t> m_stack_size{0};
+    StackUsageStats m_stack_stats;
+    // 全局队列，每个优先级一个FIFO队列和一个按截止时间排序的队列，由m_mutex保护
+    std::list<Task> m_tasks[PRIORITY_CNT];
+    std::multimap<uint64_t, Task> m_deadline_tasks[PRIORITY_CNT];
+    std::atomic<size_t> m_task_cnt{0};
+    std::atomic<size_t> m_high_task_cnt{0};
+    bool m_strict_priority;
+    size_t m_priority_weights[PRIORITY_CNT];
+    size_t m_priority_credits[PRIORITY_CNT];
+    std::atomic<uint64_t> m_wait_cnt[PRIORITY_CNT];
+    std::atomic<uint64_t> m_wait_total_us[PRIORITY_CNT];
+    std::atomic<uint64_t> m_wait_max_us[PRIORITY_CNT];
+    uint64_t m_idle_spin_us;
+    size_t m_batch_size;
+    std::atomic<uint64_t> m_spin_hit_cnt{0};
+    std::atomic<uint64_t> m_park_cnt{0};
+    // 是否统计运行时长和空闲时长，关闭后省掉每次切换的两次取时间
+    bool m_telemetry;
+    std::atomic<uint64_t> m_external_tickle_cnt{0};
+    // 协程连续运行超过该时长(微秒)时由看门狗报告，0表示不检查
+    uint64_t m_watchdog_us;
+    bool m_watchdog_migrate;
+    std::vector<int> m_cpus;
+    CpuLayout m_cpu_layout;
+
+  private:
+    Worker *find_worker(pid_t thread_id) const;
+    bool take_mail(Worker *worker, Task &task);
+    bool steal_task(Worker *worker, Task &task);
+    bool take_task(Worker *worker, Task &task);
+    void run_inline_cbs(Worker *worker);
+    void inline_loop();
+    void push_mail(Worker *worker, Task &task);
+    // 共享栈协程的原线程不存在时拒绝调度，返回false
+    bool push_task(Task &task);
+    bool push_tasks(std::list<Task> &tasks);
+    void push_global_task(Task &task);
+    bool pop_global_task(Task &task);
+    void fill_batch(Worker *worker);
+    void record_wait(Worker *worker, const Task &task, uint64_t now);
+    void resume_task(Worker *worker, const Coroutine::ptr &co);
+    void resume_idle(Worker *worker, const Coroutine::ptr &idle_co);
+    void record_stack_usage(const Coroutine::ptr &co);
+    bool capture_stall(Worker *worker, uint64_t start, StallReport &report);
+    size_t migrate_tasks(Worker *worker);
+    // 每个创建的线程要绑定的CPU，空表示不绑定
+    std::vector<std::vector<int>> cpu_plan() const;
+
+  private:
+    static void OnStallSignal(int);
 
   protected:
     std::atomic<size_t> m_idle_cnt{0};
-    std::list<Task> m_tasks;
     MutexLock m_mutex;
 
   protected:
@@ -75,6 +283,25 @@ class Scheduler : public std::enable_shared_from_this<Scheduler>
     virtual void tickle();
     virtual void run();
     virtual void idle();
+    virtual void tickle_worker(Worker *worker);
+
+    Worker *cur_worker() const;
+    // start之后不再变化
+    const std::vector<Worker *> &workers() const
+    {
+        return m_workers;
+    }
+    bool has_pending_task();
+    bool has_idle_mail();
+    // 当前线程是否有可取的任务，不加锁，只用于空闲时判断是否需要挂起
+    bool has_ready_task(Worker *worker) const;
+    // 挂起前先让出CPU自旋一段时间，poll返回true或有任务时结束，返回是否等到了
+    bool idle_spin(Worker *worker, const std::function<bool()> &poll = nullptr);
+    void count_park()
+    {
+        ++m_park_cnt;
+    }
+    void count_tickle();
 
   public:
     typedef std::shared_ptr<Scheduler> ptr;
@@ -110,12 +337,85 @@ class Scheduler : public std::enable_shared_from_this<Scheduler>
     {
         return m_idle_cnt > 0;
     }
+    bool work_stealing() const
+    {
+        return m_work_stealing;
+    }
+    // 新建协程使用的栈大小，0表示默认大小，开启自适应栈后根据统计调整
+    size_t stack_size() const
+    {
+        return m_stack_size;
+    }
+    // 开启栈涂色(tiger.coroutine.stackPaintSample)后统计的栈使用峰值
+    const StackUsageStats &stack_stats() const
+    {
+        return m_stack_stats;
+    }
+
+    // 需在start之前设置
+    void set_work_stealing(bool v)
+    {
+        m_work_stealing = v;
+    }
+
+    // 第i个创建的线程绑定cpus[i % cpus.size()]，为空时按layout自动分配，需在start之前设置
+    // 调用start的线程(use_main_thread)不绑定，避免改变调用方的亲和性
+    void set_cpu_affinity(const std::vector<int> &cpus)
+    {
+        m_cpus = cpus;
+    }
+    void set_cpu_layout(CpuLayout layout)
+    {
+        m_cpu_layout = layout;
+    }
+
+    bool strict_priority() const
+    {
+        return m_strict_priority;
+    }
+    // 严格优先级或按权重轮转(tiger.scheduler.priorityWeights)，需在start之前设置
+    void set_strict_priority(bool v)
+    {
+        m_strict_priority = v;
+    }
+
+    // 关闭telemetry时NORMAL且无截止时间的任务不计入
+    WaitStats wait_stats(Priority priority) const;
+    void reset_wait_stats();
+
+    // 空闲自旋等到任务的次数和真正挂起的次数
+    uint64_t spin_hit_cnt() const
+    {
+        return m_spin_hit_cnt;
+    }
+    uint64_t park_cnt() const
+    {
+        return m_park_cnt;
+    }
+
+    // 运行中随时可以调用，不影响调度
+    Telemetry telemetry();
+
+    uint64_t watchdog_us() const
+    {
+        return m_watchdog_us;
+    }
+    // 覆盖tiger.scheduler.watchdogMs/watchdogMigrate，需在start之前设置
+    void set_watchdog(uint64_t ms, bool migrate)
+    {
+        m_watchdog_us = ms * 1000;
+        m_watchdog_migrate = migrate;
+    }
+    // 找出连续运行超过watchdog_us的协程并采集调用栈，开启迁移时把该线程积压的任务交给其他线程
+    // 由看门狗线程调用，同一个运行片段只报告一次
+    std::vector<StallReport> check_stalls();
 
   public:
     static Scheduler::ptr GetThreadScheduler();
 
   public:
     virtual void start();
+    // 只设置停止标记并唤醒工作线程，不等待它们退出；工作线程退出前持有调度器的引用
     virtual void stop();
 
   public:
@@ -123,38 +423,73 @@ class Scheduler : public std::enable_shared_from_this<Scheduler>
     {
         if (m_is_stopping)
             return false;
-        bool need_tickle = false;
-        {
-            MutexLock::Lock lock(m_mutex);
-            need_tickle = m_tasks.empty();
-            m_tasks.push_back(Task(v, thread_id));
-        }
-        if (need_tickle && m_idle_cnt > 0)
+        Task task(v, thread_id, m_stack_size);
+        return push_task(task);
+    }
+
+    // 指定优先级，deadline_ms不为0时同一优先级内按截止时间先到先执行
+    template <typename T> bool schedule(T v, Priority priority, time_t deadline_ms = 0)
+    {
+        if (m_is_stopping)
+            return false;
+        Task task(v, 0, m_stack_size);
+        task.m_priority = priority;
+        if (deadline_ms > 0)
         {
-            tickle();
+            task.m_deadline = MonotonicMicrosecond() + deadline_ms * 1000;
         }
-        return true;
+        return push_task(task);
     }
 
     template <typename ForwardIterator> bool schedules(ForwardIterator begin, ForwardIterator end, pid_t thread_id = 0)
     {
         if (m_is_stopping)
             return false;
-        bool need_tickle = false;
+        std::list<Task> tasks;
+        while (begin != end)
         {
-            MutexLock::Lock lock(m_mutex);
-            need_tickle = m_tasks.empty();
-            while (begin != end)
-            {
-                m_tasks.push_back(Task(*begin, thread_id));
-                ++begin;
-            }
+            tasks.push_back(Task(*begin, thread_id, m_stack_size));
+            ++begin;
         }
-        if (need_tickle && m_idle_cnt > 0)
+        return push_tasks(tasks);
+    }
+
+    // 回调运行在线程共享栈上，让出时只保存已用的栈，适用于大量长时间挂起的协程
+    template <typename T> bool schedule_shared(T v, pid_t thread_id = 0)
+    {
+        if (m_is_stopping)
+            return false;
+        Task task;
+        task.m_co = std::make_shared<Coroutine>(std::move(v), 0, true);
+        task.m_thread_id = thread_id;
+        return push_task(task);
+    }
+
+    // 适用于不会阻塞的短回调，不再为每个回调创建协程；回调中途阻塞时自动提升为独立协程
+    template <typename T> bool schedule_inline(T v, pid_t thread_id = 0)
+    {
+        if (m_is_stopping)
+            return false;
+        Task task;
+        task.m_cb = std::move(v);
+        task.m_thread_id = thread_id;
+        return push_task(task);
+    }
+
+    template <typename ForwardIterator>
+    bool schedules_inline(ForwardIterator begin, ForwardIterator end, pid_t thread_id = 0)
+    {
+        if (m_is_stopping)
+            return false;
+        std::list<Task> tasks;
+        while (begin != end)
         {
-            tickle();
+            tasks.push_back(Task());
+            tasks.back().m_cb = *begin;
+            tasks.back().m_thread_id = thread_id;
+            ++begin;
         }
-        return true;
+        return push_tasks(tasks);
     }
 };
 
@@ -19,7 +19,7 @@ static ConfigVar<int64_t>::ptr g_tcp_server_recv_timeout =
 
 TCPServer::TCPServer(IOManager::ptr io_worker, IOManager::ptr accept_worker, const std::string &name)
     : m_io_worker(io_worker), m_accept_worker(accept_worker), m_accept_timeout(g_tcp_server_accept_timeout->val()),
-      m_recv_timeout(g_tcp_server_recv_timeout->val()), m_name(name), m_is_stop(true)
+      m_recv_timeout(g_tcp_server_recv_timeout->val()), m_name(name), m_is_stop(true), m_shared_stack(false)
 {
 }
 
@@ -140,7 +140,17 @@ void TCPServer::start_accept(Socket::ptr socket)
         if (client)
         {
             client->set_recv_timeout(m_accept_timeout);
-            m_io_worker->schedule(std::bind(&TCPServer::handle_client, shared_from_this(), client));
+            // 多reactor模式下连接固定在一个工作线程上，之后的读写和超时不再跨线程
+            pid_t thread_id = m_io_worker->assign_thread();
+            if (m_shared_stack)
+            {
+                m_io_worker->schedule_shared(std::bind(&TCPServer::handle_client, shared_from_this(), client),
+                                             thread_id);
+            }
+            else
+            {
+                m_io_worker->schedule(std::bind(&TCPServer::handle_client, shared_from_this(), client), thread_id);
+            }
         }
         else
         {
@@ -27,6 +27,8 @@ class TCPServer : public std::enable_shared_from_this<TCPServer>
     int64_t m_recv_timeout;
     std::string m_name;
     bool m_is_stop;
+    // 客户端协程使用共享栈，适合大量空闲长连接
+    bool m_shared_stack;
 
   protected:
     virtual void handle_client(Socket::ptr client);
@@ -63,6 +65,10 @@ class TCPServer : public std::enable_shared_from_this<TCPServer>
     {
         return m_is_stop;
     }
+    bool is_shared_stack() const
+    {
+        return m_shared_stack;
+    }
 
     void set_accept_timeout(int64_t timeout_ms)
     {
@@ -76,6 +82,10 @@ class TCPServer : public std::enable_shared_from_this<TCPServer>
     {
         m_name = name;
     }
+    void set_shared_stack(bool v)
+    {
+        m_shared_stack = v;
+    }
 
   public:
     bool load_certificates(const std::string &cert_file, const std::string &key_file);
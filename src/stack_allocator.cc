@@ -0,0 +1,270 @@
+/*****************************************************************
+ * Description
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/07
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#include "stack_allocator.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "config.h"
+#include "macro.h"
+#include "mutex.h"
+#include "thread.h"
+
+namespace tiger
+{
+
+static ConfigVar<size_t>::ptr g_stack_region_size =
+    Config::Lookup<size_t>("tiger.coroutine.stackRegionSize", 4 * 1024 * 1024, "Coroutine Stack mmap Region Size");
+static ConfigVar<size_t>::ptr g_stack_cache_cnt =
+    Config::Lookup<size_t>("tiger.coroutine.stackCacheCnt", 64, "Coroutine Free Stack Resident Count Per Size");
+static ConfigVar<bool>::ptr g_stack_guard =
+    Config::Lookup<bool>("tiger.coroutine.stackGuard", true, "Coroutine Stack Guard Page");
+
+struct SizeClass
+{
+    // 空闲且物理内存仍驻留的栈，优先复用
+    std::vector<void *> hot;
+    // 空闲且已madvise归还物理内存的栈
+    std::vector<void *> cold;
+    // 当前正在切分的区域
+    char *cur = nullptr;
+    char *end = nullptr;
+};
+
+struct StackPool
+{
+    SpinLock lock;
+    std::unordered_map<size_t, SizeClass> classes;
+    // 本池映射的区域，起始地址到结束地址
+    std::map<char *, char *> regions;
+    size_t mapped = 0;
+    size_t free_cnt = 0;
+    size_t released_cnt = 0;
+
+    // 调用时持有lock
+    bool owns(void *vp) const
+    {
+        auto it = regions.upper_bound((char *)vp);
+        if (it == regions.begin())
+            return false;
+        --it;
+        return (char *)vp < it->second;
+    }
+};
+
+static const int MAX_STACK_POOL = 64;
+
+static std::atomic<StackPool *> s_stack_pools[MAX_STACK_POOL];
+
+// 每个NUMA节点一个池，绑定了节点的线程只从本节点的池分配，物理页按首次访问落在本地
+// 不析构，避免退出时其他静态对象中的协程归还栈时访问已析构的对象
+static StackPool &GetStackPool(int node)
+{
+    node = node >= 0 && node < MAX_STACK_POOL ? node : 0;
+    StackPool *pool = s_stack_pools[node].load(std::memory_order_acquire);
+    if (pool)
+        return *pool;
+    StackPool *created = new StackPool;
+    if (s_stack_pools[node].compare_exchange_strong(pool, created))
+        return *created;
+    delete created;
+    return *pool;
+}
+
+static StackPool &GetStackPool()
+{
+    return GetStackPool(Thread::CurNumaNode());
+}
+
+// 切分出该栈的池，被其他节点的线程释放时也归还到原节点，热栈不会换到别的节点上复用
+static StackPool &OwnerStackPool(void *vp)
+{
+    StackPool &pool = GetStackPool();
+    {
+        SpinLock::Lock lock(pool.lock);
+        if (pool.owns(vp))
+            return pool;
+    }
+    for (int i = 0; i < MAX_STACK_POOL; ++i)
+    {
+        StackPool *other = s_stack_pools[i].load(std::memory_order_acquire);
+        if (!other || other == &pool)
+            continue;
+        SpinLock::Lock lock(other->lock);
+        if (other->owns(vp))
+            return *other;
+    }
+    return pool;
+}
+
+static size_t AlignSize(size_t size)
+{
+    size_t page = StackAllocator::PageSize();
+    return (size + page - 1) / page * page;
+}
+
+size_t StackAllocator::PageSize()
+{
+    static size_t page = sysconf(_SC_PAGESIZE);
+    return page;
+}
+
+// 调用时持有lock，从当前区域切出一个栈的位置，区域不够返回nullptr
+static char *ReserveSlot(SizeClass &sc, size_t slot)
+{
+    if (static_cast<size_t>(sc.end - sc.cur) < slot)
+        return nullptr;
+    char *vp = sc.cur;
+    sc.cur += slot;
+    return vp;
+}
+
+void *StackAllocator::Alloc(size_t size)
+{
+    size = AlignSize(size);
+    size_t guard = g_stack_guard->val() ? PageSize() : 0;
+    size_t slot = guard + size;
+    StackPool &pool = GetStackPool();
+    char *vp = nullptr;
+    {
+        SpinLock::Lock lock(pool.lock);
+        SizeClass &sc = pool.classes[size];
+        if (!sc.hot.empty())
+        {
+            vp = static_cast<char *>(sc.hot.back());
+            sc.hot.pop_back();
+            --pool.free_cnt;
+            return vp;
+        }
+        if (!sc.cold.empty())
+        {
+            vp = static_cast<char *>(sc.cold.back());
+            sc.cold.pop_back();
+            --pool.free_cnt;
+            --pool.released_cnt;
+            return vp;
+        }
+        vp = ReserveSlot(sc, slot);
+    }
+    // mmap、mprotect和日志都不在自旋锁内，避免其他线程长时间空转
+    if (!vp)
+    {
+        size_t region = g_stack_region_size->val() / slot * slot;
+        region = region == 0 ? slot : region;
+        void *base = mmap(nullptr, region, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (base == MAP_FAILED)
+        {
+            TIGER_LOG_E(SYSTEM_LOG) << "[mmap stack region fail"
+                                    << " size:" << region << " errno:" << strerror(errno) << "]";
+            return nullptr;
+        }
+        bool used = false;
+        {
+            SpinLock::Lock lock(pool.lock);
+            SizeClass &sc = pool.classes[size];
+            // 映射期间其他线程可能已换上新区域，优先用它，新映射的区域直接释放
+            vp = ReserveSlot(sc, slot);
+            if (!vp)
+            {
+                used = true;
+                pool.mapped += region;
+                sc.cur = static_cast<char *>(base);
+                sc.end = sc.cur + region;
+                pool.regions[sc.cur] = sc.end;
+                vp = ReserveSlot(sc, slot);
+            }
+        }
+        if (!used)
+        {
+            munmap(base, region);
+        }
+    }
+    // 栈向低地址增长，保护页放在最低处，位置已被本线程独占
+    if (guard && mprotect(vp, guard, PROT_NONE))
+    {
+        TIGER_LOG_E(SYSTEM_LOG) << "[mprotect stack guard page fail"
+                                << " errno:" << strerror(errno) << "]";
+    }
+    return vp + guard;
+}
+
+void StackAllocator::Dealloc(void *vp, size_t size)
+{
+    if (!vp)
+        return;
+    size = AlignSize(size);
+    StackPool &pool = OwnerStackPool(vp);
+    {
+        SpinLock::Lock lock(pool.lock);
+        SizeClass &sc = pool.classes[size];
+        ++pool.free_cnt;
+        if (sc.hot.size() < g_stack_cache_cnt->val())
+        {
+            sc.hot.push_back(vp);
+            return;
+        }
+    }
+    // 栈已不属于任何协程，放回链表之前释放物理内存
+    if (madvise(vp, size, MADV_DONTNEED))
+    {
+        TIGER_LOG_E(SYSTEM_LOG) << "[madvise stack fail"
+                                << " errno:" << strerror(errno) << "]";
+    }
+    SpinLock::Lock lock(pool.lock);
+    pool.classes[size].cold.push_back(vp);
+    ++pool.released_cnt;
+}
+
+size_t StackAllocator::MappedBytes()
+{
+    size_t total = 0;
+    for (int i = 0; i < MAX_STACK_POOL; ++i)
+    {
+        StackPool *pool = s_stack_pools[i].load(std::memory_order_acquire);
+        if (!pool)
+            continue;
+        SpinLock::Lock lock(pool->lock);
+        total += pool->mapped;
+    }
+    return total;
+}
+
+size_t StackAllocator::FreeCnt()
+{
+    size_t total = 0;
+    for (int i = 0; i < MAX_STACK_POOL; ++i)
+    {
+        StackPool *pool = s_stack_pools[i].load(std::memory_order_acquire);
+        if (!pool)
+            continue;
+        SpinLock::Lock lock(pool->lock);
+        total += pool->free_cnt;
+    }
+    return total;
+}
+
+size_t StackAllocator::ReleasedCnt()
+{
+    size_t total = 0;
+    for (int i = 0; i < MAX_STACK_POOL; ++i)
+    {
+        StackPool *pool = s_stack_pools[i].load(std::memory_order_acquire);
+        if (!pool)
+            continue;
+        SpinLock::Lock lock(pool->lock);
+        total += pool->released_cnt;
+    }
+    return total;
+}
+
+} // namespace tiger
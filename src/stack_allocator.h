@@ -0,0 +1,39 @@
+/*****************************************************************
+ * Description 协程栈分配器
+ *  从大块mmap区域中切分协程栈，每个栈下方有一个PROT_NONE保护页，栈溢出时直接SIGSEGV
+ *  按栈大小维护空闲链表，超过缓存数量的空闲栈用madvise(MADV_DONTNEED)归还物理内存
+ *  保护页会拆分映射区域，大量协程时需要调大vm.max_map_count或关闭tiger.coroutine.stackGuard
+ *  每个NUMA节点一个空闲栈池，绑定了节点的线程(Thread::SetAffinity)只复用本节点的栈
+ *  栈释放时归还到切分出它的节点的池，与释放它的线程所在的节点无关
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/07
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#ifndef __TIGER_STACK_ALLOCATOR_H__
+#define __TIGER_STACK_ALLOCATOR_H__
+
+#include <stddef.h>
+
+namespace tiger
+{
+
+class StackAllocator
+{
+  public:
+    // 返回栈的低地址，失败返回nullptr
+    static void *Alloc(size_t size);
+    static void Dealloc(void *vp, size_t size);
+
+    static size_t PageSize();
+    // 已映射的总字节数(含保护页)
+    static size_t MappedBytes();
+    // 空闲栈数量
+    static size_t FreeCnt();
+    // 已归还物理内存的空闲栈数量
+    static size_t ReleasedCnt();
+};
+
+} // namespace tiger
+
+#endif
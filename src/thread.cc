@@ -7,9 +7,17 @@
 
 #include "thread.h"
 
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/syscall.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <fstream>
+#include <map>
+
 #include "const.h"
 #include "macro.h"
 
@@ -19,6 +27,9 @@ namespace tiger
 static thread_local Thread *cur_thread = nullptr;
 static thread_local std::string cur_thread_name = "UNKNOW";
 static thread_local pid_t cur_thread_id = 0;
+static thread_local int cur_thread_node = 0;
+
+static const int MAX_NUMA_NODE = 64;
 
 Thread::Thread(std::function<void()> cb, const std::string &name) : m_cb(cb), m_name(name)
 {
@@ -99,6 +110,57 @@ void Thread::CondSignal(pthread_cond_t &cond, pthread_mutex_t &mtx, size_t cnt)
     pthread_mutex_unlock(&mtx);
 }
 
+bool Thread::SetAffinity(const std::vector<int> &cpus)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu : cpus)
+    {
+        if (cpu >= 0 && cpu < CPU_SETSIZE)
+        {
+            CPU_SET(cpu, &set);
+        }
+    }
+    int rt = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rt)
+    {
+        TIGER_LOG_E(SYSTEM_LOG) << "[pthread_setaffinity_np fail"
+                                << " cpus:" << cpus.size() << " errno:" << strerror(rt) << "]";
+        return false;
+    }
+    // 跨多个节点时无法确定本地节点
+    int node = -1;
+    for (auto cpu : cpus)
+    {
+        int n = CpuTopology::NodeOf(cpu);
+        node = node == -1 || node == n ? n : -2;
+    }
+    cur_thread_node = node >= 0 ? node : 0;
+    return true;
+}
+
+std::vector<int> Thread::CurAffinity()
+{
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set))
+        return cpus;
+    for (int i = 0; i < CPU_SETSIZE; ++i)
+    {
+        if (CPU_ISSET(i, &set))
+        {
+            cpus.push_back(i);
+        }
+    }
+    return cpus;
+}
+
+int Thread::CurNumaNode()
+{
+    return cur_thread_node;
+}
+
 void *Thread::Run(void *arg)
 {
     try
@@ -120,4 +182,114 @@ void *Thread::Run(void *arg)
     return 0;
 }
 
-} // namespace tiger
\ No newline at end of file
+static std::string ReadSysFile(const std::string &path)
+{
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+static std::vector<CpuTopology::Cpu> LoadCpus()
+{
+    std::vector<CpuTopology::Cpu> cpus;
+    std::map<int, int> nodes;
+    for (int node = 0; node < MAX_NUMA_NODE; ++node)
+    {
+        std::string path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+        for (auto cpu : CpuTopology::ParseCpuList(ReadSysFile(path)))
+        {
+            nodes[cpu] = node;
+        }
+    }
+    // 进程的CPU范围可能被taskset或cgroup限制，以主线程为准
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(getpid(), sizeof(set), &set))
+    {
+        TIGER_LOG_E(SYSTEM_LOG) << "[sched_getaffinity fail errno:" << strerror(errno) << "]";
+        return cpus;
+    }
+    std::map<std::pair<int, int>, int> siblings;
+    for (int i = 0; i < CPU_SETSIZE; ++i)
+    {
+        if (!CPU_ISSET(i, &set))
+            continue;
+        CpuTopology::Cpu cpu;
+        cpu.id = i;
+        cpu.node = nodes.count(i) ? nodes[i] : 0;
+        std::string topology = "/sys/devices/system/cpu/cpu" + std::to_string(i) + "/topology/";
+        std::string package = ReadSysFile(topology + "physical_package_id");
+        std::string core = ReadSysFile(topology + "core_id");
+        cpu.package = package.empty() ? 0 : atoi(package.c_str());
+        cpu.core = core.empty() ? i : atoi(core.c_str());
+        cpu.sibling = siblings[std::make_pair(cpu.package, cpu.core)]++;
+        cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+const std::vector<CpuTopology::Cpu> &CpuTopology::Cpus()
+{
+    static std::vector<Cpu> cpus = LoadCpus();
+    return cpus;
+}
+
+std::vector<int> CpuTopology::NodeCpus(int node)
+{
+    std::vector<int> cpus;
+    for (auto &cpu : Cpus())
+    {
+        if (cpu.node == node)
+        {
+            cpus.push_back(cpu.id);
+        }
+    }
+    return cpus;
+}
+
+size_t CpuTopology::NodeCnt()
+{
+    int max = -1;
+    for (auto &cpu : Cpus())
+    {
+        max = std::max(max, cpu.node);
+    }
+    return max + 1;
+}
+
+int CpuTopology::NodeOf(int cpu)
+{
+    for (auto &c : Cpus())
+    {
+        if (c.id == cpu)
+            return c.node;
+    }
+    return 0;
+}
+
+std::vector<int> CpuTopology::ParseCpuList(const std::string &str)
+{
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while (pos < str.size())
+    {
+        size_t end = str.find(',', pos);
+        end = end == std::string::npos ? str.size() : end;
+        std::string range = str.substr(pos, end - pos);
+        size_t dash = range.find('-');
+        if (!range.empty())
+        {
+            int first = atoi(range.c_str());
+            int last = dash == std::string::npos ? first : atoi(range.c_str() + dash + 1);
+            for (int cpu = first; cpu <= last; ++cpu)
+            {
+                cpus.push_back(cpu);
+            }
+        }
+        pos = end + 1;
+    }
+    return cpus;
+}
+
+} // namespace tiger
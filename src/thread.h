@@ -13,6 +13,7 @@
 #include <functional>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "mutex.h"
 
@@ -46,6 +47,12 @@ class Thread
     static const pid_t CurThreadId();
     static void CondWait(pthread_cond_t &cond, pthread_mutex_t &mtx);
     static void CondSignal(pthread_cond_t &cond, pthread_mutex_t &mtx, size_t cnt = 1);
+    // 绑定当前线程到cpus，同时记录所在的NUMA节点
+    static bool SetAffinity(const std::vector<int> &cpus);
+    // 当前线程允许运行的CPU
+    static std::vector<int> CurAffinity();
+    // 绑定到单个NUMA节点之后为该节点，否则为0
+    static int CurNumaNode();
 
   private:
     static void *Run(void *arg);
@@ -56,6 +63,29 @@ class Thread
     Thread &operator=(const Thread &) = delete;
 };
 
+// 从/sys读取的CPU拓扑，只包含主线程允许运行的CPU，读取失败时视为单节点且每个CPU独占一个核
+class CpuTopology
+{
+  public:
+    struct Cpu
+    {
+        int id = 0;
+        int node = 0;
+        int package = 0;
+        int core = 0;
+        // 同一物理核上的第几个超线程
+        int sibling = 0;
+    };
+
+  public:
+    static const std::vector<Cpu> &Cpus();
+    static std::vector<int> NodeCpus(int node);
+    static size_t NodeCnt();
+    static int NodeOf(int cpu);
+    // 解析"0-3,8,10-11"格式的CPU列表
+    static std::vector<int> ParseCpuList(const std::string &str);
+};
+
 } // namespace tiger
 
 #endif
\ No newline at end of file
@@ -7,6 +7,9 @@
 
 #include "timer.h"
 
+#include <string.h>
+
+#include <algorithm>
 #include <atomic>
 
 #include "config.h"
@@ -17,13 +20,26 @@ namespace tiger
 
 static std::atomic<size_t> s_timer_id{0};
 
-TimerManager::Timer::Timer(time_t ms, bool loop, std::function<void()> cb) : m_interval(ms), m_loop(loop)
+TimerManager::Timer::Timer(time_t us, bool loop, std::function<void()> cb, time_t slack_us)
+    : m_interval(us), m_loop(loop), m_slack(slack_us)
 {
     m_id = ++s_timer_id;
-    m_next_time = Millisecond() + m_interval;
+    refresh(LoopMicrosecond());
     m_cb.swap(cb);
 }
 
+void TimerManager::Timer::refresh(time_t now)
+{
+    m_due = now + m_interval;
+    m_next_time = m_due;
+    if (m_slack > 0)
+    {
+        // 对齐到全局的边界，不同定时器落在同一区间时到期时间相同
+        time_t align = (time_t)1 << (63 - __builtin_clzll(m_slack));
+        m_next_time = (m_due + align - 1) & ~(align - 1);
+    }
+}
+
 bool TimerManager::Timer::Comparator::operator()(const Timer::ptr &l, const Timer::ptr &r) const
 {
     if (!r)
@@ -37,23 +53,263 @@ bool TimerManager::Timer::Comparator::operator()(const Timer::ptr &l, const Time
     return l.get() < r.get();
 }
 
+TimerManager::Wheel::Wheel(time_t now) : m_time(now)
+{
+}
+
+int TimerManager::Wheel::slot_of(time_t expire) const
+{
+    // 已经到期的放在下一个要处理的槽里
+    if (expire < m_time)
+        expire = m_time;
+    time_t delta = expire - m_time;
+    if (delta < (1 << SLOT0_BITS))
+        return expire & ((1 << SLOT0_BITS) - 1);
+    int base = 1 << SLOT0_BITS;
+    for (int level = 1; level < LEVEL_CNT; ++level)
+    {
+        int shift = SLOT0_BITS + (level - 1) * SLOT_BITS;
+        if (level == LEVEL_CNT - 1 && delta >= ((time_t)1 << (shift + SLOT_BITS)))
+        {
+            // 超出范围的先放到最远的槽，降级时重新计算
+            expire = m_time + ((time_t)1 << (shift + SLOT_BITS)) - 1;
+        }
+        if (delta < ((time_t)1 << (shift + SLOT_BITS)) || level == LEVEL_CNT - 1)
+            return base + ((expire >> shift) & ((1 << SLOT_BITS) - 1));
+        base += 1 << SLOT_BITS;
+    }
+    return -1;
+}
+
+void TimerManager::Wheel::link(Timer *timer, int slot)
+{
+    timer->m_slot = slot;
+    timer->m_prev = nullptr;
+    timer->m_next = m_slots[slot];
+    if (m_slots[slot])
+        m_slots[slot]->m_prev = timer;
+    m_slots[slot] = timer;
+    m_bits[slot >> 6] |= 1ull << (slot & 63);
+}
+
+void TimerManager::Wheel::insert(Timer::ptr timer)
+{
+    link(timer.get(), slot_of(timer->m_next_time));
+    timer->m_hold = timer;
+    ++m_size;
+}
+
+void TimerManager::Wheel::erase(Timer *timer)
+{
+    int slot = timer->m_slot;
+    if (timer->m_prev)
+        timer->m_prev->m_next = timer->m_next;
+    else
+        m_slots[slot] = timer->m_next;
+    if (timer->m_next)
+        timer->m_next->m_prev = timer->m_prev;
+    if (!m_slots[slot])
+        m_bits[slot >> 6] &= ~(1ull << (slot & 63));
+    timer->m_prev = timer->m_next = nullptr;
+    timer->m_slot = -1;
+    --m_size;
+    // 调用方持有定时器，这里释放不会析构
+    timer->m_hold.reset();
+}
+
+void TimerManager::Wheel::take_slot(int slot, std::vector<Timer::ptr> &timers)
+{
+    Timer *timer = m_slots[slot];
+    while (timer)
+    {
+        Timer *next = timer->m_next;
+        timer->m_prev = timer->m_next = nullptr;
+        timer->m_slot = -1;
+        timers.push_back(std::move(timer->m_hold));
+        --m_size;
+        timer = next;
+    }
+    m_slots[slot] = nullptr;
+    m_bits[slot >> 6] &= ~(1ull << (slot & 63));
+}
+
+void TimerManager::Wheel::cascade(int level)
+{
+    int shift = SLOT0_BITS + (level - 1) * SLOT_BITS;
+    int slot = (1 << SLOT0_BITS) + (level - 1) * (1 << SLOT_BITS) + ((m_time >> shift) & ((1 << SLOT_BITS) - 1));
+    Timer *timer = m_slots[slot];
+    m_slots[slot] = nullptr;
+    m_bits[slot >> 6] &= ~(1ull << (slot & 63));
+    while (timer)
+    {
+        Timer *next = timer->m_next;
+        link(timer, slot_of(timer->m_next_time));
+        timer = next;
+    }
+}
+
+int TimerManager::Wheel::first_slot(int level, int from) const
+{
+    if (level == 0)
+    {
+        for (int word = from >> 6; word < (1 << SLOT0_BITS) / 64; ++word)
+        {
+            uint64_t bits = m_bits[word];
+            if (word == from >> 6)
+                bits &= ~0ull << (from & 63);
+            if (bits)
+                return word * 64 + __builtin_ctzll(bits);
+        }
+        return -1;
+    }
+    if (from >= (1 << SLOT_BITS))
+        return -1;
+    uint64_t bits = m_bits[(1 << SLOT0_BITS) / 64 + level - 1] & (~0ull << from);
+    return bits ? __builtin_ctzll(bits) : -1;
+}
+
+time_t TimerManager::Wheel::next_time() const
+{
+    if (m_size == 0)
+        return ~0;
+    time_t next = std::numeric_limits<time_t>::max();
+    int cur = m_time & ((1 << SLOT0_BITS) - 1);
+    time_t block = m_time - cur;
+    int slot = first_slot(0, cur);
+    if (slot >= 0)
+    {
+        next = block + slot;
+    }
+    else if ((slot = first_slot(0, 0)) >= 0)
+    {
+        next = block + (1 << SLOT0_BITS) + slot;
+    }
+    // 更高层的槽返回降级的时间，醒来降级后再重新计算
+    for (int level = 1; level < LEVEL_CNT; ++level)
+    {
+        int shift = SLOT0_BITS + (level - 1) * SLOT_BITS;
+        int idx = (m_time >> shift) & ((1 << SLOT_BITS) - 1);
+        time_t round = m_time >> (shift + SLOT_BITS) << (shift + SLOT_BITS);
+        // m_time正好在边界上时当前槽还没有降级
+        bool pending = (m_time & (((time_t)1 << shift) - 1)) == 0;
+        slot = first_slot(level, pending ? idx : idx + 1);
+        if (slot < 0)
+        {
+            slot = first_slot(level, 0);
+            round += (time_t)1 << (shift + SLOT_BITS);
+        }
+        if (slot >= 0)
+        {
+            next = std::min(next, round + ((time_t)slot << shift));
+        }
+    }
+    return next;
+}
+
+void TimerManager::Wheel::expire(time_t now, std::vector<Timer::ptr> &timers)
+{
+    while (m_time <= now)
+    {
+        if (m_size == 0)
+        {
+            m_time = now + 1;
+            return;
+        }
+        int cur = m_time & ((1 << SLOT0_BITS) - 1);
+        if (cur == 0)
+        {
+            for (int level = 1; level < LEVEL_CNT; ++level)
+            {
+                cascade(level);
+                if ((m_time >> (SLOT0_BITS + (level - 1) * SLOT_BITS)) & ((1 << SLOT_BITS) - 1))
+                    break;
+            }
+        }
+        take_slot(cur, timers);
+        ++m_time;
+        // 跳到下一个非空的槽或需要降级的边界，中间的空槽和空的边界不用逐个处理
+        time_t next = m_size ? std::max(next_time(), m_time) : now + 1;
+        m_time = std::min(next, now + 1);
+    }
+    // 插入时已经到期的定时器放在了下一个槽里，和同槽未到期的分开取出
+    int slot = m_time & ((1 << SLOT0_BITS) - 1);
+    Timer *timer = m_slots[slot];
+    while (timer)
+    {
+        Timer *next = timer->m_next;
+        if (timer->m_next_time <= now)
+        {
+            Timer::ptr hold = timer->m_hold;
+            erase(timer);
+            timers.push_back(std::move(hold));
+        }
+        timer = next;
+    }
+}
+
+void TimerManager::Wheel::clear()
+{
+    for (int slot = 0; slot < SLOT_CNT; ++slot)
+    {
+        Timer *timer = m_slots[slot];
+        m_slots[slot] = nullptr;
+        while (timer)
+        {
+            Timer *next = timer->m_next;
+            timer->m_prev = timer->m_next = nullptr;
+            timer->m_slot = -1;
+            timer->m_cb = nullptr;
+            timer->m_hold.reset();
+            timer = next;
+        }
+    }
+    memset(m_bits, 0, sizeof(m_bits));
+    m_size = 0;
+}
+
 TimerManager::TimerManager()
 {
 }
 
 TimerManager::~TimerManager()
 {
+    if (m_wheel)
+    {
+        m_wheel->clear();
+    }
 }
 
-TimerManager::Timer::ptr TimerManager::add_timer(time_t interval, std::function<void()> cb, bool loop)
+void TimerManager::insert_timer(Timer::ptr timer)
 {
-    auto timer = std::make_shared<Timer>(interval, loop, cb);
-    ReadWriteLock::WriteLock lock(m_lock);
+    if (m_wheel)
+    {
+        time_t next_time = timer->m_next_time;
+        m_wheel->insert(timer);
+        if (next_time < m_wheel_wakeup)
+        {
+            m_wheel_wakeup = next_time;
+            on_timer_refresh();
+        }
+        return;
+    }
     m_timers.insert(timer);
     if (m_timers.begin() == m_timers.find(timer))
     {
         on_timer_refresh();
     }
+}
+
+TimerManager::Timer::ptr TimerManager::add_timer(time_t interval, std::function<void()> cb, bool loop, time_t slack)
+{
+    return add_timer_us(interval * 1000, std::move(cb), loop, slack * 1000);
+}
+
+TimerManager::Timer::ptr TimerManager::add_timer_us(time_t interval_us, std::function<void()> cb, bool loop,
+                                                    time_t slack_us)
+{
+    auto timer = std::make_shared<Timer>(interval_us, loop, cb, slack_us);
+    ReadWriteLock::WriteLock lock(m_lock);
+    insert_timer(timer);
     return timer;
 }
 
@@ -84,15 +340,24 @@ TimerManager::Timer::ptr TimerManager::add_cond_timer(time_t interval, std::func
 bool TimerManager::is_valid_timer(Timer::ptr timer)
 {
     ReadWriteLock::ReadLock lock(m_lock);
+    if (m_wheel)
+        return timer->m_slot >= 0;
     return !(m_timers.find(timer) == m_timers.end());
 }
 
 void TimerManager::reset_timer(Timer::ptr timer, time_t interval)
 {
-    if (timer->m_interval == interval)
+    if (timer->m_interval == interval * 1000)
         return;
     ReadWriteLock::WriteLock lock(m_lock);
-    timer->m_interval = interval;
+    timer->m_interval = interval * 1000;
+    if (m_wheel)
+    {
+        if (timer->m_slot >= 0)
+            m_wheel->erase(timer.get());
+        insert_timer(timer);
+        return;
+    }
     if (m_timers.find(timer) == m_timers.end())
     {
         m_timers.insert(timer);
@@ -113,6 +378,15 @@ bool TimerManager::cancel_timer(Timer::ptr timer)
     ReadWriteLock::WriteLock lock(m_lock);
     if (!timer)
         return false;
+    if (m_wheel)
+    {
+        // 提前醒来只会多算一次超时，不需要唤醒
+        if (timer->m_slot < 0)
+            return false;
+        m_wheel->erase(timer.get());
+        timer->m_cb = nullptr;
+        return true;
+    }
     if (m_timers.find(timer) == m_timers.end())
     {
         return false;
@@ -130,6 +404,10 @@ bool TimerManager::cancel_timer(Timer::ptr timer)
 void TimerManager::cancel_all_timer()
 {
     ReadWriteLock::WriteLock lock(m_lock);
+    if (m_wheel)
+    {
+        m_wheel->clear();
+    }
     while (m_timers.begin() != m_timers.end())
     {
         (*m_timers.begin())->m_cb = nullptr;
@@ -140,44 +418,85 @@ void TimerManager::cancel_all_timer()
 
 time_t TimerManager::next_timer_left_time()
 {
+    time_t left_us = next_timer_left_us();
+    return left_us < 0 ? left_us : (left_us + 999) / 1000;
+}
+
+time_t TimerManager::next_timer_left_us()
+{
+    if (m_wheel)
+    {
+        ReadWriteLock::WriteLock lock(m_lock);
+        if (m_wheel->size() == 0)
+        {
+            m_wheel_wakeup = std::numeric_limits<time_t>::max();
+            return ~0;
+        }
+        m_wheel_wakeup = m_wheel->next_time();
+        time_t left_time = m_wheel_wakeup - (time_t)LoopMicrosecond();
+        return left_time < 0 ? 0 : left_time;
+    }
     ReadWriteLock::ReadLock lock(m_lock);
     if (m_timers.empty())
         return ~0;
-    auto n_ms = Millisecond();
-    if (n_ms >= (*m_timers.begin())->m_next_time)
+    time_t now = LoopMicrosecond();
+    if (now >= (*m_timers.begin())->m_next_time)
     {
         return 0;
     }
     else
     {
-        time_t left_time = (*m_timers.begin())->m_next_time - n_ms;
+        time_t left_time = (*m_timers.begin())->m_next_time - now;
         return left_time < 0 ? 0 : left_time;
     }
 }
 
 void TimerManager::all_expired_cbs(std::vector<std::function<void()>> &cbs)
 {
+    if (m_wheel)
+    {
+        ReadWriteLock::WriteLock lock(m_lock);
+        time_t now = LoopMicrosecond();
+        std::vector<Timer::ptr> expired_timers;
+        m_wheel->expire(now, expired_timers);
+        count_coalesced(expired_timers);
+        for (auto &timer : expired_timers)
+        {
+            cbs.push_back(timer->m_cb);
+            if (timer->m_loop)
+            {
+                timer->refresh(now);
+                m_wheel->insert(timer);
+            }
+            else
+            {
+                timer->m_cb = nullptr;
+            }
+        }
+        return;
+    }
     {
         ReadWriteLock::ReadLock lock(m_lock);
         if (m_timers.empty())
             return;
     }
     ReadWriteLock::WriteLock lock(m_lock);
-    auto n_ms = Millisecond();
+    time_t now = LoopMicrosecond();
     std::vector<TimerManager::Timer::ptr> expired_timers;
     for (auto &timer : m_timers)
     {
-        if (timer->m_next_time > n_ms)
+        if (timer->m_next_time > now)
             break;
         expired_timers.push_back(timer);
     }
+    count_coalesced(expired_timers);
     for (auto &timer : expired_timers)
     {
         m_timers.erase(timer);
         cbs.push_back(timer->m_cb);
         if (timer->m_loop)
         {
-            timer->m_next_time = timer->m_interval + n_ms;
+            timer->refresh(now);
             m_timers.insert(timer);
         }
         else
@@ -187,4 +506,42 @@ void TimerManager::all_expired_cbs(std::vector<std::function<void()>> &cbs)
     }
 }
 
+void TimerManager::count_coalesced(const std::vector<Timer::ptr> &timers)
+{
+    if (timers.size() < 2)
+        return;
+    bool aligned = false;
+    for (auto &timer : timers)
+    {
+        aligned = aligned || timer->m_due != timer->m_next_time;
+    }
+    if (!aligned)
+        return;
+    std::vector<time_t> dues;
+    dues.reserve(timers.size());
+    for (auto &timer : timers)
+    {
+        dues.push_back(timer->m_due);
+    }
+    std::sort(dues.begin(), dues.end());
+    m_coalesced_cnt += std::unique(dues.begin(), dues.end()) - dues.begin() - 1;
+}
+
+bool TimerManager::set_wheel(bool wheel)
+{
+    ReadWriteLock::WriteLock lock(m_lock);
+    if (wheel == (m_wheel != nullptr))
+        return true;
+    if (!m_timers.empty() || (m_wheel && m_wheel->size()))
+        return false;
+    m_wheel.reset(wheel ? new Wheel(LoopMicrosecond()) : nullptr);
+    return true;
+}
+
+size_t TimerManager::timer_cnt()
+{
+    ReadWriteLock::ReadLock lock(m_lock);
+    return m_wheel ? m_wheel->size() : m_timers.size();
+}
+
 } // namespace tiger
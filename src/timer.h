@@ -1,5 +1,6 @@
 /*****************************************************************
- * Description
+ * Description 定时器，内部使用单调时钟的微秒，add_timer等接口的间隔仍是毫秒，带_us后缀的是微秒
+ *  slack不为0的定时器到期时间向上对齐到不超过slack的2的幂，相近的定时器在同一次唤醒中处理
  * Email huxiaoheigame@gmail.com
  * Created on 2022/10/09
  * Copyright (c) 2021 虎小黑
@@ -8,7 +9,9 @@
 #ifndef __TIGER_TIMER_H__
 #define __TIGER_TIMER_H__
 
+#include <atomic>
 #include <functional>
+#include <limits>
 #include <map>
 #include <memory>
 #include <set>
@@ -27,17 +30,31 @@ class TimerManager
       private:
         friend TimerManager;
 
+      public:
+        typedef std::shared_ptr<Timer> ptr;
+
       private:
         size_t m_id;
+        // 微秒
         time_t m_interval;
         bool m_loop;
         time_t m_next_time;
+        // 允许推迟的微秒数，m_due是对齐前的到期时间
+        time_t m_slack;
+        time_t m_due;
         std::function<void()> m_cb;
+        // 时间轮的双向链表，在轮中时m_hold持有自身
+        Timer *m_prev = nullptr;
+        Timer *m_next = nullptr;
+        int m_slot = -1;
+        Timer::ptr m_hold;
 
       public:
-        typedef std::shared_ptr<Timer> ptr;
+        explicit Timer(time_t us, bool loop, std::function<void()> cb, time_t slack_us = 0);
 
-        explicit Timer(time_t ms, bool loop, std::function<void()> cb);
+      private:
+        // 从now开始计算下一次到期时间
+        void refresh(time_t now);
 
       public:
         struct Comparator
@@ -46,9 +63,61 @@ class TimerManager
         };
     };
 
+  private:
+    // 分层时间轮，第0层256个1us的槽，之后每层64个槽，覆盖约76小时，更远的定时器放在最后一层的槽里反复降级
+    class Wheel
+    {
+      public:
+        static const int SLOT0_BITS = 8;
+        static const int SLOT_BITS = 6;
+        static const int LEVEL_CNT = 6;
+        static const int SLOT_CNT = (1 << SLOT0_BITS) + (LEVEL_CNT - 1) * (1 << SLOT_BITS);
+
+      private:
+        // 下一个要处理的微秒，之前的都已经到期
+        time_t m_time;
+        size_t m_size = 0;
+        Timer *m_slots[SLOT_CNT] = {nullptr};
+        // 非空的槽，第0层4个字，其余每层1个字
+        uint64_t m_bits[SLOT_CNT / 64] = {0};
+
+      private:
+        int slot_of(time_t expire) const;
+        void link(Timer *timer, int slot);
+        void cascade(int level);
+        void take_slot(int slot, std::vector<Timer::ptr> &timers);
+        // 从slot开始(含)找第一个非空的槽，没有时返回-1
+        int first_slot(int level, int from) const;
+
+      public:
+        explicit Wheel(time_t now);
+
+        size_t size() const
+        {
+            return m_size;
+        }
+        void insert(Timer::ptr timer);
+        void erase(Timer *timer);
+        // 最早到期时间的下界，为空时返回~0
+        time_t next_time() const;
+        // 处理到now为止的所有微秒，按到期顺序取出定时器，空槽和不需要降级的边界直接跳过
+        void expire(time_t now, std::vector<Timer::ptr> &timers);
+        void clear();
+    };
+
   private:
     std::set<Timer::ptr, Timer::Comparator> m_timers;
+    // 不为空时使用时间轮代替m_timers
+    std::unique_ptr<Wheel> m_wheel;
+    // 空闲线程睡到这个时间，新定时器更早到期时才需要唤醒
+    time_t m_wheel_wakeup = std::numeric_limits<time_t>::max();
     ReadWriteLock m_lock;
+    std::atomic<uint64_t> m_coalesced_cnt{0};
+
+  private:
+    void insert_timer(Timer::ptr timer);
+    // 一批到期的定时器中有被对齐的，原本各不相同的到期时间合并成了一次唤醒
+    void count_coalesced(const std::vector<Timer::ptr> &timers);
 
   protected:
     virtual void on_timer_refresh() = 0;
@@ -60,18 +129,35 @@ class TimerManager
     virtual ~TimerManager();
 
   public:
-    Timer::ptr add_timer(time_t interval, std::function<void()> cb, bool loop = false);
+    // slack为允许推迟的毫秒数
+    Timer::ptr add_timer(time_t interval, std::function<void()> cb, bool loop = false, time_t slack = 0);
     Timer::ptr add_timer(time_t interval, std::function<void()> *cb, bool loop = false);
     Timer::ptr add_cond_timer(time_t interval, std::function<void()> cb, std::weak_ptr<void> cond, bool loop = false);
     Timer::ptr add_cond_timer(time_t interval, std::function<void()> *cb, std::weak_ptr<void> cond, bool loop = false);
+    Timer::ptr add_timer_us(time_t interval_us, std::function<void()> cb, bool loop = false, time_t slack_us = 0);
 
     bool is_valid_timer(Timer::ptr timer);
     void reset_timer(Timer::ptr timer, time_t interval);
     bool cancel_timer(Timer::ptr timer);
     void cancel_all_timer();
 
+    // 距最早的定时器的毫秒数(向上取整)，没有定时器时返回~0
     time_t next_timer_left_time();
+    time_t next_timer_left_us();
     void all_expired_cbs(std::vector<std::function<void()>> &cbs);
+
+    // 切换到时间轮(插入和取消O(1)，到期的定时器整槽取出)，只能在没有定时器时切换
+    bool set_wheel(bool wheel);
+    bool is_wheel() const
+    {
+        return m_wheel != nullptr;
+    }
+    size_t timer_cnt();
+    // 合并到期节省的唤醒次数
+    uint64_t coalesced_cnt() const
+    {
+        return m_coalesced_cnt;
+    }
 };
 
 } // namespace tiger
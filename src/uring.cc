@@ -0,0 +1,205 @@
+/*****************************************************************
+ * Description
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/22
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#include "uring.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "macro.h"
+
+namespace tiger
+{
+
+IoUring::~IoUring()
+{
+    if (m_bufs)
+        free(m_bufs);
+    if (m_sqes)
+        munmap(m_sqes, m_sqes_size);
+    if (m_cq_ptr && m_cq_ptr != m_sq_ptr)
+        munmap(m_cq_ptr, m_cq_size);
+    if (m_sq_ptr)
+        munmap(m_sq_ptr, m_sq_size);
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+bool IoUring::init(unsigned entries)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    // 内核只在本线程进入io_uring_enter时处理完成任务，避免打断正在运行的协程
+    params.flags = IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SUBMIT_ALL;
+    m_fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (m_fd < 0 && errno == EINVAL)
+    {
+        memset(&params, 0, sizeof(params));
+        m_fd = syscall(__NR_io_uring_setup, entries, &params);
+    }
+    if (m_fd < 0)
+    {
+        TIGER_LOG_W(SYSTEM_LOG) << "[io_uring_setup fail errno:" << strerror(errno) << "]";
+        return false;
+    }
+    m_features = params.features;
+    // 等待超时依赖IORING_ENTER_EXT_ARG(5.11)
+    if (!(m_features & IORING_FEAT_EXT_ARG))
+    {
+        TIGER_LOG_W(SYSTEM_LOG) << "[io_uring without ext arg features:" << m_features << "]";
+        return false;
+    }
+    m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (m_features & IORING_FEAT_SINGLE_MMAP)
+    {
+        m_sq_size = m_cq_size = std::max(m_sq_size, m_cq_size);
+    }
+    m_sq_ptr = mmap(nullptr, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    if (m_sq_ptr == MAP_FAILED)
+    {
+        m_sq_ptr = nullptr;
+        return false;
+    }
+    if (m_features & IORING_FEAT_SINGLE_MMAP)
+    {
+        m_cq_ptr = m_sq_ptr;
+    }
+    else
+    {
+        m_cq_ptr =
+            mmap(nullptr, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+        if (m_cq_ptr == MAP_FAILED)
+        {
+            m_cq_ptr = nullptr;
+            return false;
+        }
+    }
+    m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = (io_uring_sqe *)mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+                                  IORING_OFF_SQES);
+    if (m_sqes == MAP_FAILED)
+    {
+        m_sqes = nullptr;
+        return false;
+    }
+    char *sq = (char *)m_sq_ptr;
+    m_sq_head = (unsigned *)(sq + params.sq_off.head);
+    m_sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    m_sq_array = (unsigned *)(sq + params.sq_off.array);
+    m_sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    m_sq_entries = params.sq_entries;
+    char *cq = (char *)m_cq_ptr;
+    m_cq_head = (unsigned *)(cq + params.cq_off.head);
+    m_cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    m_cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    m_cqes = (io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    static const unsigned PROBE_OP_CNT = 256;
+    std::vector<char> probe_buf(sizeof(io_uring_probe) + PROBE_OP_CNT * sizeof(io_uring_probe_op), 0);
+    io_uring_probe *probe = (io_uring_probe *)probe_buf.data();
+    if (syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PROBE, probe, PROBE_OP_CNT) == 0)
+    {
+        m_ops.resize(probe->ops_len, false);
+        for (unsigned i = 0; i < probe->ops_len; ++i)
+        {
+            m_ops[i] = probe->ops[i].flags & IO_URING_OP_SUPPORTED;
+        }
+    }
+    return true;
+}
+
+int IoUring::enter(unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t arg_size)
+{
+    ++m_enter_cnt;
+    int rt = syscall(__NR_io_uring_enter, m_fd, to_submit, min_complete, flags, arg, arg_size);
+    if (rt < 0 && errno != EINTR && errno != ETIME && errno != EBUSY && errno != EAGAIN)
+    {
+        TIGER_LOG_E(SYSTEM_LOG) << "[io_uring_enter fail"
+                                << " to_submit:" << to_submit << " errno:" << strerror(errno) << "]";
+    }
+    return rt;
+}
+
+unsigned IoUring::sq_ready() const
+{
+    return __atomic_load_n(m_sq_tail, __ATOMIC_ACQUIRE) - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+}
+
+void IoUring::submit()
+{
+    unsigned ready = sq_ready();
+    if (ready > 0)
+    {
+        enter(ready, 0, 0, nullptr, 0);
+    }
+}
+
+void IoUring::wait(time_t us)
+{
+    unsigned ready = sq_ready();
+    if (cq_ready() > 0)
+    {
+        if (ready > 0)
+            enter(ready, 0, 0, nullptr, 0);
+        return;
+    }
+    __kernel_timespec ts;
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000;
+    io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = us < 0 ? 0 : (uint64_t)&ts;
+    enter(ready, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+unsigned IoUring::cq_ready() const
+{
+    return __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE) - *m_cq_head;
+}
+
+bool IoUring::setup_buffers(unsigned cnt, unsigned size)
+{
+    if (cnt == 0 || cnt > 65536 || size == 0 || !supports(IORING_OP_PROVIDE_BUFFERS))
+        return false;
+    m_bufs = (char *)malloc((size_t)cnt * size);
+    m_buf_cnt = cnt;
+    m_buf_size = size;
+    // 一次交出全部缓冲区，同步等待结果；此时ring上没有其他请求
+    push(1, [this](io_uring_sqe **sqes) {
+        provide_buffer(sqes[0], 0);
+        sqes[0]->fd = m_buf_cnt;
+    });
+    enter(1, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+    int rt = -EAGAIN;
+    reap([&rt](uint64_t, int res, uint32_t) { rt = res; });
+    if (rt < 0)
+    {
+        TIGER_LOG_W(SYSTEM_LOG) << "[io_uring provide buffers fail errno:" << strerror(-rt) << "]";
+        free(m_bufs);
+        m_bufs = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void IoUring::provide_buffer(io_uring_sqe *sqe, uint16_t bid) const
+{
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = 1;
+    sqe->addr = (uint64_t)buffer(bid);
+    sqe->len = m_buf_size;
+    sqe->off = bid;
+    sqe->buf_group = BUFFER_GROUP;
+}
+
+} // namespace tiger
@@ -0,0 +1,147 @@
+/*****************************************************************
+ * Description io_uring的简单封装，直接使用系统调用，不依赖liburing
+ *  提交队列可以多线程写入，完成队列只由创建它的reactor线程读取
+ *  支持一组provided buffers，供多次触发的recv选择缓冲区
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/22
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#ifndef __TIGER_URING_H__
+#define __TIGER_URING_H__
+
+#include <linux/io_uring.h>
+#include <string.h>
+
+#include <atomic>
+#include <vector>
+
+#include "mutex.h"
+
+namespace tiger
+{
+
+class IoUring
+{
+  public:
+    // 供多次触发的recv使用的缓冲区组
+    static const uint16_t BUFFER_GROUP = 0;
+
+  private:
+    int m_fd = -1;
+    unsigned m_features = 0;
+    void *m_sq_ptr = nullptr;
+    size_t m_sq_size = 0;
+    void *m_cq_ptr = nullptr;
+    size_t m_cq_size = 0;
+    io_uring_sqe *m_sqes = nullptr;
+    size_t m_sqes_size = 0;
+    unsigned *m_sq_head = nullptr;
+    unsigned *m_sq_tail = nullptr;
+    unsigned *m_sq_array = nullptr;
+    unsigned m_sq_mask = 0;
+    unsigned m_sq_entries = 0;
+    unsigned *m_cq_head = nullptr;
+    unsigned *m_cq_tail = nullptr;
+    unsigned m_cq_mask = 0;
+    io_uring_cqe *m_cqes = nullptr;
+    std::vector<bool> m_ops;
+    // 写提交队列的锁，reactor线程之外只有取消操作会提交
+    SpinLock m_sq_lock;
+    // provided buffers
+    char *m_bufs = nullptr;
+    unsigned m_buf_cnt = 0;
+    unsigned m_buf_size = 0;
+    std::atomic<uint64_t> m_enter_cnt{0};
+
+  private:
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t arg_size);
+    unsigned sq_ready() const;
+
+  public:
+    IoUring() = default;
+    ~IoUring();
+    IoUring(const IoUring &) = delete;
+    IoUring &operator=(const IoUring &) = delete;
+
+    // 内核不支持或被禁用时返回false，调用方退回epoll
+    bool init(unsigned entries);
+    bool supports(uint8_t op) const
+    {
+        return op < m_ops.size() && m_ops[op];
+    }
+    // io_uring_enter的调用次数
+    uint64_t enter_cnt() const
+    {
+        return m_enter_cnt;
+    }
+
+    // 在锁内填写cnt个连续的sqe(链接的请求必须连续)，只放入队列，由submit或wait统一提交
+    template <typename Fn> void push(unsigned cnt, Fn fill)
+    {
+        SpinLock::Lock lock(m_sq_lock);
+        if (sq_ready() + cnt > m_sq_entries)
+        {
+            // 队列满时先提交已有的
+            enter(sq_ready(), 0, 0, nullptr, 0);
+        }
+        // sq_array与sqes一一对应，提交顺序即填写顺序
+        io_uring_sqe *sqes[2];
+        unsigned tail = *m_sq_tail;
+        for (unsigned i = 0; i < cnt; ++i)
+        {
+            unsigned idx = (tail + i) & m_sq_mask;
+            m_sq_array[idx] = idx;
+            sqes[i] = &m_sqes[idx];
+            memset(sqes[i], 0, sizeof(io_uring_sqe));
+        }
+        fill(sqes);
+        __atomic_store_n(m_sq_tail, tail + cnt, __ATOMIC_RELEASE);
+    }
+    // 提交队列中的请求，没有请求时不进入内核
+    void submit();
+    // 提交并等待至少一个完成事件，us<0表示一直等待，已有完成事件时不等待
+    void wait(time_t us);
+    // 已完成未处理的事件数
+    unsigned cq_ready() const;
+    // 依次处理完成事件，fn(user_data, res, flags)，返回处理的个数
+    template <typename Fn> unsigned reap(Fn fn)
+    {
+        unsigned cnt = 0;
+        unsigned head = *m_cq_head;
+        unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail)
+        {
+            io_uring_cqe &cqe = m_cqes[head & m_cq_mask];
+            uint64_t user_data = cqe.user_data;
+            int res = cqe.res;
+            uint32_t flags = cqe.flags;
+            // 先归还槽位，回调中提交的请求产生的事件不会因为完成队列满而积压
+            __atomic_store_n(m_cq_head, ++head, __ATOMIC_RELEASE);
+            fn(user_data, res, flags);
+            ++cnt;
+            if (head == tail)
+            {
+                tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+            }
+        }
+        return cnt;
+    }
+
+    // 在reactor开始运行前把cnt个size字节的缓冲区交给内核，失败时不能使用多次触发的recv
+    bool setup_buffers(unsigned cnt, unsigned size);
+    bool has_buffers() const
+    {
+        return m_bufs != nullptr;
+    }
+    char *buffer(uint16_t bid) const
+    {
+        return m_bufs + (size_t)bid * m_buf_size;
+    }
+    // 数据读完后用sqe把缓冲区还给内核，user_data由调用方填写
+    void provide_buffer(io_uring_sqe *sqe, uint16_t bid) const;
+};
+
+} // namespace tiger
+
+#endif
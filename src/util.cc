@@ -9,12 +9,14 @@
 
 #include <execinfo.h>
 #include <stdarg.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 
@@ -36,6 +38,30 @@ time_t Millisecond()
     return tp.time_since_epoch().count();
 }
 
+uint64_t MonotonicMicrosecond()
+{
+    auto tp = std::chrono::time_point_cast<std::chrono::microseconds>(std::chrono::steady_clock::now());
+    return tp.time_since_epoch().count();
+}
+
+static thread_local uint64_t t_loop_clock = 0;
+
+uint64_t LoopClockUpdate()
+{
+    t_loop_clock = MonotonicMicrosecond();
+    return t_loop_clock;
+}
+
+void LoopClockClear()
+{
+    t_loop_clock = 0;
+}
+
+uint64_t LoopMicrosecond()
+{
+    return t_loop_clock ? t_loop_clock : MonotonicMicrosecond();
+}
+
 time_t Second()
 {
     auto tp = std::chrono::time_point_cast<std::chrono::seconds>(std::chrono::system_clock::now());
@@ -51,6 +77,44 @@ std::string Time2Str(time_t ts, const std::string &format)
     return buf;
 }
 
+void Backtrace(std::vector<std::string> &bt, int size, int skip)
+{
+    void **frames = (void **)malloc(sizeof(void *) * size);
+    int cnt = ::backtrace(frames, size);
+    if (cnt > skip)
+    {
+        BacktraceSymbols(frames + skip, cnt - skip, bt);
+    }
+    free(frames);
+}
+
+std::string BacktraceToString(int size, int skip, const std::string &prefix)
+{
+    std::vector<std::string> bt;
+    Backtrace(bt, size, skip);
+    std::stringstream ss;
+    for (auto &frame : bt)
+    {
+        ss << prefix << frame << std::endl;
+    }
+    return ss.str();
+}
+
+void BacktraceSymbols(void *const *frames, int cnt, std::vector<std::string> &bt)
+{
+    char **symbols = ::backtrace_symbols(frames, cnt);
+    if (!symbols)
+    {
+        TIGER_LOG_E(SYSTEM_LOG) << "[backtrace_symbols fail]";
+        return;
+    }
+    for (int i = 0; i < cnt; ++i)
+    {
+        bt.push_back(symbols[i]);
+    }
+    free(symbols);
+}
+
 std::string StringUtils::Random(size_t len, const std::string chars)
 {
     if (len == 0 || chars.empty())
@@ -517,6 +581,62 @@ static int __lstat(const char *file, struct stat *st = nullptr)
     return rst;
 }
 
+LatencyHistogram::LatencyHistogram()
+{
+    for (size_t i = 0; i < BUCKET_CNT; ++i)
+    {
+        m_buckets[i] = 0;
+    }
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const
+{
+    Snapshot snap;
+    for (size_t i = 0; i < BUCKET_CNT; ++i)
+    {
+        snap.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+    }
+    snap.count = m_count.load(std::memory_order_relaxed);
+    snap.total = m_total.load(std::memory_order_relaxed);
+    snap.max = m_max.load(std::memory_order_relaxed);
+    return snap;
+}
+
+uint64_t LatencyHistogram::Snapshot::percentile(double p) const
+{
+    uint64_t cnt = 0;
+    for (size_t i = 0; i < BUCKET_CNT; ++i)
+    {
+        cnt += buckets[i];
+    }
+    if (cnt == 0)
+        return 0;
+    uint64_t target = static_cast<uint64_t>(p * cnt);
+    target = std::max<uint64_t>(std::min(target, cnt), 1);
+    uint64_t acc = 0;
+    for (size_t i = 0; i < BUCKET_CNT; ++i)
+    {
+        acc += buckets[i];
+        if (acc >= target)
+        {
+            uint64_t upper = i == 0 ? 0 : (i < BUCKET_CNT - 1 ? (1ULL << i) - 1 : max);
+            return std::min(upper, max);
+        }
+    }
+    return max;
+}
+
+void LatencyHistogram::Snapshot::merge(const Snapshot &other)
+{
+    for (size_t i = 0; i < BUCKET_CNT; ++i)
+    {
+        buckets[i] += other.buckets[i];
+    }
+    count += other.count;
+    total += other.total;
+    max = std::max(max, other.max);
+}
+
 bool FSUtils::Unlink(const std::string &filename, bool exist)
 {
     if (!exist && __lstat(filename.c_str()))
@@ -8,9 +8,13 @@
 #ifndef __TIGER_UTIL_H__
 #define __TIGER_UTIL_H__
 
+#include <stdint.h>
+
+#include <atomic>
 #include <chrono>
 #include <iostream>
 #include <string>
+#include <vector>
 
 namespace tiger
 {
@@ -19,8 +23,20 @@ bool IsValidName(const std::string &name);
 
 time_t Millisecond();
 time_t Second();
+// 单调时钟，只用于计算时间间隔
+uint64_t MonotonicMicrosecond();
+// 事件循环每轮只读一次时钟：LoopClockUpdate刷新本线程的缓存，LoopClockClear之后LoopMicrosecond直接读时钟
+uint64_t LoopClockUpdate();
+void LoopClockClear();
+uint64_t LoopMicrosecond();
 std::string Time2Str(time_t ts, const std::string &format);
 
+// 当前线程的调用栈，skip为跳过的最内层帧数
+void Backtrace(std::vector<std::string> &bt, int size = 64, int skip = 1);
+std::string BacktraceToString(int size = 64, int skip = 2, const std::string &prefix = "");
+// 把backtrace()得到的地址转成符号，可以在采集之外的线程上调用
+void BacktraceSymbols(void *const *frames, int cnt, std::vector<std::string> &bt);
+
 class StringUtils
 {
   public:
@@ -41,6 +57,59 @@ class StringUtils
     static std::wstring StringToWString(const std::string &s);
 };
 
+// 单写者计数，读写分开不需要总线锁，其他线程可以随时读取
+inline void RelaxedAdd(std::atomic<uint64_t> &counter, uint64_t n = 1)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// 按2的幂分桶的直方图，第i个桶记录[2^(i-1), 2^i)，只允许一个线程写入
+class LatencyHistogram
+{
+  public:
+    static const size_t BUCKET_CNT = 64;
+
+    struct Snapshot
+    {
+        uint64_t count = 0;
+        uint64_t total = 0;
+        uint64_t max = 0;
+        uint64_t buckets[BUCKET_CNT] = {};
+
+        uint64_t avg() const
+        {
+            return count > 0 ? total / count : 0;
+        }
+        // p取值(0, 1]，返回该分位所在桶的上界，不超过最大值
+        uint64_t percentile(double p) const;
+        void merge(const Snapshot &other);
+    };
+
+  private:
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<uint64_t> m_total{0};
+    std::atomic<uint64_t> m_max{0};
+    std::atomic<uint64_t> m_buckets[BUCKET_CNT];
+
+  public:
+    LatencyHistogram();
+
+    void add(uint64_t v)
+    {
+        size_t idx = v == 0 ? 0 : 64 - __builtin_clzll(v);
+        RelaxedAdd(m_buckets[idx < BUCKET_CNT ? idx : BUCKET_CNT - 1]);
+        RelaxedAdd(m_count);
+        RelaxedAdd(m_total, v);
+        if (v > m_max.load(std::memory_order_relaxed))
+        {
+            m_max.store(v, std::memory_order_relaxed);
+        }
+    }
+
+    // 读取过程中仍可能有写入，各字段之间不保证严格一致
+    Snapshot snapshot() const;
+};
+
 class FSUtils
 {
   public:
@@ -0,0 +1,103 @@
+/*****************************************************************
+ * Description
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/20
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#include "watchdog.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include "macro.h"
+
+namespace tiger
+{
+
+static const uint64_t WATCHDOG_MAX_INTERVAL_US = 100 * 1000;
+static const uint64_t WATCHDOG_MIN_INTERVAL_US = 1000;
+
+Watchdog::~Watchdog()
+{
+    m_stopping = true;
+    if (m_thread)
+    {
+        m_thread->join();
+    }
+}
+
+void Watchdog::add(Scheduler *scheduler)
+{
+    MutexLock::Lock lock(m_mutex);
+    m_schedulers.insert(scheduler);
+    if (!m_thread)
+    {
+        m_thread = std::make_shared<Thread>(std::bind(&Watchdog::run, this), "WATCHDOG");
+    }
+}
+
+void Watchdog::del(Scheduler *scheduler)
+{
+    MutexLock::Lock lock(m_mutex);
+    m_schedulers.erase(scheduler);
+}
+
+void Watchdog::set_callback(Callback cb)
+{
+    MutexLock::Lock lock(m_mutex);
+    m_callback = cb;
+}
+
+void Watchdog::run()
+{
+    while (!m_stopping)
+    {
+        uint64_t interval = WATCHDOG_MAX_INTERVAL_US;
+        std::vector<Scheduler::StallReport> reports;
+        Callback cb;
+        {
+            // 持锁检查，注销调度器时等待本轮检查结束
+            MutexLock::Lock lock(m_mutex);
+            for (auto scheduler : m_schedulers)
+            {
+                // 检查间隔取阈值的1/4，超时后最多再过1/4才被发现
+                interval = std::min(interval, std::max(scheduler->watchdog_us() / 4, WATCHDOG_MIN_INTERVAL_US));
+                auto stalls = scheduler->check_stalls();
+                reports.insert(reports.end(), stalls.begin(), stalls.end());
+            }
+            cb = m_callback;
+        }
+        for (auto &report : reports)
+        {
+            ++m_stall_cnt;
+            if (cb)
+            {
+                cb(report);
+            }
+            else
+            {
+                Log(report);
+            }
+        }
+        usleep(interval);
+    }
+}
+
+void Watchdog::Log(const Scheduler::StallReport &report)
+{
+    std::stringstream ss;
+    for (auto &frame : report.backtrace)
+    {
+        ss << "\n\t" << frame;
+    }
+    TIGER_LOG_W(SYSTEM_LOG) << "[coroutine stall"
+                            << " scheduler:" << report.scheduler << " worker:" << report.worker_idx
+                            << " thread:" << report.thread_id << " co:" << report.co_id << " name:" << report.co_name
+                            << " running:" << report.running_us / 1000 << "ms migrated:" << report.migrated << "]"
+                            << ss.str();
+}
+
+} // namespace tiger
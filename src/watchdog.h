@@ -0,0 +1,63 @@
+/*****************************************************************
+ * Description 协程看门狗
+ *  独立线程定期检查开启了看门狗(tiger.scheduler.watchdogMs)的调度器
+ *  协程长时间不让出时报告协程id、名字和调用栈，可选把该线程积压的任务迁移到其他线程
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/20
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#ifndef __TIGER_WATCHDOG_H__
+#define __TIGER_WATCHDOG_H__
+
+#include <atomic>
+#include <functional>
+#include <set>
+
+#include "mutex.h"
+#include "scheduler.h"
+#include "singleton.h"
+#include "thread.h"
+
+namespace tiger
+{
+
+class Watchdog
+{
+  public:
+    typedef std::function<void(const Scheduler::StallReport &)> Callback;
+
+  private:
+    MutexLock m_mutex;
+    std::set<Scheduler *> m_schedulers;
+    Thread::ptr m_thread;
+    std::atomic<bool> m_stopping{false};
+    Callback m_callback;
+    std::atomic<uint64_t> m_stall_cnt{0};
+
+  private:
+    void run();
+
+  public:
+    ~Watchdog();
+
+    // 调度器启动时注册，停止或析构时注销，注销返回后看门狗不会再访问该调度器
+    void add(Scheduler *scheduler);
+    void del(Scheduler *scheduler);
+
+    // 默认写系统日志，回调在看门狗线程上执行
+    void set_callback(Callback cb);
+    uint64_t stall_cnt() const
+    {
+        return m_stall_cnt;
+    }
+
+  public:
+    static void Log(const Scheduler::StallReport &report);
+};
+
+typedef Singleton<Watchdog> SingletonWatchdog;
+
+} // namespace tiger
+
+#endif
@@ -0,0 +1,120 @@
+/*****************************************************************
+ * Description 有界无锁工作窃取队列(Chase-Lev)
+ *  owner线程在bottom端push/pop，其他线程在top端steal
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/02
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#ifndef __TIGER_WORK_STEALING_QUEUE_H__
+#define __TIGER_WORK_STEALING_QUEUE_H__
+
+#include <stdint.h>
+
+#include <atomic>
+
+namespace tiger
+{
+
+template <typename T> class WorkStealingQueue
+{
+  private:
+    std::atomic<int64_t> m_top{0};
+    std::atomic<int64_t> m_bottom{0};
+    int64_t m_mask;
+    std::atomic<T> *m_buffer;
+
+  public:
+    explicit WorkStealingQueue(size_t capacity = 1024)
+    {
+        size_t size = 2;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        m_mask = size - 1;
+        m_buffer = new std::atomic<T>[size];
+    }
+
+    ~WorkStealingQueue()
+    {
+        delete[] m_buffer;
+    }
+
+    size_t capacity() const
+    {
+        return m_mask + 1;
+    }
+
+    size_t size() const
+    {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+        return b > t ? b - t : 0;
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+  public:
+    // 仅owner线程调用，队列满时返回false
+    bool push(T v)
+    {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_acquire);
+        if (b - t > m_mask)
+            return false;
+        m_buffer[b & m_mask].store(v, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // 仅owner线程调用(LIFO)
+    bool pop(T &v)
+    {
+        int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+        m_bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+        if (t > b)
+        {
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        v = m_buffer[b & m_mask].load(std::memory_order_relaxed);
+        if (t == b)
+        {
+            bool won = m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // 任意线程调用(FIFO)
+    bool steal(T &v)
+    {
+        int64_t t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = m_bottom.load(std::memory_order_acquire);
+        if (t >= b)
+            return false;
+        T x = m_buffer[t & m_mask].load(std::memory_order_relaxed);
+        if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return false;
+        v = x;
+        return true;
+    }
+
+  private:
+    WorkStealingQueue(const WorkStealingQueue &) = delete;
+    WorkStealingQueue(const WorkStealingQueue &&) = delete;
+    WorkStealingQueue &operator=(const WorkStealingQueue &) = delete;
+};
+
+} // namespace tiger
+
+#endif
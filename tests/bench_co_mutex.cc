@@ -0,0 +1,113 @@
+/*****************************************************************
+ * Description 锁竞争测试(协程锁 vs 线程锁)
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/10
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#include <stdlib.h>
+
+#include "../src/co_mutex.h"
+#include "../src/macro.h"
+#include "../src/scheduler.h"
+#include "../src/util.h"
+
+// 临界区内的少量计算
+static void CriticalWork(size_t &counter)
+{
+    for (size_t i = 0; i < 64; ++i)
+    {
+        counter += i;
+    }
+}
+
+template <typename MutexType, typename LockType>
+void bench_mutex(const std::string &name, size_t thread_cnt, size_t co_cnt, size_t loop_cnt)
+{
+    MutexType mutex;
+    size_t counter = 0;
+    std::atomic<size_t> done{0};
+    auto scheduler = std::make_shared<tiger::Scheduler>("BENCH", true, thread_cnt);
+    for (size_t i = 0; i < co_cnt; ++i)
+    {
+        scheduler->schedule([&]() {
+            for (size_t j = 0; j < loop_cnt; ++j)
+            {
+                LockType lock(mutex);
+                CriticalWork(counter);
+            }
+            if (++done == co_cnt)
+            {
+                scheduler->stop();
+            }
+        });
+    }
+    time_t start = tiger::Millisecond();
+    scheduler->start();
+    time_t cost = tiger::Millisecond() - start;
+    size_t total = co_cnt * loop_cnt;
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench_co_mutex lock:" << name << " threads:" << thread_cnt
+                                 << " coroutines:" << co_cnt << " ops:" << total << " cost:" << cost << "ms"
+                                 << " throughput:" << (cost > 0 ? total * 1000 / cost : total) << "/s]";
+}
+
+template <typename RWLockType, typename ReadLockType, typename WriteLockType>
+void bench_rwlock(const std::string &name, size_t thread_cnt, size_t co_cnt, size_t loop_cnt)
+{
+    RWLockType rwlock;
+    size_t counter = 0;
+    std::atomic<size_t> done{0};
+    auto scheduler = std::make_shared<tiger::Scheduler>("BENCH", true, thread_cnt);
+    for (size_t i = 0; i < co_cnt; ++i)
+    {
+        scheduler->schedule([&]() {
+            size_t local = 0;
+            for (size_t j = 0; j < loop_cnt; ++j)
+            {
+                // 读写比例9:1
+                if (j % 10 == 0)
+                {
+                    WriteLockType lock(rwlock);
+                    CriticalWork(counter);
+                }
+                else
+                {
+                    ReadLockType lock(rwlock);
+                    local += counter;
+                }
+            }
+            if (++done == co_cnt)
+            {
+                scheduler->stop();
+            }
+        });
+    }
+    time_t start = tiger::Millisecond();
+    scheduler->start();
+    time_t cost = tiger::Millisecond() - start;
+    size_t total = co_cnt * loop_cnt;
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench_co_rwlock lock:" << name << " threads:" << thread_cnt
+                                 << " coroutines:" << co_cnt << " ops:" << total << " cost:" << cost << "ms"
+                                 << " throughput:" << (cost > 0 ? total * 1000 / cost : total) << "/s]";
+}
+
+int main(int argc, char **argv)
+{
+    tiger::SingletonLoggerMgr::Instance()->add_loggers("tiger", "../conf/tiger.yml");
+    tiger::Thread::SetName("BENCH_CO_MUTEX");
+    size_t loop_cnt = argc > 1 ? atoi(argv[1]) : 10000;
+    size_t threads[] = {1, 4, 16};
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench co mutex start]";
+    for (auto thread_cnt : threads)
+    {
+        size_t co_cnt = thread_cnt * 4;
+        bench_mutex<tiger::MutexLock, tiger::MutexLock::Lock>("pthread_mutex", thread_cnt, co_cnt, loop_cnt);
+        bench_mutex<tiger::CoMutex, tiger::CoMutex::Lock>("co_mutex", thread_cnt, co_cnt, loop_cnt);
+        bench_rwlock<tiger::ReadWriteLock, tiger::ReadWriteLock::ReadLock, tiger::ReadWriteLock::WriteLock>(
+            "pthread_rwlock", thread_cnt, co_cnt, loop_cnt);
+        bench_rwlock<tiger::CoRWLock, tiger::CoRWLock::ReadLock, tiger::CoRWLock::WriteLock>("co_rwlock", thread_cnt,
+                                                                                            co_cnt, loop_cnt);
+    }
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench co mutex end]";
+    return 0;
+}
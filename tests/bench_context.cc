@@ -0,0 +1,89 @@
+/*****************************************************************
+ * Description 上下文切换耗时测试(ucontext vs 汇编)
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/06
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/context.h"
+#include "../src/coroutine.h"
+#include "../src/macro.h"
+
+static const size_t STACK_SIZE = 128 * 1024;
+
+static uint64_t NowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+template <typename T> struct ContextPair
+{
+    static T s_main;
+    static T s_co;
+
+    static void Run()
+    {
+        while (true)
+        {
+            s_co.swap(s_main);
+        }
+    }
+
+    static double Bench(size_t cnt)
+    {
+        void *stack = malloc(STACK_SIZE);
+        s_main.init();
+        s_co.make(stack, STACK_SIZE, &Run);
+        s_main.swap(s_co);
+        uint64_t start = NowNs();
+        for (size_t i = 0; i < cnt; ++i)
+        {
+            s_main.swap(s_co);
+        }
+        uint64_t cost = NowNs() - start;
+        free(stack);
+        return (double)cost / cnt;
+    }
+};
+
+template <typename T> T ContextPair<T>::s_main;
+template <typename T> T ContextPair<T>::s_co;
+
+double bench_coroutine(size_t cnt)
+{
+    tiger::Coroutine::ptr co = std::make_shared<tiger::Coroutine>([]() {
+        while (true)
+        {
+            tiger::Coroutine::Yield();
+        }
+    });
+    co->resume();
+    uint64_t start = NowNs();
+    for (size_t i = 0; i < cnt; ++i)
+    {
+        co->resume();
+    }
+    return (double)(NowNs() - start) / cnt;
+}
+
+int main(int argc, char **argv)
+{
+    tiger::SingletonLoggerMgr::Instance()->add_loggers("tiger", "../conf/tiger.yml");
+    size_t cnt = argc > 1 ? atoi(argv[1]) : 1000000;
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench context start]";
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench_context backend:ucontext switches:" << cnt
+                                 << " resume_yield:" << ContextPair<tiger::UContext>::Bench(cnt) << "ns]";
+#ifdef TIGER_HAS_ASM_CONTEXT
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench_context backend:asm switches:" << cnt
+                                 << " resume_yield:" << ContextPair<tiger::AsmContext>::Bench(cnt) << "ns]";
+#endif
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench_context coroutine backend:" << tiger::ContextBackend()
+                                 << " switches:" << cnt << " resume_yield:" << bench_coroutine(cnt) << "ns]";
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench context end]";
+    return 0;
+}
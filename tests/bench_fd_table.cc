@@ -0,0 +1,114 @@
+/*****************************************************************
+ * Description fd事件表测试，多线程下add/del、add/cancel、add/trigger的速率
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/23
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "../src/iomanager.h"
+#include "../src/macro.h"
+#include "../src/util.h"
+
+enum class Op
+{
+    DEL,
+    CANCEL,
+    TRIGGER
+};
+
+static const char *OpName(Op op)
+{
+    switch (op)
+    {
+    case Op::DEL:
+        return "add_del";
+    case Op::CANCEL:
+        return "add_cancel";
+    default:
+        return "add_trigger";
+    }
+}
+
+// 每个协程轮流使用fd_cnt个eventfd，fd号分散在多个段上
+void bench_fd_table(Op op, size_t thread_cnt, size_t co_cnt, size_t fd_cnt, size_t loop_cnt)
+{
+    auto iom = std::make_shared<tiger::IOManager>("BENCH", false, thread_cnt);
+    iom->start();
+    std::atomic<size_t> done{0};
+    std::atomic<size_t> callbacks{0};
+    std::atomic<size_t> fails{0};
+    uint64_t start = tiger::MonotonicMicrosecond();
+    for (size_t i = 0; i < co_cnt; ++i)
+    {
+        iom->schedule([&]() {
+            std::vector<int> fds;
+            for (size_t j = 0; j < fd_cnt; ++j)
+            {
+                // 可读的eventfd，ET模式下注册后立即触发一次
+                int fd = eventfd(op == Op::TRIGGER ? 1 : 0, EFD_NONBLOCK);
+                fds.push_back(fd);
+            }
+            for (size_t j = 0; j < loop_cnt; ++j)
+            {
+                int fd = fds[j % fd_cnt];
+                if (op == Op::TRIGGER)
+                {
+                    if (!iom->add_event(fd, tiger::IOManager::READ))
+                    {
+                        ++fails;
+                        continue;
+                    }
+                    tiger::Coroutine::Yield();
+                    ++callbacks;
+                    continue;
+                }
+                if (!iom->add_event(fd, tiger::IOManager::READ, [&callbacks]() { ++callbacks; }))
+                {
+                    ++fails;
+                    continue;
+                }
+                bool ok = op == Op::DEL ? iom->del_event(fd, tiger::IOManager::READ)
+                                        : iom->cancel_event(fd, tiger::IOManager::READ);
+                fails += !ok;
+            }
+            for (int fd : fds)
+            {
+                close(fd);
+            }
+            ++done;
+        });
+    }
+    while (done < co_cnt || (op == Op::CANCEL && callbacks < co_cnt * loop_cnt))
+    {
+        usleep(1000);
+    }
+    uint64_t cost = tiger::MonotonicMicrosecond() - start;
+    iom->stop();
+    size_t total = co_cnt * loop_cnt;
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench_fd_table op:" << OpName(op) << " threads:" << thread_cnt
+                                 << " coroutines:" << co_cnt << " fds:" << co_cnt * fd_cnt << " ops:" << total
+                                 << " callbacks:" << callbacks << " fails:" << fails << " cost:" << cost / 1000
+                                 << "ms ops/s:" << total * 1000000 / (cost ? cost : 1) << "]";
+}
+
+int main(int argc, char **argv)
+{
+    tiger::SingletonLoggerMgr::Instance()->add_loggers("tiger", "../conf/tiger.yml");
+    tiger::Thread::SetName("BENCH_FD");
+    size_t loop_cnt = argc > 1 ? atoi(argv[1]) : 100000;
+    size_t fd_cnt = argc > 2 ? atoi(argv[2]) : 64;
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench fd table start]";
+    for (Op op : {Op::DEL, Op::CANCEL, Op::TRIGGER})
+    {
+        for (size_t thread_cnt : {1, 2, 4})
+        {
+            bench_fd_table(op, thread_cnt, thread_cnt * 2, fd_cnt, loop_cnt);
+        }
+    }
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench fd table end]";
+    return 0;
+}
@@ -0,0 +1,69 @@
+/*****************************************************************
+ * Description 突发任务唤醒延迟测试(直接挂起 vs 自旋后挂起)
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/15
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../src/config.h"
+#include "../src/iomanager.h"
+#include "../src/macro.h"
+#include "../src/util.h"
+
+// 外部线程每隔一段时间投递一批任务，统计任务从投递到执行的延迟
+void bench_idle(uint64_t spin_us, size_t burst_cnt, size_t burst_size, useconds_t gap_us)
+{
+    tiger::Config::Lookup<uint64_t>("tiger.scheduler.idleSpinUs")->set_val(spin_us);
+    auto iom = std::make_shared<tiger::IOManager>("BENCH", false, 2);
+    iom->start();
+    std::atomic<uint64_t> total_us{0};
+    std::atomic<uint64_t> max_us{0};
+    std::atomic<size_t> done{0};
+    for (size_t i = 0; i < burst_cnt; ++i)
+    {
+        for (size_t j = 0; j < burst_size; ++j)
+        {
+            uint64_t enqueue = tiger::MonotonicMicrosecond();
+            iom->schedule([&, enqueue]() {
+                uint64_t wait = tiger::MonotonicMicrosecond() - enqueue;
+                total_us += wait;
+                uint64_t max = max_us;
+                while (wait > max && !max_us.compare_exchange_weak(max, wait))
+                {
+                }
+                ++done;
+            });
+        }
+        usleep(gap_us);
+    }
+    while (done < burst_cnt * burst_size)
+    {
+        usleep(1000);
+    }
+    iom->stop();
+    size_t total = burst_cnt * burst_size;
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench_idle spin_us:" << spin_us << " bursts:" << burst_cnt
+                                 << " burst_size:" << burst_size << " gap:" << gap_us << "us"
+                                 << " avg_latency:" << total_us / total << "us max_latency:" << max_us
+                                 << "us parks:" << iom->park_cnt() << " spin_hits:" << iom->spin_hit_cnt() << "]";
+}
+
+int main(int argc, char **argv)
+{
+    tiger::SingletonLoggerMgr::Instance()->add_loggers("tiger", "../conf/tiger.yml");
+    tiger::Thread::SetName("BENCH_IDLE");
+    size_t burst_cnt = argc > 1 ? atoi(argv[1]) : 2000;
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench idle start]";
+    useconds_t gaps[] = {20, 200};
+    for (auto gap : gaps)
+    {
+        bench_idle(0, burst_cnt, 8, gap);
+        bench_idle(50, burst_cnt, 8, gap);
+        bench_idle(200, burst_cnt, 8, gap);
+    }
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench idle end]";
+    return 0;
+}
@@ -0,0 +1,210 @@
+/*****************************************************************
+ * Description epoll与io_uring后端对比，回显和HTTP keep-alive两种负载
+ *  HTTP服务端只解析到请求头结束并返回固定响应，测的是IO路径而不是HTTP解析
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/22
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#include <stdlib.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "../src/config.h"
+#include "../src/iomanager.h"
+#include "../src/servers/tcp_server.h"
+#include "../src/util.h"
+
+static const size_t ECHO_MSG_SIZE = 64;
+
+class EchoServer : public tiger::TCPServer
+{
+  public:
+    EchoServer(tiger::IOManager::ptr iom) : tiger::TCPServer(iom, iom)
+    {
+    }
+
+    void handle_client(tiger::Socket::ptr client) override
+    {
+        char buf[4096];
+        int rt = 0;
+        while ((rt = client->recv(buf, sizeof(buf))) > 0)
+        {
+            if (client->send(buf, rt) != rt)
+                break;
+        }
+        client->close();
+    }
+};
+
+static const char HTTP_RESPONSE[] = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 17\r\n"
+                                    "Connection: keep-alive\r\n\r\nHello! I'm tiger!";
+
+class HelloServer : public tiger::TCPServer
+{
+  public:
+    HelloServer(tiger::IOManager::ptr iom) : tiger::TCPServer(iom, iom)
+    {
+    }
+
+    void handle_client(tiger::Socket::ptr client) override
+    {
+        std::string request;
+        char buf[4096];
+        int rt = 0;
+        while ((rt = client->recv(buf, sizeof(buf))) > 0)
+        {
+            request.append(buf, rt);
+            size_t end = 0;
+            while ((end = request.find("\r\n\r\n")) != std::string::npos)
+            {
+                request.erase(0, end + 4);
+                if (client->send(HTTP_RESPONSE, sizeof(HTTP_RESPONSE) - 1) != (int)sizeof(HTTP_RESPONSE) - 1)
+                {
+                    client->close();
+                    return;
+                }
+            }
+        }
+        client->close();
+    }
+};
+
+static bool RecvEcho(tiger::Socket::ptr socket, char *buf)
+{
+    size_t n = 0;
+    while (n < ECHO_MSG_SIZE)
+    {
+        int rt = socket->recv(buf + n, ECHO_MSG_SIZE - n);
+        if (rt <= 0)
+            return false;
+        n += rt;
+    }
+    return true;
+}
+
+// 读到一个完整的HTTP响应，返回false表示连接出错
+static bool RecvResponse(tiger::Socket::ptr socket, std::string &buf)
+{
+    buf.clear();
+    size_t body = std::string::npos;
+    char tmp[4096];
+    while (true)
+    {
+        if (body == std::string::npos)
+        {
+            size_t header_end = buf.find("\r\n\r\n");
+            if (header_end != std::string::npos)
+            {
+                const char *length = strcasestr(buf.c_str(), "content-length:");
+                body = header_end + 4 + (length ? atoi(length + 15) : 0);
+            }
+        }
+        if (body != std::string::npos && buf.size() >= body)
+            return true;
+        int rt = socket->recv(tmp, sizeof(tmp));
+        if (rt <= 0)
+            return false;
+        buf.append(tmp, rt);
+    }
+}
+
+// conn_cnt条连接各完成req_cnt次请求，http为false时是回显
+void bench_backend(tiger::IOManager::Backend backend, bool multishot, bool http, size_t thread_cnt, size_t conn_cnt,
+                   size_t req_cnt, uint16_t port)
+{
+    tiger::Config::Lookup<bool>("tiger.iomanager.uringMultishotRecv")->set_val(multishot);
+    auto iom = std::make_shared<tiger::IOManager>("BENCH", false, thread_cnt);
+    iom->set_backend(backend);
+    iom->start();
+    auto addr = tiger::IPAddress::LookupAny("127.0.0.1:" + std::to_string(port));
+    tiger::TCPServer::ptr server;
+    if (http)
+    {
+        server = std::make_shared<HelloServer>(iom);
+    }
+    else
+    {
+        server = std::make_shared<EchoServer>(iom);
+    }
+    std::atomic<size_t> done{0};
+    std::atomic<size_t> fails{0};
+    std::atomic<size_t> conns{0};
+    uint64_t start = tiger::MonotonicMicrosecond();
+    auto client = [&]() {
+        auto socket = tiger::Socket::CreateTCP(addr);
+        if (!socket->connect(addr, 3000))
+        {
+            ++fails;
+            ++conns;
+            return;
+        }
+        std::string request = http ? "GET /hello HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n\r\n"
+                                   : std::string(ECHO_MSG_SIZE, 'x');
+        std::string response;
+        char buf[ECHO_MSG_SIZE];
+        for (size_t r = 0; r < req_cnt; ++r)
+        {
+            if (socket->send(request.c_str(), request.size()) != (int)request.size())
+            {
+                ++fails;
+                break;
+            }
+            if (!(http ? RecvResponse(socket, response) : RecvEcho(socket, buf)))
+            {
+                ++fails;
+                break;
+            }
+            ++done;
+        }
+        socket->close();
+        ++conns;
+    };
+    // 监听socket要在工作线程上创建才会被hook
+    iom->schedule([&]() {
+        if (!server->bind(addr))
+        {
+            TIGER_LOG_E(tiger::TEST_LOG) << "[bench_io_backend bind fail port:" << port << "]";
+            fails = conn_cnt;
+            conns = conn_cnt;
+            return;
+        }
+        server->start();
+        for (size_t i = 0; i < conn_cnt; ++i)
+        {
+            iom->schedule(client, iom->assign_thread());
+        }
+    });
+    while (conns < conn_cnt)
+    {
+        usleep(1000);
+    }
+    uint64_t cost = tiger::MonotonicMicrosecond() - start;
+    server->stop();
+    iom->stop();
+    bool uring = iom->backend() == tiger::IOManager::Backend::IO_URING;
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench_io_backend"
+                                 << " backend:" << (uring ? "io_uring" : "epoll") << " multishot_recv:" << multishot
+                                 << " load:" << (http ? "http" : "echo") << " threads:" << thread_cnt
+                                 << " conns:" << conn_cnt << " requests:" << done << " fails:" << fails
+                                 << " cost:" << cost / 1000 << "ms qps:" << done * 1000000 / (cost ? cost : 1) << "]";
+}
+
+int main(int argc, char **argv)
+{
+    tiger::SingletonLoggerMgr::Instance()->add_loggers("tiger", "../conf/tiger.yml");
+    tiger::Thread::SetName("BENCH_IO");
+    size_t req_cnt = argc > 1 ? atoi(argv[1]) : 2000;
+    size_t conn_cnt = argc > 2 ? atoi(argv[2]) : 32;
+    size_t thread_cnt = argc > 3 ? atoi(argv[3]) : 2;
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench io backend start]";
+    uint16_t port = 18080;
+    for (bool http : {false, true})
+    {
+        bench_backend(tiger::IOManager::Backend::EPOLL, false, http, thread_cnt, conn_cnt, req_cnt, port++);
+        bench_backend(tiger::IOManager::Backend::IO_URING, false, http, thread_cnt, conn_cnt, req_cnt, port++);
+        bench_backend(tiger::IOManager::Backend::IO_URING, true, http, thread_cnt, conn_cnt, req_cnt, port++);
+    }
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench io backend end]";
+    return 0;
+}
@@ -0,0 +1,81 @@
+/*****************************************************************
+ * Description 并行计算扩展性测试(1到N个线程)
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/13
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#include <stdlib.h>
+
+#include "../src/hash.h"
+#include "../src/macro.h"
+#include "../src/parallel.h"
+#include "../src/util.h"
+
+static const size_t PAYLOAD_SIZE = 4096;
+
+// 对每个payload做一次SHA256，结果按字节求和防止被优化掉
+void bench_parallel(size_t thread_cnt, const std::vector<std::string> &payloads, time_t base_cost)
+{
+    auto scheduler = std::make_shared<tiger::Scheduler>("BENCH", false, thread_cnt);
+    scheduler->start();
+    time_t start = tiger::Millisecond();
+    size_t checksum = tiger::ParallelReduce(
+        scheduler.get(), 0, payloads.size(), 0, (size_t)0,
+        [&](size_t begin, size_t end) {
+            size_t s = 0;
+            for (size_t i = begin; i < end; ++i)
+            {
+                for (auto c : tiger::SHA256(payloads[i]))
+                {
+                    s += (uint8_t)c;
+                }
+            }
+            return s;
+        },
+        [](size_t a, size_t b) { return a + b; });
+    time_t cost = tiger::Millisecond() - start;
+    scheduler->stop();
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench_parallel threads:" << thread_cnt << " payloads:" << payloads.size()
+                                 << " cost:" << cost << "ms"
+                                 << " speedup:" << (cost > 0 && base_cost > 0 ? (double)base_cost / cost : 1.0)
+                                 << " checksum:" << checksum << "]";
+}
+
+time_t bench_serial(const std::vector<std::string> &payloads)
+{
+    time_t start = tiger::Millisecond();
+    size_t s = 0;
+    for (auto &payload : payloads)
+    {
+        for (auto c : tiger::SHA256(payload))
+        {
+            s += (uint8_t)c;
+        }
+    }
+    time_t cost = tiger::Millisecond() - start;
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench_parallel serial payloads:" << payloads.size() << " cost:" << cost
+                                 << "ms checksum:" << s << "]";
+    return cost;
+}
+
+int main(int argc, char **argv)
+{
+    tiger::SingletonLoggerMgr::Instance()->add_loggers("tiger", "../conf/tiger.yml");
+    tiger::Thread::SetName("BENCH_PARALLEL");
+    size_t payload_cnt = argc > 1 ? atoi(argv[1]) : 20000;
+    size_t max_threads = argc > 2 ? atoi(argv[2]) : 8;
+    std::vector<std::string> payloads(payload_cnt);
+    for (size_t i = 0; i < payload_cnt; ++i)
+    {
+        payloads[i].assign(PAYLOAD_SIZE, (char)i);
+    }
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench parallel start]";
+    time_t base_cost = bench_serial(payloads);
+    for (size_t thread_cnt = 1; thread_cnt <= max_threads; thread_cnt *= 2)
+    {
+        bench_parallel(thread_cnt, payloads, base_cost);
+    }
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench parallel end]";
+    return 0;
+}
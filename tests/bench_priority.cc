@@ -0,0 +1,91 @@
+/*****************************************************************
+ * Description 过载时高优先级任务排队时间测试(FIFO vs 权重轮转 vs 严格优先级)
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/14
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#include <stdlib.h>
+
+#include "../src/macro.h"
+#include "../src/mutex.h"
+#include "../src/scheduler.h"
+#include "../src/util.h"
+
+typedef tiger::Scheduler::Priority Priority;
+
+// 模拟批量任务的计算量
+static void BulkWork()
+{
+    volatile size_t s = 0;
+    for (size_t i = 0; i < 2000; ++i)
+    {
+        s += i;
+    }
+}
+
+// 每probe_interval个批量任务插入一个探测任务，统计探测任务从入队到执行的延迟
+void bench_priority(const std::string &mode, size_t bulk_cnt, size_t probe_interval)
+{
+    bool fifo = mode == "fifo";
+    std::atomic<size_t> done{0};
+    std::atomic<uint64_t> probe_total{0};
+    std::atomic<uint64_t> probe_max{0};
+    size_t probe_cnt = bulk_cnt / probe_interval;
+    size_t total = bulk_cnt + probe_cnt;
+    tiger::Semaphore sem;
+    auto scheduler = std::make_shared<tiger::Scheduler>("BENCH", false, 2);
+    scheduler->set_strict_priority(mode == "strict");
+    auto finish = [&]() {
+        if (++done == total)
+            sem.post();
+    };
+    // 调度器运行中持续投递，投递速度远高于处理速度
+    time_t start = tiger::Millisecond();
+    scheduler->start();
+    for (size_t i = 0; i < bulk_cnt; ++i)
+    {
+        scheduler->schedule(
+            [&]() {
+                BulkWork();
+                finish();
+            },
+            fifo ? Priority::NORMAL : Priority::LOW);
+        if ((i + 1) % probe_interval == 0)
+        {
+            uint64_t enqueue = tiger::MonotonicMicrosecond();
+            scheduler->schedule(
+                [&, enqueue]() {
+                    uint64_t wait = tiger::MonotonicMicrosecond() - enqueue;
+                    probe_total += wait;
+                    uint64_t max = probe_max;
+                    while (wait > max && !probe_max.compare_exchange_weak(max, wait))
+                    {
+                    }
+                    finish();
+                },
+                fifo ? Priority::NORMAL : Priority::HIGH);
+        }
+    }
+    sem.wait();
+    time_t cost = tiger::Millisecond() - start;
+    scheduler->stop();
+    auto low = scheduler->wait_stats(fifo ? Priority::NORMAL : Priority::LOW);
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench_priority mode:" << mode << " bulk:" << bulk_cnt << " probes:" << probe_cnt
+                                 << " cost:" << cost << "ms probe_avg_wait:"
+                                 << (probe_cnt > 0 ? probe_total / probe_cnt : 0) << "us probe_max_wait:" << probe_max
+                                 << "us bulk_avg_wait:" << low.avg_us() << "us]";
+}
+
+int main(int argc, char **argv)
+{
+    tiger::SingletonLoggerMgr::Instance()->add_loggers("tiger", "../conf/tiger.yml");
+    tiger::Thread::SetName("BENCH_PRIORITY");
+    size_t bulk_cnt = argc > 1 ? atoi(argv[1]) : 20000;
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench priority start]";
+    bench_priority("fifo", bulk_cnt, 100);
+    bench_priority("weighted", bulk_cnt, 100);
+    bench_priority("strict", bulk_cnt, 100);
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench priority end]";
+    return 0;
+}
@@ -0,0 +1,82 @@
+/*****************************************************************
+ * Description 调度器吞吐量测试(全局队列 vs 工作窃取)
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/02
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#include <stdlib.h>
+
+#include "../src/config.h"
+#include "../src/macro.h"
+#include "../src/scheduler.h"
+#include "../src/util.h"
+
+static std::atomic<size_t> s_finished_chains{0};
+static size_t s_chains = 0;
+static bool s_inline = false;
+
+void chain_step(tiger::Scheduler *scheduler, size_t left)
+{
+    if (left == 0)
+    {
+        if (++s_finished_chains == s_chains)
+        {
+            scheduler->stop();
+        }
+        return;
+    }
+    if (s_inline)
+    {
+        scheduler->schedule_inline(std::bind(&chain_step, scheduler, left - 1));
+    }
+    else
+    {
+        scheduler->schedule(std::bind(&chain_step, scheduler, left - 1));
+    }
+}
+
+void bench_scheduler(size_t thread_cnt, bool work_stealing, bool is_inline, size_t batch_size, size_t chains,
+                     size_t chain_len)
+{
+    tiger::Config::Lookup<size_t>("tiger.scheduler.batchSize")->set_val(batch_size);
+    s_finished_chains = 0;
+    s_chains = chains;
+    s_inline = is_inline;
+    auto scheduler = std::make_shared<tiger::Scheduler>("BENCH", true, thread_cnt);
+    scheduler->set_work_stealing(work_stealing);
+    for (size_t i = 0; i < chains; ++i)
+    {
+        scheduler->schedule(std::bind(&chain_step, scheduler.get(), chain_len));
+    }
+    time_t start = tiger::Millisecond();
+    scheduler->start();
+    time_t cost = tiger::Millisecond() - start;
+    size_t total = chains * (chain_len + 1);
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench_scheduler"
+                                 << " mode:" << (work_stealing ? "work_stealing" : "global_list")
+                                 << " inline:" << is_inline << " batch:" << batch_size << " threads:" << thread_cnt
+                                 << " tasks:" << total << " cost:" << cost << "ms"
+                                 << " throughput:" << (cost > 0 ? total * 1000 / cost : total) << "/s]";
+}
+
+int main(int argc, char **argv)
+{
+    tiger::SingletonLoggerMgr::Instance()->add_loggers("tiger", "../conf/tiger.yml");
+    tiger::Thread::SetName("BENCH_SCHEDULER");
+    size_t total = argc > 1 ? atoi(argv[1]) : 100000;
+    size_t threads[] = {1, 4, 16, 64};
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench scheduler start]";
+    for (auto thread_cnt : threads)
+    {
+        size_t chains = thread_cnt * 4;
+        bench_scheduler(thread_cnt, false, false, 1, chains, total / chains);
+        bench_scheduler(thread_cnt, false, false, 16, chains, total / chains);
+        bench_scheduler(thread_cnt, false, true, 1, chains, total / chains);
+        bench_scheduler(thread_cnt, false, true, 16, chains, total / chains);
+        bench_scheduler(thread_cnt, true, false, 16, chains, total / chains);
+        bench_scheduler(thread_cnt, true, true, 16, chains, total / chains);
+    }
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench scheduler end]";
+    return 0;
+}
@@ -0,0 +1,73 @@
+/*****************************************************************
+ * Description 挂起协程内存占用测试(独立栈 vs 共享栈)
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/08
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <vector>
+
+#include "../src/coroutine.h"
+#include "../src/macro.h"
+
+// 当前进程常驻内存字节数
+static size_t ResidentBytes()
+{
+    size_t size = 0;
+    size_t resident = 0;
+    std::ifstream ifs("/proc/self/statm");
+    ifs >> size >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+// 模拟等待消息的连接处理函数，挂起时栈上有少量数据
+void parked_fn()
+{
+    volatile char buf[1024];
+    for (size_t i = 0; i < sizeof(buf); ++i)
+    {
+        buf[i] = i;
+    }
+    tiger::Coroutine::Yield();
+}
+
+void bench_shared_stack(size_t cnt, bool shared)
+{
+    std::vector<tiger::Coroutine::ptr> cos;
+    cos.reserve(cnt);
+    size_t before = ResidentBytes();
+    for (size_t i = 0; i < cnt; ++i)
+    {
+        cos.push_back(std::make_shared<tiger::Coroutine>(&parked_fn, 0, shared));
+        cos.back()->resume();
+    }
+    size_t after = ResidentBytes();
+    size_t saved = 0;
+    for (auto &co : cos)
+    {
+        saved += co->saved_stack_size();
+    }
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench_shared_stack mode:" << (shared ? "shared" : "private")
+                                 << " coroutines:" << cnt << " rss:" << (after - before) / 1024 << "KB"
+                                 << " per_coroutine:" << (after > before ? (after - before) / cnt : 0) << "B"
+                                 << " saved_stack:" << saved / cnt << "B]";
+    for (auto &co : cos)
+    {
+        co->resume();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    tiger::SingletonLoggerMgr::Instance()->add_loggers("tiger", "../conf/tiger.yml");
+    size_t cnt = argc > 1 ? atoi(argv[1]) : 10000;
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench shared stack start]";
+    bench_shared_stack(cnt, false);
+    bench_shared_stack(cnt, true);
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench shared stack end]";
+    return 0;
+}
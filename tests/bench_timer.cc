@@ -0,0 +1,136 @@
+/*****************************************************************
+ * Description 定时器测试(红黑树 vs 时间轮)，不同数量的未到期定时器下插入、取消和批量到期的耗时
+ *  以及相隔几毫秒的超时在不同slack下IOManager实际的唤醒次数
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/24
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <random>
+
+#include "../src/iomanager.h"
+#include "../src/macro.h"
+#include "../src/timer.h"
+#include "../src/util.h"
+
+class BenchTimerManager : public tiger::TimerManager
+{
+  protected:
+    void on_timer_refresh() override
+    {
+    }
+};
+
+static double NsPerOp(uint64_t cost_us, size_t cnt)
+{
+    return cnt ? cost_us * 1000.0 / cnt : 0;
+}
+
+// pending_cnt个1~60s的定时器模拟连接的读超时，在此基础上测量读写路径上的add/cancel和1s内到期的批量处理
+void bench_timer(bool wheel, size_t pending_cnt, size_t churn_cnt)
+{
+    BenchTimerManager manager;
+    manager.set_wheel(wheel);
+    std::mt19937 rng(pending_cnt);
+    std::vector<tiger::TimerManager::Timer::ptr> pending;
+    pending.reserve(pending_cnt);
+    std::function<void()> cb = []() {};
+
+    uint64_t start = tiger::MonotonicMicrosecond();
+    for (size_t i = 0; i < pending_cnt; ++i)
+    {
+        pending.push_back(manager.add_timer(1000 + rng() % 59000, cb));
+    }
+    uint64_t insert_us = tiger::MonotonicMicrosecond() - start;
+
+    start = tiger::MonotonicMicrosecond();
+    for (size_t i = 0; i < churn_cnt; ++i)
+    {
+        auto timer = manager.add_timer(1000 + rng() % 59000, cb);
+        manager.cancel_timer(timer);
+    }
+    uint64_t churn_us = tiger::MonotonicMicrosecond() - start;
+
+    // 另加一批1s内到期的定时器，等全部到期后一次取出；插入较慢时部分长定时器也会一起到期，按个数平均
+    size_t expire_cnt = std::min(pending_cnt, (size_t)100000);
+    for (size_t i = 0; i < expire_cnt; ++i)
+    {
+        manager.add_timer(rng() % 1000, cb);
+    }
+    usleep(1100 * 1000);
+    std::vector<std::function<void()>> cbs;
+    start = tiger::MonotonicMicrosecond();
+    manager.all_expired_cbs(cbs);
+    uint64_t expire_us = tiger::MonotonicMicrosecond() - start;
+
+    start = tiger::MonotonicMicrosecond();
+    for (auto &timer : pending)
+    {
+        manager.cancel_timer(timer);
+    }
+    uint64_t cancel_us = tiger::MonotonicMicrosecond() - start;
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench_timer " << (wheel ? "wheel" : "set") << " pending:" << pending_cnt
+                                 << " insert:" << NsPerOp(insert_us, pending_cnt) << "ns"
+                                 << " add_cancel:" << NsPerOp(churn_us, churn_cnt) << "ns"
+                                 << " expire:" << NsPerOp(expire_us, cbs.size()) << "ns(" << cbs.size() << ")"
+                                 << " cancel:" << NsPerOp(cancel_us, pending_cnt) << "ns]";
+}
+
+// timer_cnt个定时器在1s内随机到期，统计空闲线程挂起(即被唤醒)的次数
+void bench_timer_slack(bool wheel, size_t timer_cnt, time_t slack_ms)
+{
+    auto iom = std::make_shared<tiger::IOManager>("BENCH", false, 1);
+    iom->set_timer_wheel(wheel);
+    iom->start();
+    std::mt19937 rng(timer_cnt);
+    std::atomic<size_t> fired{0};
+    std::atomic<uint64_t> late_us{0};
+    uint64_t park_cnt = iom->park_cnt();
+    for (size_t i = 0; i < timer_cnt; ++i)
+    {
+        time_t interval_us = 1000 + rng() % 1000000;
+        uint64_t due = tiger::MonotonicMicrosecond() + interval_us;
+        iom->add_timer_us(
+            interval_us,
+            [&fired, &late_us, due]() {
+                late_us += tiger::MonotonicMicrosecond() - due;
+                ++fired;
+            },
+            false, slack_ms * 1000);
+    }
+    while (fired < timer_cnt)
+    {
+        usleep(10000);
+    }
+    park_cnt = iom->park_cnt() - park_cnt;
+    iom->stop();
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench_timer_slack " << (wheel ? "wheel" : "set") << " timers:" << timer_cnt
+                                 << " slack:" << slack_ms << "ms wakeups:" << park_cnt
+                                 << " saved:" << iom->timer_coalesced_cnt()
+                                 << " avg_late:" << late_us / timer_cnt << "us]";
+}
+
+int main(int argc, char **argv)
+{
+    tiger::SingletonLoggerMgr::Instance()->add_loggers("tiger", "../conf/tiger.yml");
+    tiger::Thread::SetName("BENCH_TIMER");
+    size_t churn_cnt = argc > 1 ? atoi(argv[1]) : 1000000;
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench timer start]";
+    for (size_t pending_cnt : {1000, 100000, 1000000})
+    {
+        bench_timer(false, pending_cnt, churn_cnt);
+        bench_timer(true, pending_cnt, churn_cnt);
+    }
+    for (bool wheel : {false, true})
+    {
+        for (time_t slack_ms : {0, 1, 5, 20})
+        {
+            bench_timer_slack(wheel, 5000, slack_ms);
+        }
+    }
+    TIGER_LOG_I(tiger::TEST_LOG) << "[bench timer end]";
+    return 0;
+}
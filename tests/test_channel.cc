@@ -0,0 +1,148 @@
+/*****************************************************************
+ * Description
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/11
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#include "../src/channel.h"
+#include "../src/macro.h"
+#include "../src/scheduler.h"
+
+static const size_t ITEM_CNT = 1000;
+
+static void Check(bool ok, const std::string &name)
+{
+    if (ok)
+    {
+        TIGER_LOG_D(tiger::TEST_LOG) << name << " suc";
+        return;
+    }
+    TIGER_LOG_E(tiger::TEST_LOG) << name << " fail";
+    throw std::runtime_error(name + " error");
+}
+
+// 多生产者多消费者，容量很小迫使双方频繁挂起
+void test_channel_mpmc()
+{
+    static const size_t PRODUCER_CNT = 4;
+    static const size_t CONSUMER_CNT = 4;
+    tiger::Channel<size_t> chan(4);
+    std::atomic<size_t> sum{0};
+    std::atomic<size_t> received{0};
+    std::atomic<size_t> producers{PRODUCER_CNT};
+    std::atomic<size_t> consumers{CONSUMER_CNT};
+    auto scheduler = std::make_shared<tiger::Scheduler>("CHANNEL", true, 2);
+    for (size_t i = 0; i < PRODUCER_CNT; ++i)
+    {
+        scheduler->schedule([&, i]() {
+            for (size_t j = 1; j <= ITEM_CNT; ++j)
+            {
+                chan.send(i * ITEM_CNT + j);
+            }
+            if (--producers == 0)
+            {
+                chan.close();
+            }
+        });
+    }
+    for (size_t i = 0; i < CONSUMER_CNT; ++i)
+    {
+        scheduler->schedule([&]() {
+            size_t value = 0;
+            while (chan.recv(value))
+            {
+                sum += value;
+                ++received;
+            }
+            if (--consumers == 0)
+            {
+                scheduler->stop();
+            }
+        });
+    }
+    scheduler->start();
+    size_t total = PRODUCER_CNT * ITEM_CNT;
+    Check(received == total && sum == total * (total + 1) / 2, "test_channel_mpmc");
+}
+
+// 解析 -> 处理 -> 汇总三级流水线，批量收发
+void test_channel_pipeline()
+{
+    tiger::Channel<size_t> parsed(8);
+    tiger::Channel<std::string> handled(8);
+    size_t bytes = 0;
+    size_t expect = 0;
+    auto scheduler = std::make_shared<tiger::Scheduler>("PIPELINE", true, 3);
+    scheduler->schedule([&]() {
+        std::vector<size_t> batch;
+        for (size_t i = 1; i <= ITEM_CNT; ++i)
+        {
+            batch.push_back(i);
+            if (batch.size() == 16 || i == ITEM_CNT)
+            {
+                Check(parsed.send_batch(batch) == batch.size(), "test_channel_pipeline send_batch");
+                batch.clear();
+            }
+        }
+        parsed.close();
+    });
+    scheduler->schedule([&]() {
+        std::vector<size_t> batch;
+        while (parsed.recv_batch(batch, 16) > 0)
+        {
+            for (auto v : batch)
+            {
+                handled.send(std::string(v % 10 + 1, 'x'));
+            }
+            batch.clear();
+        }
+        handled.close();
+    });
+    scheduler->schedule([&]() {
+        std::string msg;
+        while (handled.recv(msg))
+        {
+            bytes += msg.size();
+        }
+        scheduler->stop();
+    });
+    for (size_t i = 1; i <= ITEM_CNT; ++i)
+    {
+        expect += i % 10 + 1;
+    }
+    scheduler->start();
+    Check(bytes == expect, "test_channel_pipeline");
+}
+
+void test_channel_close()
+{
+    tiger::Channel<int> chan(2);
+    Check(chan.try_send(1) && chan.try_send(2) && !chan.try_send(3), "test_channel_close full");
+    chan.close();
+    int value = 0;
+    Check(!chan.try_send(4), "test_channel_close send");
+    auto scheduler = std::make_shared<tiger::Scheduler>("CHANNEL_CLOSE", true, 1);
+    std::vector<int> values;
+    bool last = true;
+    scheduler->schedule([&]() {
+        // 关闭后仍能取出剩余数据
+        chan.recv_batch(values, 10);
+        last = chan.recv(value);
+        scheduler->stop();
+    });
+    scheduler->start();
+    Check(values.size() == 2 && values[0] == 1 && values[1] == 2 && !last, "test_channel_close recv");
+}
+
+int main()
+{
+    tiger::SingletonLoggerMgr::Instance()->add_loggers("tiger", "../conf/tiger.yml");
+    tiger::Thread::SetName("CHANNEL");
+    TIGER_LOG_D(tiger::TEST_LOG) << "[channel test start]";
+    test_channel_mpmc();
+    test_channel_pipeline();
+    test_channel_close();
+    TIGER_LOG_D(tiger::TEST_LOG) << "[channel test end]";
+    return 0;
+}
@@ -0,0 +1,197 @@
+/*****************************************************************
+ * Description
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/10
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#include "../src/co_mutex.h"
+#include "../src/macro.h"
+#include "../src/scheduler.h"
+
+static const size_t CO_CNT = 16;
+static const size_t LOOP_CNT = 100;
+
+// 让出当前协程，稍后在同一线程继续执行
+static void YieldNow()
+{
+    tiger::Scheduler::GetThreadScheduler()->schedule(tiger::Coroutine::GetRunningCo(), tiger::Thread::CurThreadId());
+    tiger::Coroutine::Yield();
+}
+
+static void Check(bool ok, const std::string &name)
+{
+    if (ok)
+    {
+        TIGER_LOG_D(tiger::TEST_LOG) << name << " suc";
+        return;
+    }
+    TIGER_LOG_E(tiger::TEST_LOG) << name << " fail";
+    throw std::runtime_error(name + " error");
+}
+
+// 持锁期间让出，线程锁会在同一线程上死锁，协程锁不会
+void test_co_mutex(size_t thread_cnt)
+{
+    tiger::CoMutex mutex;
+    size_t counter = 0;
+    size_t inside = 0;
+    bool overlap = false;
+    std::atomic<size_t> done{0};
+    auto scheduler = std::make_shared<tiger::Scheduler>("CO_MUTEX", true, thread_cnt);
+    for (size_t i = 0; i < CO_CNT; ++i)
+    {
+        scheduler->schedule([&]() {
+            for (size_t j = 0; j < LOOP_CNT; ++j)
+            {
+                tiger::CoMutex::Lock lock(mutex);
+                overlap = overlap || ++inside != 1;
+                YieldNow();
+                ++counter;
+                --inside;
+            }
+            if (++done == CO_CNT)
+            {
+                scheduler->stop();
+            }
+        });
+    }
+    scheduler->start();
+    Check(counter == CO_CNT * LOOP_CNT && !overlap, "test_co_mutex threads:" + std::to_string(thread_cnt));
+}
+
+void test_co_cond_var()
+{
+    tiger::CoMutex mutex;
+    tiger::CoCondVar cond;
+    std::list<size_t> queue;
+    size_t consumed = 0;
+    bool finished = false;
+    auto scheduler = std::make_shared<tiger::Scheduler>("CO_COND", true, 2);
+    scheduler->schedule([&]() {
+        while (true)
+        {
+            tiger::CoMutex::Lock lock(mutex);
+            while (queue.empty() && !finished)
+            {
+                cond.wait(mutex);
+            }
+            if (queue.empty())
+                break;
+            consumed += queue.front();
+            queue.pop_front();
+        }
+        scheduler->stop();
+    });
+    scheduler->schedule([&]() {
+        for (size_t i = 1; i <= LOOP_CNT; ++i)
+        {
+            {
+                tiger::CoMutex::Lock lock(mutex);
+                queue.push_back(i);
+            }
+            cond.notify_one();
+            YieldNow();
+        }
+        tiger::CoMutex::Lock lock(mutex);
+        finished = true;
+        cond.notify_all();
+    });
+    scheduler->start();
+    Check(consumed == LOOP_CNT * (LOOP_CNT + 1) / 2, "test_co_cond_var");
+}
+
+void test_co_semaphore()
+{
+    static const size_t LIMIT = 3;
+    tiger::CoSemaphore sem(LIMIT);
+    std::atomic<size_t> inside{0};
+    std::atomic<size_t> max_inside{0};
+    std::atomic<size_t> done{0};
+    auto scheduler = std::make_shared<tiger::Scheduler>("CO_SEM", true, 2);
+    for (size_t i = 0; i < CO_CNT; ++i)
+    {
+        scheduler->schedule([&]() {
+            for (size_t j = 0; j < 10; ++j)
+            {
+                sem.wait();
+                size_t cur = ++inside;
+                size_t max = max_inside;
+                while (cur > max && !max_inside.compare_exchange_weak(max, cur))
+                {
+                }
+                YieldNow();
+                --inside;
+                sem.post();
+            }
+            if (++done == CO_CNT)
+            {
+                scheduler->stop();
+            }
+        });
+    }
+    scheduler->start();
+    Check(max_inside > 0 && max_inside <= LIMIT && sem.try_wait(), "test_co_semaphore");
+}
+
+void test_co_rwlock()
+{
+    tiger::CoRWLock rwlock;
+    std::atomic<size_t> readers{0};
+    std::atomic<size_t> writers{0};
+    std::atomic<bool> broken{false};
+    std::atomic<size_t> done{0};
+    auto scheduler = std::make_shared<tiger::Scheduler>("CO_RWLOCK", true, 2);
+    for (size_t i = 0; i < CO_CNT; ++i)
+    {
+        bool is_writer = i % 4 == 0;
+        scheduler->schedule([&, is_writer]() {
+            for (size_t j = 0; j < 20; ++j)
+            {
+                if (is_writer)
+                {
+                    tiger::CoRWLock::WriteLock lock(rwlock);
+                    if (++writers != 1 || readers != 0)
+                        broken = true;
+                    YieldNow();
+                    --writers;
+                }
+                else
+                {
+                    tiger::CoRWLock::ReadLock lock(rwlock);
+                    ++readers;
+                    if (writers != 0)
+                        broken = true;
+                    YieldNow();
+                    --readers;
+                }
+            }
+            if (++done == CO_CNT)
+            {
+                // 读锁可以同时持有，写锁互斥，两者都能拿到说明没有残留的持有者
+                {
+                    tiger::CoRWLock::ReadLock r1(rwlock);
+                    tiger::CoRWLock::ReadLock r2(rwlock);
+                }
+                tiger::CoRWLock::WriteLock w(rwlock);
+                scheduler->stop();
+            }
+        });
+    }
+    scheduler->start();
+    Check(!broken && readers == 0 && writers == 0, "test_co_rwlock");
+}
+
+int main()
+{
+    tiger::SingletonLoggerMgr::Instance()->add_loggers("tiger", "../conf/tiger.yml");
+    tiger::Thread::SetName("CO_MUTEX");
+    TIGER_LOG_D(tiger::TEST_LOG) << "[co mutex test start]";
+    test_co_mutex(1);
+    test_co_mutex(4);
+    test_co_cond_var();
+    test_co_semaphore();
+    test_co_rwlock();
+    TIGER_LOG_D(tiger::TEST_LOG) << "[co mutex test end]";
+    return 0;
+}
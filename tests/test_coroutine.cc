@@ -5,8 +5,14 @@
  * Copyright (c) 2021 虎小黑
  ****************************************************************/
 
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../src/config.h"
 #include "../src/coroutine.h"
 #include "../src/macro.h"
+#include "../src/stack_allocator.h"
 #include "../src/thread.h"
 
 void test_fn_1()
@@ -42,12 +48,160 @@ void test_coroutine()
     co_2->resume();
 }
 
+void test_coroutine_pool()
+{
+    auto co = tiger::CoroutinePool::Get(&test_fn_1);
+    auto raw = co.get();
+    co->resume();
+    size_t hit = tiger::CoroutinePool::HitCnt();
+    if (!tiger::CoroutinePool::Put(co) || co || tiger::CoroutinePool::CachedCnt() != 1)
+    {
+        TIGER_LOG_E(tiger::TEST_LOG) << "test_coroutine_pool put fail";
+        throw std::runtime_error("test_coroutine_pool error");
+    }
+    co = tiger::CoroutinePool::Get(&test_fn_2);
+    if (co.get() != raw || tiger::CoroutinePool::HitCnt() != hit + 1)
+    {
+        TIGER_LOG_E(tiger::TEST_LOG) << "test_coroutine_pool get fail";
+        throw std::runtime_error("test_coroutine_pool error");
+    }
+    co->resume();
+    co->resume();
+    TIGER_LOG_D(tiger::TEST_LOG) << "test_coroutine_pool suc hit:" << tiger::CoroutinePool::HitCnt()
+                                 << " miss:" << tiger::CoroutinePool::MissCnt();
+}
+
+size_t test_overflow(size_t depth)
+{
+    volatile char buf[1024];
+    buf[0] = depth;
+    if (depth > 1024 * 1024)
+        return buf[0];
+    return test_overflow(depth + 1) + buf[0];
+}
+
+void test_stack_allocator()
+{
+    size_t page = tiger::StackAllocator::PageSize();
+    void *vp = tiger::StackAllocator::Alloc(page * 4);
+    tiger::StackAllocator::Dealloc(vp, page * 4);
+    if (tiger::StackAllocator::Alloc(page * 4) != vp)
+    {
+        TIGER_LOG_E(tiger::TEST_LOG) << "test_stack_allocator reuse fail";
+        throw std::runtime_error("test_stack_allocator error");
+    }
+    tiger::StackAllocator::Dealloc(vp, page * 4);
+    // 栈溢出必须落在保护页上
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        auto co = std::make_shared<tiger::Coroutine>([]() { test_overflow(0); }, page * 4);
+        co->resume();
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFSIGNALED(status) || WTERMSIG(status) != SIGSEGV)
+    {
+        TIGER_LOG_E(tiger::TEST_LOG) << "test_stack_allocator guard page fail status:" << status;
+        throw std::runtime_error("test_stack_allocator error");
+    }
+    TIGER_LOG_D(tiger::TEST_LOG) << "test_stack_allocator suc mapped:" << tiger::StackAllocator::MappedBytes()
+                                 << " free:" << tiger::StackAllocator::FreeCnt();
+}
+
+void test_shared_fn(size_t seed)
+{
+    volatile size_t buf[256];
+    for (size_t i = 0; i < 256; ++i)
+    {
+        buf[i] = seed + i;
+    }
+    for (size_t n = 0; n < 3; ++n)
+    {
+        tiger::Coroutine::Yield();
+        for (size_t i = 0; i < 256; ++i)
+        {
+            if (buf[i] != seed + i)
+            {
+                throw std::runtime_error("test_shared_stack corrupted");
+            }
+        }
+    }
+}
+
+void test_shared_stack()
+{
+    std::vector<tiger::Coroutine::ptr> cos;
+    for (size_t i = 0; i < 16; ++i)
+    {
+        cos.push_back(std::make_shared<tiger::Coroutine>(std::bind(&test_shared_fn, i * 1000), 0, true));
+    }
+    for (size_t n = 0; n < 4; ++n)
+    {
+        for (auto &co : cos)
+        {
+            co->resume();
+        }
+    }
+    for (auto &co : cos)
+    {
+        if (co->state() != tiger::Coroutine::State::TERMINAL)
+        {
+            TIGER_LOG_E(tiger::TEST_LOG) << "test_shared_stack fail id:" << co->id() << " state:" << co->state();
+            throw std::runtime_error("test_shared_stack error");
+        }
+    }
+    TIGER_LOG_D(tiger::TEST_LOG) << "test_shared_stack suc";
+}
+
+void test_stack_paint_fn()
+{
+    volatile char buf[8 * 1024];
+    for (size_t i = 0; i < sizeof(buf); ++i)
+    {
+        buf[i] = i;
+    }
+}
+
+void test_stack_paint()
+{
+    auto sample = tiger::Config::Lookup<uint32_t>("tiger.coroutine.stackPaintSample");
+    sample->set_val(1);
+    tiger::StackUsageStats stats;
+    auto co = std::make_shared<tiger::Coroutine>(&test_fn_1);
+    co->resume();
+    size_t small = co->stack_used();
+    stats.add(small);
+    // 复用时只重新涂色用过的部分，测量结果不受上次运行影响
+    co->reset(&test_stack_paint_fn);
+    co->resume();
+    size_t large = co->stack_used();
+    stats.add(large);
+    co->reset(&test_fn_1);
+    co->resume();
+    sample->set_val(0);
+    if (small == 0 || large < 8 * 1024 || co->stack_used() != small || stats.count() != 2 ||
+        stats.percentile(1.0) < large || stats.max() != large)
+    {
+        TIGER_LOG_E(tiger::TEST_LOG) << "test_stack_paint fail small:" << small << " large:" << large
+                                     << " reused:" << co->stack_used() << " p100:" << stats.percentile(1.0);
+        throw std::runtime_error("test_stack_paint error");
+    }
+    TIGER_LOG_D(tiger::TEST_LOG) << "test_stack_paint suc small:" << small << " large:" << large
+                                 << " p50:" << stats.percentile(0.5);
+}
+
 int main()
 {
     tiger::SingletonLoggerMgr::Instance()->add_loggers("tiger", "../conf/tiger.yml");
     tiger::Thread::SetName("COROUTINE");
     TIGER_LOG_D(tiger::TEST_LOG) << "[coroutine test start]";
     test_coroutine();
+    test_coroutine_pool();
+    test_stack_allocator();
+    test_shared_stack();
+    test_stack_paint();
     TIGER_LOG_D(tiger::TEST_LOG) << "[coroutine test end]";
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,144 @@
+/*****************************************************************
+ * Description
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/12
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#include "../src/future.h"
+#include "../src/iomanager.h"
+#include "../src/macro.h"
+#include "../src/util.h"
+
+static const size_t CALL_CNT = 10;
+static const time_t CALL_MS = 100;
+
+// 模拟一次后端调用，挂起当前协程ms毫秒
+static void BackendCall(time_t ms)
+{
+    auto iom = tiger::IOManager::GetThreadIOM();
+    auto co = tiger::Coroutine::GetRunningCo();
+    pid_t thread_id = tiger::Thread::CurThreadId();
+    iom->add_timer(ms, [iom, co, thread_id]() { iom->schedule(co, thread_id); });
+    tiger::Coroutine::Yield();
+}
+
+static void Check(bool ok, const std::string &name)
+{
+    if (ok)
+    {
+        TIGER_LOG_D(tiger::TEST_LOG) << name << " suc";
+        return;
+    }
+    TIGER_LOG_E(tiger::TEST_LOG) << name << " fail";
+    throw std::runtime_error(name + " error");
+}
+
+// 并发发起多个耗时调用，总耗时应接近单次调用而不是累加
+void test_when_all()
+{
+    auto iom = std::make_shared<tiger::IOManager>("FUTURE", true, 2);
+    iom->schedule([iom]() {
+        std::vector<tiger::Future<size_t>> futures;
+        time_t start = tiger::Millisecond();
+        for (size_t i = 0; i < CALL_CNT; ++i)
+        {
+            futures.push_back(tiger::Async(iom.get(), [i]() {
+                BackendCall(CALL_MS);
+                return i * i;
+            }));
+        }
+        tiger::WhenAll(futures).wait();
+        time_t cost = tiger::Millisecond() - start;
+        size_t sum = 0;
+        for (auto &future : futures)
+        {
+            sum += future.get();
+        }
+        Check(sum == 285 && cost < (time_t)(CALL_CNT * CALL_MS / 2),
+              "test_when_all cost:" + std::to_string(cost) + "ms");
+        iom->stop();
+    });
+    iom->start();
+}
+
+void test_when_any()
+{
+    auto iom = std::make_shared<tiger::IOManager>("FUTURE", true, 2);
+    iom->schedule([iom]() {
+        std::vector<tiger::Future<void>> futures;
+        futures.push_back(tiger::Async(iom.get(), []() { BackendCall(CALL_MS * 3); }));
+        futures.push_back(tiger::Async(iom.get(), []() { BackendCall(CALL_MS / 10); }));
+        size_t idx = tiger::WhenAny(futures).get();
+        Check(idx == 1 && !futures[0].ready(), "test_when_any");
+        futures[0].wait();
+        iom->stop();
+    });
+    iom->start();
+}
+
+void test_promise_exception()
+{
+    auto scheduler = std::make_shared<tiger::Scheduler>("FUTURE", true, 2);
+    bool caught = false;
+    scheduler->schedule([&]() {
+        auto future = tiger::Async(scheduler.get(), []() -> int { throw std::logic_error("backend error"); });
+        try
+        {
+            future.get();
+        }
+        catch (const std::logic_error &e)
+        {
+            caught = std::string(e.what()) == "backend error";
+        }
+        scheduler->stop();
+    });
+    scheduler->start();
+    Check(caught, "test_promise_exception");
+}
+
+// 不在协程中等待时阻塞线程
+void test_future_thread_wait()
+{
+    auto scheduler = std::make_shared<tiger::Scheduler>("FUTURE", false, 1);
+    scheduler->start();
+    auto future = tiger::Async(scheduler.get(), []() { return std::string("tiger"); });
+    Check(future.get() == "tiger", "test_future_thread_wait");
+    scheduler->stop();
+}
+
+void test_wait_group()
+{
+    auto iom = std::make_shared<tiger::IOManager>("WAIT_GROUP", true, 2);
+    std::atomic<size_t> finished{0};
+    iom->schedule([&]() {
+        tiger::WaitGroup wg;
+        wg.add(CALL_CNT);
+        for (size_t i = 0; i < CALL_CNT; ++i)
+        {
+            iom->schedule([&]() {
+                BackendCall(CALL_MS / 10);
+                ++finished;
+                wg.done();
+            });
+        }
+        wg.wait();
+        Check(finished == CALL_CNT, "test_wait_group");
+        iom->stop();
+    });
+    iom->start();
+}
+
+int main()
+{
+    tiger::SingletonLoggerMgr::Instance()->add_loggers("tiger", "../conf/tiger.yml");
+    tiger::Thread::SetName("FUTURE");
+    TIGER_LOG_D(tiger::TEST_LOG) << "[future test start]";
+    test_when_all();
+    test_when_any();
+    test_promise_exception();
+    test_future_thread_wait();
+    test_wait_group();
+    TIGER_LOG_D(tiger::TEST_LOG) << "[future test end]";
+    return 0;
+}
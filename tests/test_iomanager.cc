@@ -5,9 +5,40 @@
  * Copyright (c) 2021 虎小黑
  ****************************************************************/
 
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <new>
+
+#include "../src/config.h"
+#include "../src/fdmanager.h"
 #include "../src/hook.h"
 #include "../src/iomanager.h"
 #include "../src/thread.h"
+#include "../src/util.h"
+
+// 只统计指定协程中的分配
+static std::atomic<size_t> s_alloc_co_id{0};
+static std::atomic<size_t> s_alloc_cnt{0};
+
+void *operator new(size_t size)
+{
+    if (s_alloc_co_id && tiger::Coroutine::CurCoroutineId() == s_alloc_co_id)
+    {
+        ++s_alloc_cnt;
+    }
+    void *ptr = malloc(size ? size : 1);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
 
 void sleep_func1()
 {
@@ -58,6 +89,409 @@ void test_timer()
     iom->start();
 }
 
+// 时间轮：到期不早于设定时间，跨层降级的定时器也按时触发，取消的不触发
+void test_timer_wheel()
+{
+    auto iom = std::make_shared<tiger::IOManager>("WHEEL", true, 2);
+    if (!iom->set_timer_wheel(true) || !iom->is_wheel())
+    {
+        throw std::runtime_error("test_timer_wheel set_timer_wheel error");
+    }
+    std::atomic<size_t> fired{0};
+    std::atomic<size_t> errors{0};
+    time_t delays[] = {0, 1, 5, 255, 256, 300, 700, 1200};
+    for (auto delay : delays)
+    {
+        time_t expire = tiger::Millisecond() + delay;
+        iom->add_timer(delay, [&, expire]() {
+            // 触发晚一些可以接受，早于到期时间是错误
+            time_t now = tiger::Millisecond();
+            if (now < expire || now > expire + 100)
+            {
+                ++errors;
+            }
+            ++fired;
+        });
+    }
+    auto canceled = iom->add_timer(500, [&]() { ++errors; });
+    // 远超第0层范围的定时器不会触发，也不会让空闲线程提前醒来
+    auto far = iom->add_timer(3600 * 1000, [&]() { ++errors; });
+    std::atomic<size_t> loops{0};
+    auto loop = iom->add_timer(
+        100, [&]() { ++loops; }, true);
+    iom->add_timer(1500, [&]() {
+        iom->cancel_timer(loop);
+        iom->cancel_timer(far);
+        iom->stop();
+    });
+    iom->cancel_timer(canceled);
+    iom->start();
+    TIGER_LOG_D(tiger::TEST_LOG) << "[timer_wheel fired:" << fired << " errors:" << errors << " loops:" << loops
+                                 << " left:" << iom->timer_cnt() << "]";
+    if (fired != sizeof(delays) / sizeof(delays[0]) || errors != 0 || loops < 5 || loops > 15 || iom->timer_cnt())
+    {
+        throw std::runtime_error("test_timer_wheel error");
+    }
+}
+
+// 亚毫秒的usleep，不早于请求的时间，平均延迟不到1ms
+void test_timer_us(bool wheel)
+{
+    static const size_t ROUND_CNT = 50;
+    static const uint64_t SLEEP_US = 300;
+    auto iom = std::make_shared<tiger::IOManager>("TIMER_US", true, 1);
+    iom->set_timer_wheel(wheel);
+    size_t early = 0;
+    uint64_t late_us = 0;
+    iom->schedule([&]() {
+        for (size_t i = 0; i < ROUND_CNT; ++i)
+        {
+            uint64_t start = tiger::MonotonicMicrosecond();
+            usleep(SLEEP_US);
+            uint64_t cost = tiger::MonotonicMicrosecond() - start;
+            if (cost < SLEEP_US)
+            {
+                ++early;
+                continue;
+            }
+            late_us += cost - SLEEP_US;
+        }
+        iom->stop();
+    });
+    iom->start();
+    TIGER_LOG_D(tiger::TEST_LOG) << "[timer_us wheel:" << wheel << " early:" << early
+                                 << " avg_late:" << late_us / ROUND_CNT << "us]";
+    if (early != 0 || late_us / ROUND_CNT >= 1000)
+    {
+        throw std::runtime_error("test_timer_us error");
+    }
+}
+
+// 带slack的定时器不早于到期时间，不晚于slack之后，相近的合并到同一次唤醒
+void test_timer_slack(bool wheel)
+{
+    static const size_t TIMER_CNT = 100;
+    static const time_t SLACK_US = 8000;
+    auto iom = std::make_shared<tiger::IOManager>("SLACK", true, 1);
+    iom->set_timer_wheel(wheel);
+    std::atomic<size_t> fired{0};
+    std::atomic<size_t> early{0};
+    std::atomic<size_t> late{0};
+    iom->schedule([&]() {
+        for (size_t i = 0; i < TIMER_CNT; ++i)
+        {
+            time_t interval = 10000 + i * 97;
+            uint64_t due = tiger::MonotonicMicrosecond() + interval;
+            iom->add_timer_us(
+                interval,
+                [&, due]() {
+                    uint64_t now = tiger::MonotonicMicrosecond();
+                    early += now < due;
+                    // 再留5ms给调度
+                    late += now > due + SLACK_US + 5000;
+                    if (++fired == TIMER_CNT)
+                    {
+                        iom->stop();
+                    }
+                },
+                false, SLACK_US);
+        }
+    });
+    iom->start();
+    TIGER_LOG_D(tiger::TEST_LOG) << "[timer_slack wheel:" << wheel << " fired:" << fired << " early:" << early
+                                 << " late:" << late << " coalesced:" << iom->timer_coalesced_cnt() << "]";
+    if (fired != TIMER_CNT || early != 0 || late != 0 || iom->timer_coalesced_cnt() < TIMER_CNT / 2)
+    {
+        throw std::runtime_error("test_timer_slack error");
+    }
+}
+
+// 多reactor模式：每条连接固定在一个线程上，读写和读超时都由该线程的reactor完成
+void test_multi_reactor()
+{
+    static const size_t CONN_CNT = 8;
+    static const size_t ROUND_CNT = 100;
+    auto iom = std::make_shared<tiger::IOManager>("REACTOR", true, 2);
+    iom->set_multi_reactor(true);
+    std::atomic<size_t> finished{0};
+    std::atomic<size_t> moved{0};
+    std::atomic<size_t> timeouts{0};
+    auto finish = [&]() {
+        if (++finished == CONN_CNT * 2)
+        {
+            iom->stop();
+        }
+    };
+    iom->schedule([&]() {
+        for (size_t i = 0; i < CONN_CNT; ++i)
+        {
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+            {
+                throw std::runtime_error("test_multi_reactor socketpair error");
+            }
+            tiger::SingletonFDManager::Instance()->get_fd(fds[0], true)->set_recv_timeout(20);
+            tiger::SingletonFDManager::Instance()->get_fd(fds[1], true);
+            iom->schedule(
+                [&, fds]() {
+                    pid_t thread_id = tiger::Thread::CurThreadId();
+                    char buf[8];
+                    ssize_t n = 0;
+                    while ((n = read(fds[1], buf, sizeof(buf))) > 0)
+                    {
+                        write(fds[1], buf, n);
+                        moved += tiger::Thread::CurThreadId() != thread_id;
+                    }
+                    close(fds[1]);
+                    finish();
+                },
+                iom->assign_thread());
+            iom->schedule(
+                [&, fds]() {
+                    pid_t thread_id = tiger::Thread::CurThreadId();
+                    char buf[8];
+                    for (size_t r = 0; r < ROUND_CNT; ++r)
+                    {
+                        write(fds[0], "ping", 4);
+                        if (read(fds[0], buf, sizeof(buf)) != 4)
+                            break;
+                        moved += tiger::Thread::CurThreadId() != thread_id;
+                    }
+                    // 对端不再回写，等待读超时
+                    if (read(fds[0], buf, sizeof(buf)) == -1 && errno == ETIMEDOUT)
+                    {
+                        ++timeouts;
+                    }
+                    close(fds[0]);
+                    finish();
+                },
+                iom->assign_thread());
+        }
+    });
+    iom->start();
+    TIGER_LOG_D(tiger::TEST_LOG) << "[multi_reactor finished:" << finished << " moved:" << moved
+                                 << " timeouts:" << timeouts << "]";
+    if (finished != CONN_CNT * 2 || moved != 0 || timeouts != CONN_CNT)
+    {
+        throw std::runtime_error("test_multi_reactor error");
+    }
+}
+
+// 阻塞读和读超时的等待过程不分配内存
+void test_io_timeout_alloc(bool multi_reactor)
+{
+    static const size_t ROUND_CNT = 100;
+    static const uint64_t TIMEOUT_MS = 50;
+    auto iom = std::make_shared<tiger::IOManager>("ALLOC", true, 1);
+    iom->set_multi_reactor(multi_reactor);
+    size_t received = 0;
+    size_t allocs = 0;
+    uint64_t timeout_cost = 0;
+    bool timed_out = false;
+    iom->schedule([&]() {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+        {
+            throw std::runtime_error("test_io_timeout_alloc socketpair error");
+        }
+        tiger::SingletonFDManager::Instance()->get_fd(fds[0], true)->set_recv_timeout(TIMEOUT_MS);
+        tiger::SingletonFDManager::Instance()->get_fd(fds[1], true);
+        pid_t thread_id = tiger::Thread::CurThreadId();
+        iom->schedule(
+            [&, fds]() {
+                // 每次让出后再写，读端总是先阻塞
+                for (size_t r = 0; r < ROUND_CNT; ++r)
+                {
+                    iom->schedule(tiger::Coroutine::GetRunningCo(), thread_id);
+                    tiger::Coroutine::Yield();
+                    write(fds[1], "x", 1);
+                }
+            },
+            thread_id);
+        iom->schedule(
+            [&, fds]() {
+                char buf[1];
+                // 第一次等待会创建fd所在的段，之后开始统计
+                received += read(fds[0], buf, sizeof(buf)) == 1;
+                s_alloc_cnt = 0;
+                s_alloc_co_id = tiger::Coroutine::CurCoroutineId();
+                while (received < ROUND_CNT && read(fds[0], buf, sizeof(buf)) == 1)
+                {
+                    ++received;
+                }
+                // 对端不再写，等待读超时
+                uint64_t start = tiger::MonotonicMicrosecond();
+                timed_out = read(fds[0], buf, sizeof(buf)) == -1 && errno == ETIMEDOUT;
+                timeout_cost = (tiger::MonotonicMicrosecond() - start) / 1000;
+                s_alloc_co_id = 0;
+                allocs = s_alloc_cnt;
+                close(fds[0]);
+                close(fds[1]);
+                iom->stop();
+            },
+            thread_id);
+    });
+    iom->start();
+    TIGER_LOG_D(tiger::TEST_LOG) << "[io_timeout_alloc multi_reactor:" << multi_reactor << " received:" << received
+                                 << " allocs:" << allocs << " timed_out:" << timed_out << " cost:" << timeout_cost
+                                 << "ms]";
+    if (received != ROUND_CNT || allocs != 0 || !timed_out || timeout_cost < TIMEOUT_MS ||
+        timeout_cost > TIMEOUT_MS + 100)
+    {
+        throw std::runtime_error("test_io_timeout_alloc error");
+    }
+}
+
+// io_uring后端：本地回环上accept、回显和读超时，multishot为true时recv使用provided buffer
+void test_uring(bool multishot)
+{
+    static const size_t CONN_CNT = 4;
+    static const size_t ROUND_CNT = 100;
+    tiger::Config::Lookup<bool>("tiger.iomanager.uringMultishotRecv")->set_val(multishot);
+    auto iom = std::make_shared<tiger::IOManager>("URING", true, 2);
+    iom->set_backend(tiger::IOManager::Backend::IO_URING);
+    std::atomic<size_t> finished{0};
+    std::atomic<size_t> echoed{0};
+    std::atomic<size_t> timeouts{0};
+    auto finish = [&]() {
+        if (++finished == CONN_CNT * 2)
+        {
+            iom->stop();
+        }
+    };
+    iom->schedule([&]() {
+        int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t addr_len = sizeof(addr);
+        if (bind(listen_fd, (sockaddr *)&addr, addr_len) || listen(listen_fd, CONN_CNT) ||
+            getsockname(listen_fd, (sockaddr *)&addr, &addr_len))
+        {
+            throw std::runtime_error("test_uring listen error");
+        }
+        for (size_t i = 0; i < CONN_CNT; ++i)
+        {
+            iom->schedule(
+                [&, addr]() {
+                    int fd = socket(AF_INET, SOCK_STREAM, 0);
+                    tiger::SingletonFDManager::Instance()->get_fd(fd)->set_recv_timeout(20);
+                    if (connect(fd, (const sockaddr *)&addr, sizeof(addr)))
+                    {
+                        throw std::runtime_error("test_uring connect error");
+                    }
+                    char buf[8];
+                    for (size_t r = 0; r < ROUND_CNT; ++r)
+                    {
+                        if (send(fd, "ping", 4, 0) != 4 || recv(fd, buf, sizeof(buf), 0) != 4 ||
+                            memcmp(buf, "ping", 4))
+                            break;
+                        ++echoed;
+                    }
+                    if (read(fd, buf, sizeof(buf)) == -1 && errno == ETIMEDOUT)
+                    {
+                        ++timeouts;
+                    }
+                    close(fd);
+                    finish();
+                },
+                iom->assign_thread());
+        }
+        for (size_t i = 0; i < CONN_CNT; ++i)
+        {
+            sockaddr_in peer;
+            socklen_t peer_len = sizeof(peer);
+            int fd = accept(listen_fd, (sockaddr *)&peer, &peer_len);
+            if (fd < 0 || peer.sin_addr.s_addr != htonl(INADDR_LOOPBACK))
+            {
+                throw std::runtime_error("test_uring accept error");
+            }
+            iom->schedule(
+                [&, fd]() {
+                    char buf[8];
+                    ssize_t n = 0;
+                    while ((n = read(fd, buf, sizeof(buf))) > 0)
+                    {
+                        write(fd, buf, n);
+                    }
+                    close(fd);
+                    finish();
+                },
+                iom->assign_thread());
+        }
+        close(listen_fd);
+    });
+    iom->start();
+    TIGER_LOG_D(tiger::TEST_LOG) << "[uring multishot:" << multishot << " backend:" << (int)iom->backend()
+                                 << " finished:" << finished << " echoed:" << echoed << " timeouts:" << timeouts << "]";
+    tiger::Config::Lookup<bool>("tiger.iomanager.uringMultishotRecv")->set_val(false);
+    if (finished != CONN_CNT * 2 || echoed != CONN_CNT * ROUND_CNT || timeouts != CONN_CNT)
+    {
+        throw std::runtime_error("test_uring error");
+    }
+}
+
+// io_uring后端上共享栈协程的阻塞读写，多个协程轮流使用同一块共享栈
+void test_uring_shared()
+{
+    static const size_t CONN_CNT = 8;
+    static const size_t ROUND_CNT = 100;
+    auto iom = std::make_shared<tiger::IOManager>("URING_SHARED", true, 1);
+    iom->set_backend(tiger::IOManager::Backend::IO_URING);
+    std::atomic<size_t> finished{0};
+    std::atomic<size_t> received{0};
+    auto finish = [&]() {
+        if (++finished == CONN_CNT * 2)
+        {
+            iom->stop();
+        }
+    };
+    iom->schedule([&]() {
+        for (size_t i = 0; i < CONN_CNT; ++i)
+        {
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+            {
+                throw std::runtime_error("test_uring_shared socketpair error");
+            }
+            tiger::SingletonFDManager::Instance()->get_fd(fds[0], true);
+            tiger::SingletonFDManager::Instance()->get_fd(fds[1], true);
+            iom->schedule_shared([&, fds, i]() {
+                char buf[8];
+                ssize_t n = 0;
+                while ((n = recv(fds[0], buf, sizeof(buf), 0)) > 0)
+                {
+                    // 栈被其他协程覆盖时会读到别的连接的数据
+                    received += std::count(buf, buf + n, (char)('a' + i));
+                }
+                close(fds[0]);
+                finish();
+            });
+            iom->schedule([&, fds, i]() {
+                char c = 'a' + i;
+                for (size_t r = 0; r < ROUND_CNT; ++r)
+                {
+                    // 每次让出后再写，读端总是先阻塞
+                    iom->schedule(tiger::Coroutine::GetRunningCo());
+                    tiger::Coroutine::Yield();
+                    if (send(fds[1], &c, 1, 0) != 1)
+                        break;
+                }
+                close(fds[1]);
+                finish();
+            });
+        }
+    });
+    iom->start();
+    TIGER_LOG_D(tiger::TEST_LOG) << "[uring_shared backend:" << (int)iom->backend() << " finished:" << finished
+                                 << " received:" << received << "]";
+    if (finished != CONN_CNT * 2 || received != CONN_CNT * ROUND_CNT)
+    {
+        throw std::runtime_error("test_uring_shared error");
+    }
+}
+
 int main()
 {
     tiger::SingletonLoggerMgr::Instance()->add_loggers("tiger", "../conf/tiger.yml");
@@ -65,5 +499,16 @@ int main()
     TIGER_LOG_D(tiger::TEST_LOG) << "[http_iomanager test start]";
     test_sleep();
     test_timer();
+    test_timer_wheel();
+    test_timer_us(false);
+    test_timer_us(true);
+    test_timer_slack(false);
+    test_timer_slack(true);
+    test_multi_reactor();
+    test_io_timeout_alloc(false);
+    test_io_timeout_alloc(true);
+    test_uring(false);
+    test_uring(true);
+    test_uring_shared();
     TIGER_LOG_D(tiger::TEST_LOG) << "[http_iomanager test end]";
 }
\ No newline at end of file
@@ -0,0 +1,185 @@
+/*****************************************************************
+ * Description
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/13
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#include "../src/macro.h"
+#include "../src/parallel.h"
+
+static const size_t ITEM_CNT = 100000;
+
+static void Check(bool ok, const std::string &name)
+{
+    if (ok)
+    {
+        TIGER_LOG_D(tiger::TEST_LOG) << name << " suc";
+        return;
+    }
+    TIGER_LOG_E(tiger::TEST_LOG) << name << " fail";
+    throw std::runtime_error(name + " error");
+}
+
+// 在调度器之外的线程中运行fn，调度器运行在主线程上，返回时工作线程都已退出
+static void RunInThread(tiger::Scheduler::ptr scheduler, std::function<void()> fn)
+{
+    tiger::Thread::ptr caller;
+    scheduler->schedule([&]() {
+        caller = std::make_shared<tiger::Thread>(
+            [&]() {
+                fn();
+                scheduler->stop();
+            },
+            "CALLER");
+    });
+    scheduler->start();
+    caller->join();
+}
+
+// 在线程中调用，等待时阻塞调用线程
+void test_parallel_for()
+{
+    auto scheduler = std::make_shared<tiger::Scheduler>("PARALLEL", true, 4);
+    std::vector<size_t> values(ITEM_CNT, 0);
+    RunInThread(scheduler, [&]() {
+        tiger::ParallelFor(scheduler.get(), 0, ITEM_CNT, 1000, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+            {
+                values[i] += i * 2;
+            }
+        });
+    });
+    bool ok = true;
+    for (size_t i = 0; i < ITEM_CNT; ++i)
+    {
+        ok = ok && values[i] == i * 2;
+    }
+    Check(ok, "test_parallel_for");
+}
+
+// 在协程中调用，嵌套并行也不会占住工作线程
+void test_parallel_reduce()
+{
+    auto scheduler = std::make_shared<tiger::Scheduler>("PARALLEL", true, 2);
+    size_t sum = 0;
+    size_t nested = 0;
+    scheduler->schedule([&]() {
+        auto map = [](size_t begin, size_t end) {
+            size_t s = 0;
+            for (size_t i = begin; i < end; ++i)
+            {
+                s += i;
+            }
+            return s;
+        };
+        auto reduce = [](size_t a, size_t b) { return a + b; };
+        sum = tiger::ParallelReduce(scheduler.get(), 0, ITEM_CNT + 1, 0, (size_t)0, map, reduce);
+        nested = tiger::ParallelReduce(
+            scheduler.get(), 0, 8, 1, (size_t)0,
+            [&](size_t begin, size_t end) {
+                return tiger::ParallelReduce(scheduler.get(), 0, 1000, 100, (size_t)0, map, reduce);
+            },
+            reduce);
+        scheduler->stop();
+    });
+    scheduler->start();
+    Check(sum == ITEM_CNT * (ITEM_CNT + 1) / 2 && nested == 8 * 999 * 1000 / 2, "test_parallel_reduce");
+}
+
+void test_parallel_invoke()
+{
+    auto scheduler = std::make_shared<tiger::Scheduler>("PARALLEL", true, 2);
+    std::atomic<int> mask{0};
+    bool caught = false;
+    RunInThread(scheduler, [&]() {
+        tiger::ParallelInvoke(
+            scheduler.get(), [&]() { mask |= 1; }, [&]() { mask |= 2; }, [&]() { mask |= 4; });
+        try
+        {
+            tiger::ParallelFor(scheduler.get(), 0, 16, 1, [](size_t begin, size_t end) {
+                if (begin == 7)
+                    throw std::logic_error("chunk error");
+            });
+        }
+        catch (const std::logic_error &e)
+        {
+            caught = true;
+        }
+    });
+    Check(mask == 7 && caught, "test_parallel_invoke");
+}
+
+// 调度器正在停止时任务不能入队，在调用方执行完，不会一直等待
+void test_parallel_stopping()
+{
+    auto scheduler = std::make_shared<tiger::Scheduler>("PARALLEL", true, 2);
+    size_t sum = 0;
+    scheduler->schedule([&]() {
+        scheduler->stop();
+        sum = tiger::ParallelReduce(
+            scheduler.get(), 0, 100, 10, (size_t)0,
+            [](size_t begin, size_t end) {
+                size_t s = 0;
+                for (size_t i = begin; i < end; ++i)
+                {
+                    s += i;
+                }
+                return s;
+            },
+            [](size_t a, size_t b) { return a + b; });
+    });
+    scheduler->start();
+    Check(sum == 99 * 100 / 2, "test_parallel_stopping");
+}
+
+// 在共享栈协程中调用，等待期间同一块共享栈上运行着其他调用方
+void test_parallel_shared()
+{
+    static const size_t CALLER_CNT = 8;
+    auto scheduler = std::make_shared<tiger::Scheduler>("PARALLEL", true, 2);
+    std::vector<size_t> sums(CALLER_CNT, 0);
+    std::atomic<size_t> finished{0};
+    for (size_t k = 0; k < CALLER_CNT; ++k)
+    {
+        scheduler->schedule_shared([&, k]() {
+            size_t base = k * 1000;
+            sums[k] = tiger::ParallelReduce(
+                scheduler.get(), 0, 1000, 50, (size_t)0,
+                [base](size_t begin, size_t end) {
+                    size_t s = 0;
+                    for (size_t i = begin; i < end; ++i)
+                    {
+                        s += base + i;
+                    }
+                    return s;
+                },
+                [](size_t a, size_t b) { return a + b; });
+            if (++finished == CALLER_CNT)
+            {
+                scheduler->stop();
+            }
+        });
+    }
+    scheduler->start();
+    bool ok = true;
+    for (size_t k = 0; k < CALLER_CNT; ++k)
+    {
+        ok = ok && sums[k] == k * 1000 * 1000 + 999 * 1000 / 2;
+    }
+    Check(ok, "test_parallel_shared");
+}
+
+int main()
+{
+    tiger::SingletonLoggerMgr::Instance()->add_loggers("tiger", "../conf/tiger.yml");
+    tiger::Thread::SetName("PARALLEL");
+    TIGER_LOG_D(tiger::TEST_LOG) << "[parallel test start]";
+    test_parallel_for();
+    test_parallel_reduce();
+    test_parallel_invoke();
+    test_parallel_stopping();
+    test_parallel_shared();
+    TIGER_LOG_D(tiger::TEST_LOG) << "[parallel test end]";
+    return 0;
+}
@@ -0,0 +1,459 @@
+/*****************************************************************
+ * Description
+ * Email huxiaoheigame@gmail.com
+ * Created on 2023/03/04
+ * Copyright (c) 2021 虎小黑
+ ****************************************************************/
+
+#include <unistd.h>
+
+#include "../src/config.h"
+#include "../src/macro.h"
+#include "../src/mutex.h"
+#include "../src/scheduler.h"
+#include "../src/watchdog.h"
+
+void test_pinned(bool work_stealing)
+{
+    static const size_t PINNED_CNT = 1000;
+    std::atomic<size_t> done{0};
+    std::atomic<size_t> wrong{0};
+    auto scheduler = std::make_shared<tiger::Scheduler>("PINNED", true, 4);
+    scheduler->set_work_stealing(work_stealing);
+    for (size_t i = 0; i < 4; ++i)
+    {
+        scheduler->schedule([scheduler, &done, &wrong]() {
+            pid_t thread_id = tiger::Thread::CurThreadId();
+            for (size_t j = 0; j < PINNED_CNT; ++j)
+            {
+                scheduler->schedule(
+                    [scheduler, thread_id, &done, &wrong]() {
+                        if (tiger::Thread::CurThreadId() != thread_id)
+                        {
+                            ++wrong;
+                        }
+                        if (++done == 4 * PINNED_CNT)
+                        {
+                            scheduler->stop();
+                        }
+                    },
+                    thread_id);
+            }
+        });
+    }
+    scheduler->start();
+    if (done == 4 * PINNED_CNT && wrong == 0)
+    {
+        TIGER_LOG_D(tiger::TEST_LOG) << "test_pinned suc work_stealing:" << work_stealing;
+    }
+    else
+    {
+        TIGER_LOG_E(tiger::TEST_LOG) << "test_pinned fail work_stealing:" << work_stealing << " done:" << done
+                                     << " wrong:" << wrong;
+        throw std::runtime_error("test_pinned error");
+    }
+}
+
+void test_inline(bool work_stealing)
+{
+    static const size_t INLINE_CNT = 1000;
+    std::atomic<size_t> done{0};
+    std::atomic<size_t> yielded{0};
+    auto scheduler = std::make_shared<tiger::Scheduler>("INLINE", true, 4);
+    scheduler->set_work_stealing(work_stealing);
+    for (size_t i = 0; i < INLINE_CNT; ++i)
+    {
+        scheduler->schedule_inline([scheduler, i, &done, &yielded]() {
+            if (i % 10 == 0)
+            {
+                // 回调中途让出，所在协程被提升后由调度器重新唤醒
+                // 指定当前线程，保证协程让出之后才会被再次resume
+                scheduler->schedule(tiger::Coroutine::GetRunningCo(), tiger::Thread::CurThreadId());
+                tiger::Coroutine::Yield();
+                ++yielded;
+            }
+            if (++done == INLINE_CNT)
+            {
+                scheduler->stop();
+            }
+        });
+    }
+    scheduler->start();
+    if (done == INLINE_CNT && yielded == INLINE_CNT / 10)
+    {
+        TIGER_LOG_D(tiger::TEST_LOG) << "test_inline suc work_stealing:" << work_stealing;
+    }
+    else
+    {
+        TIGER_LOG_E(tiger::TEST_LOG) << "test_inline fail work_stealing:" << work_stealing << " done:" << done
+                                     << " yielded:" << yielded;
+        throw std::runtime_error("test_inline error");
+    }
+}
+
+void test_shared(bool work_stealing)
+{
+    static const size_t SHARED_CNT = 100;
+    std::atomic<size_t> done{0};
+    std::atomic<size_t> wrong{0};
+    auto scheduler = std::make_shared<tiger::Scheduler>("SHARED", true, 4);
+    scheduler->set_work_stealing(work_stealing);
+    for (size_t i = 0; i < SHARED_CNT; ++i)
+    {
+        scheduler->schedule_shared([scheduler, &done, &wrong]() {
+            pid_t thread_id = tiger::Thread::CurThreadId();
+            for (size_t j = 0; j < 10; ++j)
+            {
+                // 重新调度时不指定线程，共享栈协程也必须回到原线程
+                scheduler->schedule(tiger::Coroutine::GetRunningCo());
+                tiger::Coroutine::Yield();
+                if (tiger::Thread::CurThreadId() != thread_id)
+                {
+                    ++wrong;
+                }
+            }
+            if (++done == SHARED_CNT)
+            {
+                scheduler->stop();
+            }
+        });
+    }
+    scheduler->start();
+    if (done == SHARED_CNT && wrong == 0)
+    {
+        TIGER_LOG_D(tiger::TEST_LOG) << "test_shared suc work_stealing:" << work_stealing;
+    }
+    else
+    {
+        TIGER_LOG_E(tiger::TEST_LOG) << "test_shared fail work_stealing:" << work_stealing << " done:" << done
+                                     << " wrong:" << wrong;
+        throw std::runtime_error("test_shared error");
+    }
+}
+
+void test_shared_foreign()
+{
+    std::atomic<bool> rejected{false};
+    std::atomic<bool> home{false};
+    tiger::Semaphore sem;
+    auto scheduler = std::make_shared<tiger::Scheduler>("SHARED_A", false, 1);
+    auto foreign = std::make_shared<tiger::Scheduler>("SHARED_B", false, 1);
+    scheduler->start();
+    foreign->start();
+    scheduler->schedule_shared([scheduler, foreign, &rejected, &home, &sem]() {
+        pid_t thread_id = tiger::Thread::CurThreadId();
+        // 共享栈协程投递到其他调度器找不到原线程，必须被拒绝而不是换线程执行
+        rejected = !foreign->schedule(tiger::Coroutine::GetRunningCo());
+        scheduler->schedule(tiger::Coroutine::GetRunningCo());
+        tiger::Coroutine::Yield();
+        home = tiger::Thread::CurThreadId() == thread_id;
+        sem.post();
+    });
+    sem.wait();
+    scheduler->stop();
+    foreign->stop();
+    if (rejected && home)
+    {
+        TIGER_LOG_D(tiger::TEST_LOG) << "test_shared_foreign suc";
+    }
+    else
+    {
+        TIGER_LOG_E(tiger::TEST_LOG) << "test_shared_foreign fail rejected:" << rejected << " home:" << home;
+        throw std::runtime_error("test_shared_foreign error");
+    }
+}
+
+void test_adaptive_stack()
+{
+    static const size_t TASK_CNT = 2048;
+    auto sample = tiger::Config::Lookup<uint32_t>("tiger.coroutine.stackPaintSample");
+    auto adaptive = tiger::Config::Lookup<bool>("tiger.scheduler.adaptiveStack");
+    sample->set_val(1);
+    adaptive->set_val(true);
+    std::atomic<size_t> done{0};
+    auto scheduler = std::make_shared<tiger::Scheduler>("ADAPTIVE", true, 2);
+    for (size_t i = 0; i < TASK_CNT; ++i)
+    {
+        scheduler->schedule([scheduler, &done]() {
+            if (++done == TASK_CNT)
+            {
+                scheduler->stop();
+            }
+        });
+    }
+    scheduler->start();
+    sample->set_val(0);
+    adaptive->set_val(false);
+    const auto &stats = scheduler->stack_stats();
+    size_t stack_size = scheduler->stack_size();
+    if (stats.count() < TASK_CNT || stack_size == 0 || stack_size >= tiger::Coroutine::DefaultStackSize() ||
+        stack_size < stats.percentile(0.99))
+    {
+        TIGER_LOG_E(tiger::TEST_LOG) << "test_adaptive_stack fail samples:" << stats.count()
+                                     << " stack_size:" << stack_size << " p99:" << stats.percentile(0.99);
+        throw std::runtime_error("test_adaptive_stack error");
+    }
+    TIGER_LOG_D(tiger::TEST_LOG) << "test_adaptive_stack suc samples:" << stats.count() << " p99:"
+                                 << stats.percentile(0.99) << " stack_size:" << stack_size;
+}
+
+// 单线程执行，检查出队顺序
+void test_priority(bool strict)
+{
+    typedef tiger::Scheduler::Priority Priority;
+    static const size_t CLASS_CNT = 40;
+    static const size_t TOTAL = CLASS_CNT * 3;
+    std::vector<int> order;
+    std::vector<time_t> deadlines;
+    auto scheduler = std::make_shared<tiger::Scheduler>("PRIORITY", true, 1);
+    scheduler->set_strict_priority(strict);
+    Priority classes[] = {Priority::LOW, Priority::NORMAL, Priority::HIGH};
+    for (size_t i = 0; i < CLASS_CNT; ++i)
+    {
+        for (auto priority : classes)
+        {
+            // 高优先级任务的截止时间倒序入队
+            time_t deadline = priority == Priority::HIGH ? (CLASS_CNT - i) * 1000 : 0;
+            scheduler->schedule(
+                [&, priority, deadline]() {
+                    order.push_back((int)priority);
+                    if (priority == Priority::HIGH)
+                        deadlines.push_back(deadline);
+                    if (order.size() == TOTAL)
+                        scheduler->stop();
+                },
+                priority, deadline);
+        }
+    }
+    scheduler->start();
+    bool ok = order.size() == TOTAL;
+    for (size_t i = 1; i < deadlines.size(); ++i)
+    {
+        ok = ok && deadlines[i - 1] < deadlines[i];
+    }
+    if (strict)
+    {
+        for (size_t i = 1; i < order.size(); ++i)
+        {
+            ok = ok && order[i - 1] <= order[i];
+        }
+    }
+    else
+    {
+        // 按8:4:1轮转，第一轮13个任务
+        size_t cnt[3] = {0, 0, 0};
+        for (size_t i = 0; i < 13; ++i)
+        {
+            ++cnt[order[i]];
+        }
+        ok = ok && cnt[0] == 8 && cnt[1] == 4 && cnt[2] == 1;
+    }
+    for (auto priority : classes)
+    {
+        ok = ok && scheduler->wait_stats(priority).count == CLASS_CNT;
+    }
+    auto high = scheduler->wait_stats(Priority::HIGH);
+    auto low = scheduler->wait_stats(Priority::LOW);
+    if (!ok)
+    {
+        TIGER_LOG_E(tiger::TEST_LOG) << "test_priority fail strict:" << strict << " executed:" << order.size();
+        throw std::runtime_error("test_priority error");
+    }
+    TIGER_LOG_D(tiger::TEST_LOG) << "test_priority suc strict:" << strict << " high_avg_wait:" << high.avg_us()
+                                 << "us low_avg_wait:" << low.avg_us() << "us";
+}
+
+// 运行过程中抓取快照，结束后检查计数与执行的任务一致
+void test_telemetry(bool work_stealing)
+{
+    static const size_t TASK_CNT = 1000;
+    std::atomic<size_t> done{0};
+    std::atomic<size_t> scraped{0};
+    auto scheduler = std::make_shared<tiger::Scheduler>("TELEMETRY", true, 2);
+    scheduler->set_work_stealing(work_stealing);
+    for (size_t i = 0; i < TASK_CNT; ++i)
+    {
+        scheduler->schedule([&]() {
+            if (++done % 100 == 0)
+            {
+                scraped += scheduler->telemetry().workers.size();
+            }
+            if (done == TASK_CNT)
+            {
+                scheduler->stop();
+            }
+        });
+    }
+    scheduler->start();
+    auto telemetry = scheduler->telemetry();
+    uint64_t task_cnt = 0;
+    for (auto &worker : telemetry.workers)
+    {
+        task_cnt += worker.task_cnt;
+    }
+    bool ok = scraped == TASK_CNT / 100 * 2 && telemetry.workers.size() == 2 && telemetry.task_cnt == TASK_CNT &&
+              task_cnt == TASK_CNT && telemetry.wait.count == TASK_CNT && telemetry.run.count == TASK_CNT &&
+              telemetry.switch_cnt >= TASK_CNT && telemetry.queue_depth == 0 &&
+              telemetry.wait.percentile(0.99) <= telemetry.wait.max &&
+              telemetry.run.percentile(0.5) <= telemetry.run.max;
+    if (!ok)
+    {
+        TIGER_LOG_E(tiger::TEST_LOG) << "test_telemetry fail work_stealing:" << work_stealing
+                                     << " tasks:" << telemetry.task_cnt << " waits:" << telemetry.wait.count
+                                     << " runs:" << telemetry.run.count << " switches:" << telemetry.switch_cnt;
+        throw std::runtime_error("test_telemetry error");
+    }
+    TIGER_LOG_D(tiger::TEST_LOG) << "test_telemetry suc work_stealing:" << work_stealing
+                                 << " wait_p99:" << telemetry.wait.percentile(0.99)
+                                 << "us run_p99:" << telemetry.run.percentile(0.99)
+                                 << "us steals:" << telemetry.steal_cnt << " tickles:" << telemetry.tickle_cnt
+                                 << " idle:" << telemetry.idle_us << "us";
+}
+
+// 一个协程忙等不让出，看门狗报告它并把指定在该线程的任务迁移走，它自己留在原线程继续运行
+void test_watchdog()
+{
+    static const size_t PINNED_CNT = 10;
+    static const uint64_t BUSY_US = 300 * 1000;
+    std::vector<tiger::Scheduler::StallReport> reports;
+    tiger::MutexLock mutex;
+    tiger::SingletonWatchdog::Instance()->set_callback([&](const tiger::Scheduler::StallReport &report) {
+        tiger::MutexLock::Lock lock(mutex);
+        reports.push_back(report);
+    });
+    std::atomic<size_t> migrated{0};
+    std::atomic<bool> busy{true};
+    std::atomic<bool> resumed{false};
+    auto scheduler = std::make_shared<tiger::Scheduler>("WATCHDOG", true, 2);
+    scheduler->set_watchdog(20, true);
+    scheduler->schedule([&]() {
+        tiger::Coroutine::GetRunningCo()->set_name("busy_loop");
+        pid_t thread_id = tiger::Thread::CurThreadId();
+        for (size_t i = 0; i < PINNED_CNT; ++i)
+        {
+            scheduler->schedule(
+                [&, thread_id]() {
+                    if (busy && tiger::Thread::CurThreadId() != thread_id)
+                        ++migrated;
+                },
+                thread_id);
+        }
+        // 让出之前已经在信箱中
+        scheduler->schedule(tiger::Coroutine::GetRunningCo(), thread_id);
+        uint64_t start = tiger::MonotonicMicrosecond();
+        while (tiger::MonotonicMicrosecond() - start < BUSY_US)
+        {
+        }
+        busy = false;
+        tiger::Coroutine::Yield();
+        resumed = tiger::Thread::CurThreadId() == thread_id;
+        scheduler->stop();
+    });
+    scheduler->start();
+    tiger::SingletonWatchdog::Instance()->set_callback(nullptr);
+    tiger::MutexLock::Lock lock(mutex);
+    bool ok = reports.size() == 1 && migrated == PINNED_CNT && resumed;
+    if (ok)
+    {
+        auto &report = reports[0];
+        ok = report.scheduler == "WATCHDOG" && report.co_name == "busy_loop" && !report.backtrace.empty() &&
+             report.migrated == PINNED_CNT && report.running_us >= 20 * 1000;
+    }
+    if (!ok)
+    {
+        TIGER_LOG_E(tiger::TEST_LOG) << "test_watchdog fail reports:" << reports.size() << " migrated:" << migrated
+                                     << " resumed:" << resumed;
+        throw std::runtime_error("test_watchdog error");
+    }
+    tiger::Watchdog::Log(reports[0]);
+    TIGER_LOG_D(tiger::TEST_LOG) << "test_watchdog suc running:" << reports[0].running_us
+                                 << "us frames:" << reports[0].backtrace.size();
+}
+
+// 检查创建的线程按绑定方式设置了亲和性，调用start的线程不绑定
+void test_cpu_affinity(tiger::Scheduler::CpuLayout layout, const std::vector<int> &cpus)
+{
+    static const size_t THREAD_CNT = 2;
+    auto scheduler = std::make_shared<tiger::Scheduler>("AFFINITY", true, THREAD_CNT + 1);
+    scheduler->set_cpu_layout(layout);
+    scheduler->set_cpu_affinity(cpus);
+    tiger::MutexLock mutex;
+    std::vector<std::vector<int>> affinities;
+    scheduler->schedule([&]() {
+        pid_t main_thread_id = tiger::Thread::CurThreadId();
+        std::vector<pid_t> thread_ids;
+        while (thread_ids.size() < THREAD_CNT)
+        {
+            thread_ids.clear();
+            for (auto &worker : scheduler->telemetry().workers)
+            {
+                if (worker.thread_id != 0 && worker.thread_id != main_thread_id)
+                    thread_ids.push_back(worker.thread_id);
+            }
+            usleep(1000);
+        }
+        for (auto thread_id : thread_ids)
+        {
+            scheduler->schedule(
+                [&]() {
+                    tiger::MutexLock::Lock lock(mutex);
+                    affinities.push_back(tiger::Thread::CurAffinity());
+                    if (affinities.size() == THREAD_CNT)
+                        scheduler->stop();
+                },
+                thread_id);
+        }
+    });
+    scheduler->start();
+    bool ok = affinities.size() == THREAD_CNT;
+    for (auto &affinity : affinities)
+    {
+        if (!cpus.empty())
+        {
+            ok = ok && affinity.size() == 1 && affinity[0] == cpus[0];
+        }
+        else if (layout == tiger::Scheduler::CpuLayout::CORE)
+        {
+            ok = ok && affinity.size() == 1;
+        }
+        else if (layout == tiger::Scheduler::CpuLayout::NUMA)
+        {
+            int node = affinity.empty() ? -1 : tiger::CpuTopology::NodeOf(affinity[0]);
+            ok = ok && node >= 0 && affinity == tiger::CpuTopology::NodeCpus(node);
+        }
+    }
+    if (!ok)
+    {
+        TIGER_LOG_E(tiger::TEST_LOG) << "test_cpu_affinity fail layout:" << (int)layout << " cpus:" << cpus.size()
+                                     << " threads:" << affinities.size();
+        throw std::runtime_error("test_cpu_affinity error");
+    }
+    TIGER_LOG_D(tiger::TEST_LOG) << "test_cpu_affinity suc layout:" << (int)layout << " cpus:" << cpus.size()
+                                 << " nodes:" << tiger::CpuTopology::NodeCnt()
+                                 << " online:" << tiger::CpuTopology::Cpus().size();
+}
+
+int main()
+{
+    tiger::SingletonLoggerMgr::Instance()->add_loggers("tiger", "../conf/tiger.yml");
+    tiger::Thread::SetName("SCHEDULER");
+    TIGER_LOG_D(tiger::TEST_LOG) << "[scheduler test start]";
+    test_pinned(false);
+    test_pinned(true);
+    test_inline(false);
+    test_inline(true);
+    test_shared(false);
+    test_shared(true);
+    test_shared_foreign();
+    test_adaptive_stack();
+    test_priority(true);
+    test_priority(false);
+    test_telemetry(false);
+    test_telemetry(true);
+    test_watchdog();
+    test_cpu_affinity(tiger::Scheduler::CpuLayout::CORE, {});
+    test_cpu_affinity(tiger::Scheduler::CpuLayout::NUMA, {});
+    test_cpu_affinity(tiger::Scheduler::CpuLayout::NONE, {tiger::CpuTopology::Cpus().back().id});
+    TIGER_LOG_D(tiger::TEST_LOG) << "[scheduler test end]";
+    return 0;
+}